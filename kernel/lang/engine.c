@@ -22,12 +22,14 @@
  ****************************************************************/
 
 #include <lang/engine.h>
+#include <lang/filter.h>
 #include <lang/headers.h>
 #include <lang/symtable.h>
 #include <lang/signature.h>
 #include <lang/module.h>
 
 #include <pfq/global.h>
+#include <pfq/group.h>
 #include <pfq/printk.h>
 
 
@@ -153,10 +155,35 @@ pfq_lang_run(struct qbuff * buff, struct pfq_lang_computation_tree *prg)
 }
 
 
+/* run the computation, evaluating the shared prefix once per packet */
+
+ActionQbuff
+pfq_lang_run_shared(struct qbuff * buff, struct pfq_lang_computation_tree *prg, struct pfq_group_shared *sh)
+{
+	struct pfq_lang_functional *fun = &prg->entry_point->fun;
+	size_t n;
+
+	for(n = 0; n < prg->prefix_len; n++, fun = fun->next)
+	{
+		int pass = pfq_group_shared_lookup(sh, prg->prefix_key[n]);
+		if (pass < 0) {
+			buff = ((function_ptr_t)fun->run)(fun, buff).qbuff;
+			pass = !is_drop(buff->monad->fanout);
+			pfq_group_shared_store(sh, prg->prefix_key[n], pass);
+		}
+
+		if (!pass)
+			return Drop(buff);
+	}
+
+	return fun ? EVAL_FUNCTION((function_t){fun}, buff) : Pass(buff);
+}
+
+
 struct pfq_lang_computation_tree *
 pfq_lang_computation_alloc (struct pfq_lang_computation_descr const *descr)
 {
-        struct pfq_lang_computation_tree * c = kzalloc(sizeof(size_t) + descr->size * sizeof(struct pfq_lang_functional_node),
+        struct pfq_lang_computation_tree * c = kzalloc(sizeof(struct pfq_lang_computation_tree) + descr->size * sizeof(struct pfq_lang_functional_node),
 						  GFP_KERNEL);
 	if (c)
 		c->size = descr->size;
@@ -474,6 +501,21 @@ get_functional_node_by_index(struct pfq_lang_computation_descr const *descr, str
 }
 
 
+static bool
+has_scalar_args(struct pfq_lang_functional_descr const *fun)
+{
+	size_t i;
+
+	for(i = 0; i < sizeof(fun->arg)/sizeof(fun->arg[0]); i++)
+	{
+		if (!is_arg_null(&fun->arg[i]) &&
+		    !(is_arg_data(&fun->arg[i]) && fun->arg[i].size <= 8))
+			return false;
+	}
+	return true;
+}
+
+
 /*
  * Prerequisite: valid computation (check by means of pfq_lang_validate_computation_descr)
  */
@@ -481,6 +523,7 @@ get_functional_node_by_index(struct pfq_lang_computation_descr const *descr, str
 int
 pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, struct pfq_lang_computation_tree *comp, void *context)
 {
+	struct pfq_lang_functional_node *next;
 	size_t n;
 
         /* size */
@@ -496,7 +539,6 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
         for(n = 0; n < descr->size; n++)
         {
 		struct pfq_lang_functional_descr const *fun;
-		struct pfq_lang_functional_node *next;
 		const char *signature;
 		init_ptr_t init, fini;
 		void *addr;
@@ -621,6 +663,17 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 				return -EPERM;
 			}
 		}
+
+		comp->node[n].shareable = pfq_lang_is_filter(addr) && has_scalar_args(fun);
+	}
+
+	/* leading filters: their keys are assigned by the group */
+
+	comp->prefix_len = 0;
+	for(next = comp->entry_point; next && next->shareable && comp->prefix_len < Q_LANG_MAX_PREFIX; )
+	{
+		comp->prefix_key[comp->prefix_len++] = 0;
+		next = next->fun.next ? container_of(next->fun.next, struct pfq_lang_functional_node, fun) : NULL;
 	}
 
 	return 0;
@@ -78,5 +78,8 @@ extern char * strdup_user(const char __user *str);
 
 extern ActionQbuff pfq_lang_run(struct qbuff *, struct pfq_lang_computation_tree *prg);
 
+struct pfq_group_shared;
+extern ActionQbuff pfq_lang_run_shared(struct qbuff *, struct pfq_lang_computation_tree *prg, struct pfq_group_shared *sh);
+
 
 #endif /* PFQ_LANG_ENGINE_H */
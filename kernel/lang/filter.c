@@ -163,6 +163,7 @@ struct pfq_lang_function_descr filter_functions[] = {
 
         { "unit",	  "Qbuff -> Action Qbuff",	unit		     , NULL, NULL   },
         { "ip",           "Qbuff -> Action Qbuff",	filter_ip	     , NULL, NULL   },
+        { "ip6",          "Qbuff -> Action Qbuff",	filter_ip6	     , NULL, NULL   },
         { "udp",          "Qbuff -> Action Qbuff",	filter_udp	     , NULL, NULL   },
         { "tcp",          "Qbuff -> Action Qbuff",	filter_tcp	     , NULL, NULL   },
         { "icmp",         "Qbuff -> Action Qbuff",	filter_icmp	     , NULL, NULL   },
@@ -192,3 +193,18 @@ struct pfq_lang_function_descr filter_functions[] = {
 
         { NULL }};
 
+
+/* the filters above depend on the packet only: their results can be shared */
+
+bool
+pfq_lang_is_filter(void *run)
+{
+	struct pfq_lang_function_descr const *f;
+
+	for(f = filter_functions; f->symbol; f++)
+	{
+		if (f->ptr == run)
+			return true;
+	}
+	return false;
+}
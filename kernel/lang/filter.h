@@ -28,12 +28,21 @@
 #include <lang/predicate.h>
 
 
+extern bool pfq_lang_is_filter(void *run);
+
+
 static inline ActionQbuff
 filter_ip(arguments_t args, struct qbuff * b)
 {
         return is_ip(b) ? Pass(b) : Drop(b);
 }
 
+static inline ActionQbuff
+filter_ip6(arguments_t args, struct qbuff * b)
+{
+        return is_ip6(b) ? Pass(b) : Drop(b);
+}
+
 static inline ActionQbuff
 filter_udp(arguments_t args, struct qbuff * b)
 {
@@ -23,7 +23,9 @@
 
 #include <lang/forward.h>
 
+#include <pfq/class_table.h>
 #include <pfq/global.h>
+#include <pfq/group.h>
 #include <pfq/percpu.h>
 #include <pfq/netdev.h>
 #include <pfq/io.h>
@@ -266,11 +268,53 @@ detour_if_kernel(arguments_t args, struct qbuff * b)
 }
 
 
+static int
+class_table_init(arguments_t args)
+{
+	const int table = GET_ARG_0(int, args);
+	if (table < 0 || table >= Q_CLASS_TABLES) {
+                printk(KERN_INFO "[PFQ|init] class_table: %d invalid table!\n", table);
+                return -EINVAL;
+	}
+	return 0;
+}
+
+
+/* the class is looked up by key in the group table (updated by the user),
+ * the packet is dropped if the key is not found.
+ */
+
+static ActionQbuff
+class_table(arguments_t args, struct qbuff * b)
+{
+	const int table = GET_ARG_0(int, args);
+	property_t p = GET_ARG_1(property_t, args);
+	struct pfq_class_table *t;
+	uint64_t key;
+	int c;
+
+	t = (struct pfq_class_table *)atomic_long_read(&b->monad->group->class_table[table]);
+	if (t == NULL)
+		return Drop(b);
+
+	key = EVAL_PROPERTY(p, b);
+	if (IS_NOTHING(key))
+		return Drop(b);
+
+	c = pfq_class_table_lookup(t, FROM_JUST(uint64_t, key));
+	if (c < 0)
+		return Drop(b);
+
+	return Pass(class(b, Q_CLASS(c)));
+}
+
+
 struct pfq_lang_function_descr forward_functions[] = {
 
         { "drop",       "Qbuff -> Action Qbuff",		forward_drop	   , NULL, NULL     },
         { "broadcast",  "Qbuff -> Action Qbuff",		forward_broadcast  , NULL, NULL     },
         { "classify",	"CInt -> Qbuff -> Action Qbuff",	forward_class	   , NULL, NULL     },
+        { "class_table","CInt -> (Qbuff -> Word64) -> Qbuff -> Action Qbuff", class_table, class_table_init, NULL },
         { "kernel",	"Qbuff -> Action Qbuff",		forward_kernel	   , NULL, NULL     },
         { "detour",	"Qbuff -> Action Qbuff",		detour_kernel	   , NULL, NULL     },
 
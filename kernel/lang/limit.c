@@ -0,0 +1,259 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+
+#include <linux/kernel.h>
+#include <linux/hash.h>
+#include <linux/jiffies.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/printk.h>
+#include <pfq/stats.h>
+
+
+/* token buckets are per-cpu: the rate is evenly split among the cpus online
+ * when the computation is loaded, and each bucket is refilled lazily, at the
+ * jiffy resolution. Tokens are scaled by HZ and by the number of cpus (a
+ * packet, or a bit, costs HZ * cpus tokens, and each bucket gains rate tokens
+ * per jiffy) so that neither low rates nor the split are truncated. A bucket
+ * holds up to Q_LIMIT_BURST jiffies worth of tokens.
+ *
+ * Cpus brought online later get a share as well: the aggregate rate exceeds
+ * the given one until the computation is loaded again.
+ */
+
+#define Q_LIMIT_BURST		(HZ/100 ?: 1)
+#define Q_LIMIT_MAX_FRAME	65536		/* GRO/GSO packets included */
+
+
+struct pfq_token_bucket
+{
+	uint64_t	tokens;
+	unsigned long	last;
+};
+
+
+static inline void
+count_drop(arguments_t args, struct qbuff * buff)
+{
+	const int idx = GET_ARG_1(int, args);
+	if (idx >= 0)
+		local_inc(&get_group_counters(buff)->value[idx]);
+}
+
+
+static int
+check_counter(const char *name, int idx)
+{
+	if (idx >= Q_MAX_COUNTERS) {
+		printk(KERN_INFO "[PFQ|init] %s: counter[%d]: bad index!\n", name, idx);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+
+static int
+limit_init(const char *name, arguments_t args, uint64_t cost)
+{
+	const uint64_t rate = GET_ARG_0(uint64_t, args);
+	struct pfq_token_bucket __percpu *buckets;
+	uint64_t capacity;
+	int cpu, cpus;
+
+	if (rate == 0) {
+		printk(KERN_INFO "[PFQ|init] %s: rate must be > 0!\n", name);
+		return -EINVAL;
+	}
+
+	if (check_counter(name, GET_ARG_1(int, args)) < 0)
+		return -EINVAL;
+
+	cpus = (int)num_online_cpus();
+	capacity = rate * Q_LIMIT_BURST + cost * (uint64_t)cpus;
+
+	buckets = alloc_percpu(struct pfq_token_bucket);
+	if (!buckets) {
+		printk(KERN_INFO "[PFQ|init] %s: out of memory!\n", name);
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu)
+	{
+		struct pfq_token_bucket *b = per_cpu_ptr(buckets, cpu);
+		b->tokens = capacity;
+		b->last = jiffies;
+	}
+
+	SET_ARG_2(args, buckets);
+	SET_ARG_4(args, capacity);
+	SET_ARG_5(args, cpus);
+
+	pr_devel("[PFQ|init] %s: rate:%llu (split among %d cpus) capacity:%llu\n", name,
+		 (unsigned long long)rate, cpus, (unsigned long long)capacity);
+	return 0;
+}
+
+
+static int limit_pps_init(arguments_t args)
+{
+	return limit_init("limit_pps", args, HZ);
+}
+
+
+static int limit_bps_init(arguments_t args)
+{
+	return limit_init("limit_bps", args, (uint64_t)Q_LIMIT_MAX_FRAME * 8 * HZ);
+}
+
+
+static int limit_fini(arguments_t args)
+{
+	struct pfq_token_bucket __percpu *buckets = GET_ARG_2(struct pfq_token_bucket __percpu *, args);
+
+	free_percpu(buckets);
+	return 0;
+}
+
+
+/* take the tokens from the bucket of this cpu (the cost is scaled by the
+ * number of cpus here), false if not available */
+
+static inline bool
+token_bucket_take(arguments_t args, uint64_t cost)
+{
+	struct pfq_token_bucket *b = this_cpu_ptr(GET_ARG_2(struct pfq_token_bucket __percpu *, args));
+	const uint64_t rate = GET_ARG_0(uint64_t, args);
+	const uint64_t capacity = GET_ARG_4(uint64_t, args);
+	const int cpus = GET_ARG_5(int, args);
+	unsigned long now = jiffies;
+
+	cost *= (uint64_t)cpus;
+
+	if (now != b->last) {
+		unsigned long delta = min_t(unsigned long, now - b->last, Q_LIMIT_BURST);
+		b->tokens = min_t(uint64_t, b->tokens + delta * rate, capacity);
+		b->last = now;
+	}
+
+	if (b->tokens < cost)
+		return false;
+
+	b->tokens -= cost;
+	return true;
+}
+
+
+static ActionQbuff
+limit_pps(arguments_t args, struct qbuff * buff)
+{
+	if (token_bucket_take(args, HZ))
+		return Pass(buff);
+
+	count_drop(args, buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+limit_bps(arguments_t args, struct qbuff * buff)
+{
+	if (token_bucket_take(args, (uint64_t)qbuff_len(buff) * 8 * HZ))
+		return Pass(buff);
+
+	count_drop(args, buff);
+	return Drop(buff);
+}
+
+
+/* sampling: 1-in-N packets (by the per-cpu packet counter), or 1-in-N flows */
+
+static int sample_init(arguments_t args)
+{
+	const int n = GET_ARG_0(int, args);
+
+	if (n <= 0) {
+		printk(KERN_INFO "[PFQ|init] sample: %d bad ratio!\n", n);
+		return -EINVAL;
+	}
+
+	return check_counter("sample", GET_ARG_1(int, args));
+}
+
+
+static ActionQbuff
+sample(arguments_t args, struct qbuff * buff)
+{
+	const int n = GET_ARG_0(int, args);
+
+	if ((buff->counter % (unsigned int)n) == 0)
+		return Pass(buff);
+
+	count_drop(args, buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+sample_hash(arguments_t args, struct qbuff * buff)
+{
+	const int n = GET_ARG_0(int, args);
+	struct qbuff_flow flow;
+	uint32_t hash;
+
+	/* packets of the same flow (in both directions) share the fate, non-IP
+	 * packets are sampled by counter. IP fragments are sampled on the
+	 * addresses and protocol only (qbuff_flow_hash would hash them by id):
+	 * the fragments of a flow share the fate, that of the unfragmented
+	 * packets of the same flow may differ.
+	 */
+
+	if (!qbuff_ip_flow(buff, &flow))
+		hash = buff->counter;
+	else if (flow.frag & (IP_MF|IP_OFFSET))
+		hash = hash_32((__force uint32_t)(flow.saddr ^ flow.daddr) ^ (uint32_t)flow.proto, 32);
+	else
+		hash = hash_32(qbuff_flow_hash(&flow), 32);
+
+	if ((hash % (unsigned int)n) == 0)
+		return Pass(buff);
+
+	count_drop(args, buff);
+	return Drop(buff);
+}
+
+
+struct pfq_lang_function_descr limit_functions[] = {
+
+	{ "limit_pps",	 "Word64 -> CInt -> Qbuff -> Action Qbuff", limit_pps,   limit_pps_init, limit_fini },
+	{ "limit_bps",	 "Word64 -> CInt -> Qbuff -> Action Qbuff", limit_bps,   limit_bps_init, limit_fini },
+	{ "sample",	 "CInt -> CInt -> Qbuff -> Action Qbuff",   sample,	 sample_init,	 NULL },
+	{ "sample_hash", "CInt -> CInt -> Qbuff -> Action Qbuff",   sample_hash, sample_init,	 NULL },
+
+	{ NULL }};
@@ -64,6 +64,83 @@ dec_counter(arguments_t args, struct qbuff * buff)
 }
 
 
+/* a snap length of 0 in the monad means no limit: snap requires 1 byte at least */
+
+static int
+snap_init(arguments_t args)
+{
+        const int len = GET_ARG(int, args);
+
+	if (len < 1 || len > 0xffff) {
+                printk(KERN_INFO "[PFQ|init] snap: %d bad length!\n", len);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+
+static int
+snap_l4_init(arguments_t args)
+{
+        const int len = GET_ARG(int, args);
+
+	if (len < 0 || len > 0xffff) {
+                printk(KERN_INFO "[PFQ|init] snap_l4: %d bad length!\n", len);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+
+static ActionQbuff
+snap(arguments_t args, struct qbuff * buff)
+{
+        const int len = GET_ARG(int, args);
+
+	return Pass(snap_len(buff, (unsigned int)len));
+}
+
+
+/* headers up to the transport layer, plus len bytes of payload.
+ * Packets that are not IP are not truncated.
+ */
+
+static ActionQbuff
+snap_l4(arguments_t args, struct qbuff * buff)
+{
+        const int len = GET_ARG(int, args);
+	uint16_t frag;
+	int proto, off, hlen = 0;
+
+	off = qbuff_l4_offset(buff, &proto, &frag);
+	if (off < 0)
+		return Pass(buff);
+
+	off += buff->monad->ipoff;
+
+	if (!(frag & IP_OFFSET)) {
+		switch(proto)
+		{
+		case IPPROTO_TCP: {
+			struct tcphdr _tcph;
+			const struct tcphdr *tcp;
+			tcp = qbuff_header_pointer(buff, off, sizeof(_tcph), &_tcph);
+			hlen = tcp ? tcp->doff << 2 : 0;
+		} break;
+		case IPPROTO_UDP:
+			hlen = sizeof(struct udphdr);
+			break;
+		case IPPROTO_ICMP:
+		case IPPROTO_ICMPV6:
+			hlen = sizeof(struct icmphdr);
+			break;
+		}
+	}
+
+	return Pass(snap_len(buff, (unsigned int)(off + hlen + len)));
+}
+
+
 static ActionQbuff
 log_msg(arguments_t args, struct qbuff * buff)
 {
@@ -191,7 +268,7 @@ trace(arguments_t args, struct qbuff * buff)
 					, buff->to_kernel
 					);
 
-		printk(KERN_INFO "[pfq-lang]     MONAD: state:%u fanout:{cl=%lx h1=%u h2=%u tp=%u} shift:%d ipoff:%d ipproto:%d ep_ctx:%d\n"
+		printk(KERN_INFO "[pfq-lang]     MONAD: state:%u fanout:{cl=%lx h1=%u h2=%u tp=%u} shift:%d ipoff:%d ipproto:%d ep_ctx:%d snaplen:%u\n"
 					, mon->state
 					, mon->fanout.class_mask
 					, mon->fanout.hash
@@ -201,6 +278,7 @@ trace(arguments_t args, struct qbuff * buff)
 					, mon->ipoff
 					, mon->ipproto
 					, mon->ep_ctx
+					, mon->snaplen
 					);
 
 	}
@@ -214,6 +292,8 @@ struct pfq_lang_function_descr misc_functions[] = {
         { "dec",	"CInt    -> Qbuff -> Action Qbuff",	dec_counter, NULL, NULL	},
 	{ "mark",	"Word32  -> Qbuff -> Action Qbuff",	mark	   , NULL, NULL },
 	{ "put_state",	"Word32  -> Qbuff -> Action Qbuff",	put_state  , NULL, NULL },
+	{ "snap",	"CInt    -> Qbuff -> Action Qbuff",	snap	   , snap_init, NULL },
+	{ "snap_l4",	"CInt    -> Qbuff -> Action Qbuff",	snap_l4	   , snap_l4_init, NULL },
 
         { "log_msg",	"String -> Qbuff -> Action Qbuff",	log_msg	   , NULL, NULL },
         { "log_buff",   "Qbuff -> Action Qbuff",		log_buff   , NULL, NULL },
@@ -156,12 +156,21 @@ struct pfq_lang_functional_node
 	fini_ptr_t	      fini;
 
 	bool		      initialized;
+	bool		      shareable;	/* pure filter with scalar arguments */
 };
 
 
+/* leading filters of a computation whose results can be shared
+ * with the other groups (see pfq_group_shared)
+ */
+
+#define Q_LANG_MAX_PREFIX	4
+
 struct pfq_lang_computation_tree
 {
 	size_t size;
+	size_t prefix_len;
+	unsigned long prefix_key[Q_LANG_MAX_PREFIX];	/* equal keys <-> equal prefixes */
 	struct pfq_lang_functional_node *entry_point;
 	struct pfq_lang_functional_node node[];
 };
@@ -77,6 +77,7 @@ struct pfq_lang_monad
 	int			ipoff;
         int			ipproto;
         int			ep_ctx;		/* endpoint context */
+        unsigned int		snaplen;	/* bytes copied to the sockets of the group, 0 = no limit */
 };
 
 /* Fanout constructors */
@@ -145,6 +146,14 @@ class(struct qbuff * buff, uint64_t class_mask)
         return buff;
 }
 
+static inline
+struct qbuff *
+snap_len(struct qbuff * buff, unsigned int len)
+{
+        buff->monad->snaplen = len;
+        return buff;
+}
+
 static inline
 struct qbuff *
 to_kernel(struct qbuff * buff)
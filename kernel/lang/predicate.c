@@ -33,6 +33,12 @@ pred_is_ip(arguments_t args, struct qbuff * b)
         return  is_ip(b);
 }
 
+static bool
+pred_is_ip6(arguments_t args, struct qbuff * b)
+{
+        return  is_ip6(b);
+}
+
 static bool
 pred_is_udp(arguments_t args, struct qbuff * b)
 {
@@ -217,6 +223,7 @@ struct pfq_lang_function_descr predicate_functions[] = {
         { "all_bit",	"(Qbuff -> Word64) -> Word64 -> Qbuff -> Bool", all_bit	   , NULL, NULL },
 
         { "is_ip",	   "Qbuff -> Bool", pred_is_ip	       , NULL, NULL },
+        { "is_ip6",	   "Qbuff -> Bool", pred_is_ip6	       , NULL, NULL },
         { "is_tcp",        "Qbuff -> Bool", pred_is_tcp	       , NULL, NULL },
         { "is_udp",        "Qbuff -> Bool", pred_is_udp	       , NULL, NULL },
         { "is_icmp",       "Qbuff -> Bool", pred_is_icmp       , NULL, NULL },
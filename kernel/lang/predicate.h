@@ -166,53 +166,47 @@ is_ip(struct qbuff * buff)
 }
 
 static inline bool
-is_udp(struct qbuff * buff)
+is_ip6(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
+	if (qbuff_ip_version(buff) == 6)
+		return true;
+        return false;
+}
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-                return false;
 
-	if (ip->protocol != IPPROTO_UDP)
-                return false;
+static inline bool
+is_l4(struct qbuff * buff, int protocol, int len)
+{
+	char _l4h[sizeof(struct tcphdr)];
 
-        return qbuff_header_available(buff, (int)qbuff_maclen(buff)  + (ip->ihl<<2), sizeof(struct udphdr));
+	return qbuff_l4_header_pointer(buff, protocol, 0, len, _l4h) != NULL;
 }
 
 
 static inline bool
-is_tcp(struct qbuff * buff)
+is_udp(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-                return false;
+	return is_l4(buff, IPPROTO_UDP, sizeof(struct udphdr));
+}
 
-	if (ip->protocol != IPPROTO_TCP)
-                return false;
 
-	return qbuff_header_available(buff, (int)qbuff_maclen(buff) + (ip->ihl<<2), sizeof(struct tcphdr));
+static inline bool
+is_tcp(struct qbuff * buff)
+{
+	return is_l4(buff, IPPROTO_TCP, sizeof(struct tcphdr));
 }
 
 
 static inline bool
 is_icmp(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-                return false;
-
-	if (ip->protocol != IPPROTO_ICMP)
-                return false;
+	switch(qbuff_ip_version(buff))
+	{
+	case 4: return is_l4(buff, IPPROTO_ICMP, sizeof(struct icmphdr));
+	case 6: return is_l4(buff, IPPROTO_ICMPV6, sizeof(struct icmp6hdr));
+	}
 
-	return qbuff_header_available(buff, (int)qbuff_maclen(buff) + (ip->ihl<<2), sizeof(struct icmphdr));
+	return false;
 }
 
 
@@ -263,19 +257,7 @@ has_dst_addr(struct qbuff * buff, __be32 addr, __be32 mask)
 static inline bool
 is_flow(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return false;
-
-	if (ip->protocol != IPPROTO_UDP &&
-	    ip->protocol != IPPROTO_TCP)
-                return false;
-
-	return qbuff_header_available(buff, (int)qbuff_maclen(buff) + (ip->ihl<<2), ip->protocol == IPPROTO_UDP ?
-				    sizeof(struct udphdr) : sizeof(struct tcphdr));
+	return is_udp(buff) || is_tcp(buff);
 }
 
 
@@ -289,120 +271,71 @@ is_l3_proto(struct qbuff * buff, uint16_t type)
 static inline bool
 is_l4_proto(struct qbuff * buff, uint8_t protocol)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
+	int proto;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
+	if (qbuff_l4_offset(buff, &proto, NULL) < 0)
 		return false;
 
-        return ip->protocol == protocol;
+        return proto == protocol;
 }
 
 
 static inline bool
 is_frag(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
+	uint16_t frag; int proto;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
+	if (qbuff_l4_offset(buff, &proto, &frag) < 0)
 		return false;
 
-        return (ip->frag_off & __constant_htons(IP_MF|IP_OFFSET)) != 0;
+        return (frag & (IP_MF|IP_OFFSET)) != 0;
 }
 
 static inline bool
 is_first_frag(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
+	uint16_t frag; int proto;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
+	if (qbuff_l4_offset(buff, &proto, &frag) < 0)
 		return false;
 
-        return (ip->frag_off & __constant_htons(IP_MF|IP_OFFSET)) == __constant_htons(IP_MF);
+        return (frag & (IP_MF|IP_OFFSET)) == IP_MF;
 }
 
 static inline bool
 is_more_frag(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
+	uint16_t frag; int proto;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
+	if (qbuff_l4_offset(buff, &proto, &frag) < 0)
 		return false;
 
-	return (ip->frag_off & __constant_htons(IP_OFFSET)) != 0;
+	return (frag & IP_OFFSET) != 0;
 }
 
+
+/* UDP and TCP share the layout of the port fields */
+
 static inline bool
 has_src_port(struct qbuff * buff, uint16_t port)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
+	struct qbuff_flow flow;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
+	if (!is_flow(buff) || !qbuff_ip_flow(buff, &flow))
 		return false;
 
-	switch(ip->protocol)
-	{
-	case IPPROTO_UDP: {
-		struct udphdr _udph; const struct udphdr *udp;
-		udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct udphdr), &_udph);
-		if (udp == NULL)
-			return false;
-
-		return udp->source == cpu_to_be16(port);
-	}
-	case IPPROTO_TCP: {
-		struct tcphdr _tcph; const struct tcphdr *tcp;
-		tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct tcphdr), &_tcph);
-		if (tcp == NULL)
-			return false;
-
-		return tcp->source == cpu_to_be16(port);
-	}
-	}
-
-	return false;
+	return flow.sport == cpu_to_be16(port);
 }
 
 static inline bool
 has_dst_port(struct qbuff * buff, uint16_t port)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
+	struct qbuff_flow flow;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
+	if (!is_flow(buff) || !qbuff_ip_flow(buff, &flow))
 		return false;
 
-	switch(ip->protocol)
-	{
-	case IPPROTO_UDP: {
-		struct udphdr _udph; const struct udphdr *udp;
-		udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct udphdr), &_udph);
-		if (udp == NULL)
-			return false;
-
-		return udp->dest == cpu_to_be16(port);
-	}
-	case IPPROTO_TCP: {
-		struct tcphdr _tcph; const struct tcphdr *tcp;
-		tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct tcphdr), &_tcph);
-		if (tcp == NULL)
-			return false;
-
-		return tcp->dest == cpu_to_be16(port);
-	}
-	}
-
-	return false;
+	return flow.dport == cpu_to_be16(port);
 }
 
 
@@ -471,8 +404,15 @@ is_ip_multicast(struct qbuff * buff)
 {
 	struct iphdr _iph;
 	const struct iphdr *ip;
+	struct ipv6hdr _ip6h;
+	const struct ipv6hdr *ip6;
         bool ctx = buff->monad->ep_ctx;
 
+	ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+	if (ip6 != NULL)
+		return (ipv6_addr_is_multicast(&ip6->saddr) && (ctx & EPOINT_SRC)) ||
+		       (ipv6_addr_is_multicast(&ip6->daddr) && (ctx & EPOINT_DST));
+
 	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
 	if (ip == NULL)
 		return false;
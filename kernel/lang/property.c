@@ -35,6 +35,12 @@ ip_tos(arguments_t args, struct qbuff * buff)
 {
 	struct iphdr _iph;
 	const struct iphdr *ip;
+	struct ipv6hdr _ip6h;
+	const struct ipv6hdr *ip6;
+
+	ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+	if (ip6 != NULL)
+		return (uint64_t)JUST(ipv6_get_dsfield(ip6));
 
 	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
 	if (ip == NULL)
@@ -49,6 +55,12 @@ ip_tot_len(arguments_t args, struct qbuff * buff)
 {
 	struct iphdr _iph;
 	const struct iphdr *ip;
+	struct ipv6hdr _ip6h;
+	const struct ipv6hdr *ip6;
+
+	ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+	if (ip6 != NULL)
+		return (uint64_t)JUST(be16_to_cpu(ip6->payload_len) + sizeof(struct ipv6hdr));
 
 	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
 	if (ip == NULL)
@@ -77,6 +89,12 @@ ip_ttl(arguments_t args, struct qbuff * buff)
 {
 	struct iphdr _iph;
 	const struct iphdr *ip;
+	struct ipv6hdr _ip6h;
+	const struct ipv6hdr *ip6;
+
+	ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+	if (ip6 != NULL)
+		return (uint64_t)JUST(ip6->hop_limit);
 
 	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
 	if (ip == NULL)
@@ -106,20 +124,10 @@ ip_frag(arguments_t args, struct qbuff * buff)
 static uint64_t
 tcp_source(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct tcphdr _tcp;
 	const struct tcphdr *tcp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_TCP)
-		return NOTHING;
-
-	tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_tcp), &_tcp);
+	tcp = qbuff_l4_header_pointer(buff, IPPROTO_TCP, 0, sizeof(_tcp), &_tcp);
 	if (tcp == NULL)
 		return NOTHING;
 
@@ -130,20 +138,10 @@ tcp_source(arguments_t args, struct qbuff * buff)
 static uint64_t
 tcp_dest(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct tcphdr _tcp;
 	const struct tcphdr *tcp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_TCP)
-		return NOTHING;
-
-	tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_tcp), &_tcp);
+	tcp = qbuff_l4_header_pointer(buff, IPPROTO_TCP, 0, sizeof(_tcp), &_tcp);
 	if (tcp == NULL)
 		return NOTHING;
 
@@ -153,20 +151,10 @@ tcp_dest(arguments_t args, struct qbuff * buff)
 static uint64_t
 tcp_hdrlen_(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct tcphdr _tcp;
 	const struct tcphdr *tcp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_TCP)
-		return NOTHING;
-
-	tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_tcp), &_tcp);
+	tcp = qbuff_l4_header_pointer(buff, IPPROTO_TCP, 0, sizeof(_tcp), &_tcp);
 	if (tcp == NULL)
 		return NOTHING;
 
@@ -180,20 +168,10 @@ tcp_hdrlen_(arguments_t args, struct qbuff * buff)
 static uint64_t
 udp_source(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct udphdr _udp;
 	const struct udphdr *udp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_UDP)
-		return NOTHING;
-
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+	udp = qbuff_l4_header_pointer(buff, IPPROTO_UDP, 0, sizeof(_udp), &_udp);
 	if (udp == NULL)
 		return NOTHING;
 
@@ -204,20 +182,10 @@ udp_source(arguments_t args, struct qbuff * buff)
 static uint64_t
 udp_dest(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct udphdr _udp;
 	const struct udphdr *udp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_UDP)
-		return NOTHING;
-
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+	udp = qbuff_l4_header_pointer(buff, IPPROTO_UDP, 0, sizeof(_udp), &_udp);
 	if (udp == NULL)
 		return NOTHING;
 
@@ -227,20 +195,10 @@ udp_dest(arguments_t args, struct qbuff * buff)
 static uint64_t
 udp_len(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct udphdr _udp;
 	const struct udphdr *udp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_UDP)
-		return NOTHING;
-
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+	udp = qbuff_l4_header_pointer(buff, IPPROTO_UDP, 0, sizeof(_udp), &_udp);
 	if (udp == NULL)
 		return NOTHING;
 
@@ -251,20 +209,11 @@ udp_len(arguments_t args, struct qbuff * buff)
 static uint64_t
 icmp_type(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct icmphdr _icmp;
 	const struct icmphdr *icmp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_ICMP)
-		return NOTHING;
-
-	icmp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_icmp), &_icmp);
+	icmp = qbuff_l4_header_pointer(buff, qbuff_ip_version(buff) == 6 ? IPPROTO_ICMPV6 : IPPROTO_ICMP,
+				       0, sizeof(_icmp), &_icmp);
 	if (icmp == NULL)
 		return NOTHING;
 
@@ -275,20 +224,11 @@ icmp_type(arguments_t args, struct qbuff * buff)
 static uint64_t
 icmp_code(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct icmphdr _icmp;
 	const struct icmphdr *icmp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_ICMP)
-		return NOTHING;
-
-	icmp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_icmp), &_icmp);
+	icmp = qbuff_l4_header_pointer(buff, qbuff_ip_version(buff) == 6 ? IPPROTO_ICMPV6 : IPPROTO_ICMP,
+				       0, sizeof(_icmp), &_icmp);
 	if (icmp == NULL)
 		return NOTHING;
 
@@ -30,11 +30,209 @@
 #include <pfq/nethdr.h>
 
 
+/* first byte of the payload carries the IP version (MPLS, GTP-U) */
+
+static inline int
+guess_ip_offset(struct qbuff *buff, int offset, int *proto)
+{
+	uint8_t _v; const uint8_t *v;
+
+	v = qbuff_header_pointer(buff, offset, 1, &_v);
+	if (v == NULL)
+		return -1;
+
+	switch(*v >> 4)
+	{
+	case 4: *proto = IPPROTO_IP;   return offset;
+	case 6: *proto = IPPROTO_IPV6; return offset;
+	}
+
+	return -1;
+}
+
+
+static inline int
+mpls_next_ip_offset(struct qbuff *buff, int offset, int *proto)
+{
+	int n;
+
+	for(n = 0; n < Q_MPLS_MAX_LABELS; n++)
+	{
+		__be32 _lse; const __be32 *lse;
+
+		lse = qbuff_header_pointer(buff, offset, sizeof(_lse), &_lse);
+		if (lse == NULL)
+			return -1;
+
+		offset += sizeof(__be32);
+
+		if (be32_to_cpu(*lse) & Q_MPLS_BOS)
+			return guess_ip_offset(buff, offset, proto);
+	}
+
+	return -1;
+}
+
+
+static inline int
+ether_next_ip_offset(struct qbuff *buff, int offset, __be16 type, int *proto)
+{
+	switch(type)
+	{
+	case __constant_htons(ETH_P_IP):
+		*proto = IPPROTO_IP;
+		return offset;
+	case __constant_htons(ETH_P_IPV6):
+		*proto = IPPROTO_IPV6;
+		return offset;
+	case __constant_htons(ETH_P_MPLS_UC):
+	case __constant_htons(ETH_P_MPLS_MC):
+		return mpls_next_ip_offset(buff, offset, proto);
+	}
+
+	return -1;
+}
+
+
+/* inner Ethernet frame (VXLAN, GRE/TEB), up to two vlan tags */
+
+static inline int
+eth_next_ip_offset(struct qbuff *buff, int offset, int *proto)
+{
+	struct ethhdr _eth; const struct ethhdr *eth;
+	__be16 type;
+	int n;
+
+	eth = qbuff_header_pointer(buff, offset, sizeof(_eth), &_eth);
+	if (eth == NULL)
+		return -1;
+
+	type = eth->h_proto;
+	offset += ETH_HLEN;
+
+	for(n = 0; n < 2 && (type == __constant_htons(ETH_P_8021Q) ||
+			     type == __constant_htons(ETH_P_8021AD)); n++)
+	{
+		struct vlan_hdr _vh; const struct vlan_hdr *vh;
+
+		vh = qbuff_header_pointer(buff, offset, sizeof(_vh), &_vh);
+		if (vh == NULL)
+			return -1;
+
+		type = vh->h_vlan_encapsulated_proto;
+		offset += VLAN_HLEN;
+	}
+
+	return ether_next_ip_offset(buff, offset, type, proto);
+}
+
+
 static inline int
-next_ip_offset(struct qbuff const *buff, int offset, int tproto, int *proto)
+gre_next_ip_offset(struct qbuff *buff, int offset, int *proto)
 {
-	(void)buff;
+	struct pfq_grehdr _gre; const struct pfq_grehdr *gre;
+	uint16_t flags;
 
+	gre = qbuff_header_pointer(buff, offset, sizeof(_gre), &_gre);
+	if (gre == NULL)
+		return -1;
+
+	flags = be16_to_cpu(gre->flags);
+	if (flags & Q_GRE_VERSION)
+		return -1;
+
+	offset += sizeof(struct pfq_grehdr);
+	offset += (flags & Q_GRE_CSUM) ? 4 : 0;
+	offset += (flags & Q_GRE_KEY)  ? 4 : 0;
+	offset += (flags & Q_GRE_SEQ)  ? 4 : 0;
+
+	if (gre->protocol == __constant_htons(ETH_P_TEB))
+		return eth_next_ip_offset(buff, offset, proto);
+
+	return ether_next_ip_offset(buff, offset, gre->protocol, proto);
+}
+
+
+/* GTPv1-U G-PDU: optional fields and extension headers are skipped */
+
+static inline int
+gtp_next_ip_offset(struct qbuff *buff, int offset, int *proto)
+{
+	struct pfq_gtp1hdr _gtp; const struct pfq_gtp1hdr *gtp;
+	uint8_t _next; const uint8_t *next;
+	int n;
+
+	gtp = qbuff_header_pointer(buff, offset, sizeof(_gtp), &_gtp);
+	if (gtp == NULL)
+		return -1;
+
+	if (Q_GTP_VERSION(gtp->flags) != 1 || !(gtp->flags & Q_GTP_FLAG_PT) ||
+	    gtp->type != Q_GTP_TYPE_GPDU)
+		return -1;
+
+	offset += sizeof(struct pfq_gtp1hdr);
+
+	if (!(gtp->flags & Q_GTP_FLAG_OPT))
+		return guess_ip_offset(buff, offset, proto);
+
+	/* seq. number (2), N-PDU number (1), next extension type (1) */
+
+	offset += 4;
+
+	if (!(gtp->flags & Q_GTP_FLAG_E))
+		return guess_ip_offset(buff, offset, proto);
+
+	next = qbuff_header_pointer(buff, offset - 1, 1, &_next);
+
+	for(n = 0; next && *next && n < 8; n++)
+	{
+		uint8_t _len; const uint8_t *len;
+
+		len = qbuff_header_pointer(buff, offset, 1, &_len);
+		if (len == NULL || *len == 0)
+			return -1;
+
+		offset += *len * 4;
+		next = qbuff_header_pointer(buff, offset - 1, 1, &_next);
+	}
+
+	if (next == NULL || *next)
+		return -1;
+
+	return guess_ip_offset(buff, offset, proto);
+}
+
+
+static inline int
+udp_next_ip_offset(struct qbuff *buff, int offset, int *proto)
+{
+	struct udphdr _udp; const struct udphdr *udp;
+
+	udp = qbuff_header_pointer(buff, offset, sizeof(_udp), &_udp);
+	if (udp == NULL)
+		return -1;
+
+	offset += sizeof(struct udphdr);
+
+	switch(be16_to_cpu(udp->dest))
+	{
+	case Q_GTP_U_PORT:
+		return gtp_next_ip_offset(buff, offset, proto);
+	case Q_VXLAN_PORT:
+		return eth_next_ip_offset(buff, offset + sizeof(struct pfq_vxlanhdr), proto);
+	}
+
+	return -1;
+}
+
+
+/* offset of the IP header carried by the transport protocol tproto
+ * (IP-in-IP, GRE, GTP-U, VXLAN and MPLS over any of them)
+ */
+
+static inline int
+next_ip_offset(struct qbuff *buff, int offset, int tproto, int *proto)
+{
 	switch(tproto)
 	{
 	case IPPROTO_IPIP: {
@@ -45,32 +243,84 @@ next_ip_offset(struct qbuff const *buff, int offset, int tproto, int *proto)
 		*proto = IPPROTO_IPV6;
 		return offset;
 	}
+	case IPPROTO_GRE:
+		return gre_next_ip_offset(buff, offset, proto);
+	case IPPROTO_UDP:
+		return udp_next_ip_offset(buff, offset, proto);
 	}
 
 	return -1;
 }
 
 
+/* walk the IPv6 extension headers starting at offset (the first byte past
+ * the fixed header) whose type is *nexthdr. On return *nexthdr holds the
+ * upper-layer protocol and *frag the host-order offset/M-flag field of the
+ * fragment header, if any (0 otherwise); if not NULL, *id is set to the
+ * fragment identification.
+ */
+
+#define Q_IPV6_MAX_EXTHDR	8
+
 static inline int
-qbuff_next_ip_offset(struct qbuff *buff, int offset, int *proto)
+qbuff_ipv6_skip_exthdr(struct qbuff *buff, int offset, int *nexthdr, uint16_t *frag, __be32 *id)
 {
-	switch(*proto)
+	int n;
+
+	*frag = 0;
+
+	for(n = 0; n < Q_IPV6_MAX_EXTHDR; n++)
 	{
-	case IPPROTO_NONE: {
+		struct ipv6_opt_hdr _hp;
+		const struct ipv6_opt_hdr *hp;
 
-		if (qbuff_eth_hdr(buff)->h_proto == __constant_htons(ETH_P_IP))
+		switch(*nexthdr)
 		{
-			*proto = IPPROTO_IP;
-			return (int)qbuff_maclen(buff);
+		case NEXTHDR_HOP:
+		case NEXTHDR_ROUTING:
+		case NEXTHDR_DEST: {
+			hp = qbuff_header_pointer(buff, offset, sizeof(_hp), &_hp);
+			if (hp == NULL)
+				return -1;
+			*nexthdr = hp->nexthdr;
+			offset += ipv6_optlen(hp);
+		} break;
+		case NEXTHDR_AUTH: {
+			hp = qbuff_header_pointer(buff, offset, sizeof(_hp), &_hp);
+			if (hp == NULL)
+				return -1;
+			*nexthdr = hp->nexthdr;
+			offset += ipv6_authlen(hp);
+		} break;
+		case NEXTHDR_FRAGMENT: {
+			struct frag_hdr _fh;
+			const struct frag_hdr *fh;
+			fh = qbuff_header_pointer(buff, offset, sizeof(_fh), &_fh);
+			if (fh == NULL)
+				return -1;
+			*nexthdr = fh->nexthdr;
+			*frag = be16_to_cpu(fh->frag_off);
+			if (id)
+				*id = fh->identification;
+			offset += sizeof(struct frag_hdr);
+		} break;
+		default:
+			return offset;
 		}
+	}
 
-		if (qbuff_eth_hdr(buff)->h_proto == __constant_htons(ETH_P_IPV6))
-		{
-			*proto = IPPROTO_IPV6;
-			return (int)qbuff_maclen(buff);
-		}
+	return -1;
+}
 
-		return -1;
+
+static inline int
+qbuff_next_ip_offset(struct qbuff *buff, int offset, int *proto)
+{
+	switch(*proto)
+	{
+	case IPPROTO_NONE: {
+
+		return ether_next_ip_offset(buff, (int)qbuff_maclen(buff), qbuff_eth_hdr(buff)->h_proto, proto);
 
 	} break;
 	case IPPROTO_IP: {
@@ -79,11 +329,30 @@ qbuff_next_ip_offset(struct qbuff *buff, int offset, int *proto)
 		const struct iphdr *ip;
 
 		ip = qbuff_header_pointer(buff, offset, sizeof(_iph), &_iph);
-		if (ip == NULL)
+		if (ip == NULL || (ip->frag_off & __constant_htons(IP_OFFSET)))
 			return -1;
 
                 return next_ip_offset(buff, offset + (ip->ihl<<2), ip->protocol, proto);
 
+	} break;
+	case IPPROTO_IPV6: {
+
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+		int nexthdr, next;
+		uint16_t frag;
+
+		ip6 = qbuff_header_pointer(buff, offset, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return -1;
+
+		nexthdr = ip6->nexthdr;
+		next = qbuff_ipv6_skip_exthdr(buff, offset + sizeof(struct ipv6hdr), &nexthdr, &frag, NULL);
+		if (next < 0 || (frag & IP6_OFFSET))
+			return -1;
+
+		return next_ip_offset(buff, next, nexthdr, proto);
+
 	} break;
 	}
 
@@ -123,6 +392,7 @@ qbuff_generic_ip_header_pointer(struct qbuff * buff, int ip_proto, int offset, i
 }
 
 #define qbuff_ip_header_pointer(buff, offset, len, buffer)  qbuff_generic_ip_header_pointer(buff, IPPROTO_IP, offset, len, buffer)
+#define qbuff_ip6_header_pointer(buff, offset, len, buffer) qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, offset, len, buffer)
 
 
 static inline int
@@ -141,6 +411,78 @@ qbuff_ip_version(struct qbuff * buff)
 }
 
 
+/* offset of the transport header relative to the current IP header, for
+ * both IPv4 and IPv6 (extension headers skipped). *proto is set to the
+ * transport protocol and, if not NULL, *frag to the host-order fragment
+ * offset field (IPv6 offsets are reported in the IPv4 layout, i.e. in 8-byte
+ * units under IP_OFFSET and the more-fragment bit as IP_MF); if not NULL,
+ * *id is set to the datagram id (IPv6 only when a fragment header is found).
+ */
+
+static inline int
+__qbuff_l4_offset(struct qbuff *buff, int *proto, uint16_t *frag, __be32 *id)
+{
+	uint16_t _frag;
+
+	if (frag == NULL)
+		frag = &_frag;
+
+	switch(qbuff_ip_version(buff))
+	{
+	case 4: {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return -1;
+		*proto = ip->protocol;
+		*frag = be16_to_cpu(ip->frag_off) & (IP_OFFSET|IP_MF);
+		if (id)
+			*id = (__force __be32)ip->id;
+		return ip->ihl<<2;
+	}
+	case 6: {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+		uint16_t f;
+		int off;
+		ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return -1;
+		*proto = ip6->nexthdr;
+		off = qbuff_ipv6_skip_exthdr(buff, buff->monad->ipoff + sizeof(struct ipv6hdr), proto, &f, id);
+		if (off < 0)
+			return -1;
+		*frag = ((f & IP6_OFFSET) >> 3) | ((f & IP6_MF) ? IP_MF : 0);
+		return off - buff->monad->ipoff;
+	}
+	}
+
+	return -1;
+}
+
+#define qbuff_l4_offset(buff, proto, frag)	__qbuff_l4_offset(buff, proto, frag, NULL)
+
+
+/* pointer into the transport header (offset relative to its start), valid
+ * only when the transport protocol is l4proto and the packet is not a
+ * trailing fragment.
+ */
+
+static inline const void *
+qbuff_l4_header_pointer(struct qbuff *buff, int l4proto, int offset, int len, void *buffer)
+{
+	uint16_t frag;
+	int proto, l4off;
+
+	l4off = qbuff_l4_offset(buff, &proto, &frag);
+	if (l4off < 0 || proto != l4proto || (frag & IP_OFFSET))
+		return NULL;
+
+	return qbuff_header_pointer(buff, buff->monad->ipoff + l4off + offset, len, buffer);
+}
+
+
 static inline int
 qbuff_ip_protocol(struct qbuff * buff)
 {
@@ -153,10 +495,138 @@ qbuff_ip_protocol(struct qbuff * buff)
 		if (ip)
 			return ip->protocol;
 	} break;
+	case 6: {
+		int proto;
+		if (qbuff_l4_offset(buff, &proto, NULL) >= 0)
+			return proto;
+	} break;
 	}
 
 	return IPPROTO_NONE;
 }
 
 
+/* TOS (IPv4) or traffic class (IPv6) byte, -1 if not an IP packet */
+
+static inline int
+qbuff_ip_dsfield(struct qbuff * buff)
+{
+	switch(qbuff_ip_version(buff))
+	{
+	case 4: {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip)
+			return ip->tos;
+	} break;
+	case 6: {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+		ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6)
+			return ipv6_get_dsfield(ip6);
+	} break;
+	}
+
+	return -1;
+}
+
+
+/* flow of the current IP header: IPv6 addresses are folded into 32 bits,
+ * so that the symmetric hash (saddr ^ daddr ^ sport ^ dport) is the same
+ * for both families. Ports are set only for the first fragment of UDP and
+ * TCP packets, 0 otherwise; a truncated transport header makes it fail.
+ * For fragments, frag holds IP_MF|IP_OFFSET and id the datagram id.
+ */
+
+struct qbuff_flow
+{
+	__be32		saddr;
+	__be32		daddr;
+	__be16		sport;
+	__be16		dport;
+	int		proto;
+	uint16_t	frag;
+	__be32		id;
+};
+
+
+static inline __be32
+ipv6_addr_fold(struct in6_addr const *addr)
+{
+	return addr->s6_addr32[0] ^ addr->s6_addr32[1] ^
+	       addr->s6_addr32[2] ^ addr->s6_addr32[3];
+}
+
+
+static inline bool
+qbuff_ip_flow(struct qbuff *buff, struct qbuff_flow *flow)
+{
+	uint16_t frag;
+	int l4off;
+
+	flow->sport = flow->dport = 0;
+	flow->proto = IPPROTO_NONE;
+	flow->frag  = 0;
+	flow->id    = 0;
+
+	switch(qbuff_ip_version(buff))
+	{
+	case 4: {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return false;
+		flow->saddr = ip->saddr;
+		flow->daddr = ip->daddr;
+	} break;
+	case 6: {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+		ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return false;
+		flow->saddr = ipv6_addr_fold(&ip6->saddr);
+		flow->daddr = ipv6_addr_fold(&ip6->daddr);
+	} break;
+	default:
+		return false;
+	}
+
+	l4off = __qbuff_l4_offset(buff, &flow->proto, &frag, &flow->id);
+	if (l4off < 0)
+		return true;
+
+	flow->frag = frag;
+
+	if ((flow->proto == IPPROTO_UDP || flow->proto == IPPROTO_TCP) && !(frag & IP_OFFSET)) {
+		struct udphdr _udp;
+		const struct udphdr *udp;
+		udp = qbuff_header_pointer(buff, buff->monad->ipoff + l4off, sizeof(_udp), &_udp);
+		if (udp == NULL)
+			return false; /* broken */
+		flow->sport = udp->source;
+		flow->dport = udp->dest;
+	}
+
+	return true;
+}
+
+
+/* symmetric flow hash: the fragments of a datagram are hashed together on
+ * (saddr, daddr, proto, id), as only the first one carries the ports.
+ */
+
+static inline uint32_t
+qbuff_flow_hash(struct qbuff_flow const *flow)
+{
+	if (flow->frag & (IP_MF|IP_OFFSET))
+		return (__force uint32_t)(flow->saddr ^ flow->daddr ^ flow->id) ^ (uint32_t)flow->proto;
+
+	return (__force uint32_t)(flow->saddr ^ flow->daddr ^ (__force __be32)flow->sport ^ (__force __be32)flow->dport);
+}
+
+
 #endif /* PFQ_LANG_QBUFF_H */
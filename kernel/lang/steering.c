@@ -31,11 +31,17 @@
 #include <pfq/qbuff.h>
 #include <pfq/vlan.h>
 
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+
 
 
 #define IP_TOS_MASK      0x3
 #define IP_DSCP_MASK     0xfc
 
+#define Q_KEY_IP_FLOW	(Q_KEY_IP_SRC|Q_KEY_IP_DST|Q_KEY_IP_PROTO|Q_KEY_SRC_PORT|Q_KEY_DST_PORT)
+
 static ActionQbuff
 steering_key(arguments_t args, struct qbuff * buff)
 {
@@ -43,38 +49,27 @@ steering_key(arguments_t args, struct qbuff * buff)
         uint32_t hash, src_hash, dst_hash;
 	uint64_t field;
 
-	struct iphdr   _ip;    struct iphdr const *ip;
-	struct udphdr  _udp;   struct udphdr const *udp;
+	struct qbuff_flow flow;
 	struct icmphdr _icmp;  struct icmphdr const *icmp;
 
+	if ((key & Q_KEY_IP_FLOW) && !qbuff_ip_flow(buff, &flow))
+		return Drop(buff);
+
 	switch(key)
 	{
 	case Q_KEY_IP_SRC|Q_KEY_IP_DST|Q_KEY_IP_PROTO: {
 
-		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
-		if (ip == NULL)
-			return Drop(buff);
-
-		return Steering(buff, (__force uint32_t)(ip->saddr ^ ip->daddr));
+		return Steering(buff, (__force uint32_t)(flow.saddr ^ flow.daddr));
 
 	}
 	case Q_KEY_IP_SRC|Q_KEY_IP_DST|Q_KEY_SRC_PORT|Q_KEY_DST_PORT|Q_KEY_IP_PROTO: {
 
-		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
-		if (ip == NULL)
-			return Drop(buff);
-
-		if (ip->protocol != IPPROTO_UDP &&
-		    ip->protocol != IPPROTO_TCP) {
+		if (flow.proto != IPPROTO_UDP &&
+		    flow.proto != IPPROTO_TCP) {
 		    	return Drop(buff);
 		}
 
-		udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
-		if (udp == NULL)
-			return Drop(buff);  /* broken */
-
-		hash = ip->saddr ^ ip->daddr ^ (__force __be32)udp->source ^ (__force __be32)udp->dest;
-		return Steering(buff, (__force uint32_t)hash);
+		return Steering(buff, qbuff_flow_hash(&flow));
 	}
 
 	}
@@ -111,70 +106,54 @@ steering_key(arguments_t args, struct qbuff * buff)
 
                 case Q_KEY_IP_SRC:
                 {
-                        ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
-                        if (ip == NULL)
-                                return Drop(buff);
-	                src_hash = ((src_hash << 5) + src_hash) + ip->saddr;
+	                src_hash = ((src_hash << 5) + src_hash) + flow.saddr;
 
                 } break;
 
                 case Q_KEY_IP_DST:
                 {
-                        ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
-                        if (ip == NULL)
-                                return Drop(buff);
-	                dst_hash = ((dst_hash << 5) + dst_hash) + ip->daddr;
+	                dst_hash = ((dst_hash << 5) + dst_hash) + flow.daddr;
 
                 } break;
                 case Q_KEY_IP_PROTO:
                 {
-                        ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
-                        if (ip == NULL)
-                                return Drop(buff);
-	                hash = ((hash << 5) + hash) + ip->protocol;
+	                hash = ((hash << 5) + hash) + flow.proto;
 
                 } break;
                 case Q_KEY_IP_ECN:
                 {
-                        ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
-                        if (ip == NULL)
+                        int tos = qbuff_ip_dsfield(buff);
+                        if (tos < 0)
                                 return Drop(buff);
-	                hash = ((hash << 5) + hash) + (ip->tos & IP_TOS_MASK);
+	                hash = ((hash << 5) + hash) + (tos & IP_TOS_MASK);
 
                 } break;
 
                 case Q_KEY_IP_DSCP:
                 {
-                        ip = qbuff_ip_header_pointer(buff, 0, sizeof(_ip), &_ip);
-                        if (ip == NULL)
+                        int tos = qbuff_ip_dsfield(buff);
+                        if (tos < 0)
                                 return Drop(buff);
-	                hash = ((hash << 5) + hash) + (ip->tos & IP_DSCP_MASK);
+	                hash = ((hash << 5) + hash) + (tos & IP_DSCP_MASK);
 
                 } break;
 
                 case Q_KEY_SRC_PORT:
                 {
-                        udp = qbuff_ip_header_pointer(buff, 0, sizeof(_udp), &_udp);
-                        if (udp == NULL)
-                                return Drop(buff);
-
-	                src_hash = ((src_hash << 5) + src_hash) + udp->source;
+	                src_hash = ((src_hash << 5) + src_hash) + flow.sport;
 
                 } break;
 
                 case Q_KEY_DST_PORT:
                 {
-                        udp = qbuff_ip_header_pointer(buff, 0, sizeof(_udp), &_udp);
-                        if (udp == NULL)
-                                return Drop(buff);
-
-	                dst_hash = ((dst_hash << 5) + dst_hash) + udp->dest;
+	                dst_hash = ((dst_hash << 5) + dst_hash) + flow.dport;
 
                 } break;
 
                 case Q_KEY_ICMP_TYPE:
                 {
-                        icmp = qbuff_ip_header_pointer(buff, 0, sizeof(_icmp), &_icmp);
+                        icmp = qbuff_l4_header_pointer(buff, qbuff_ip_version(buff) == 6 ? IPPROTO_ICMPV6 : IPPROTO_ICMP,
+                                                       0, sizeof(_icmp), &_icmp);
                         if (icmp == NULL)
                                 return Drop(buff);
 
@@ -184,7 +163,8 @@ steering_key(arguments_t args, struct qbuff * buff)
 
                 case Q_KEY_ICMP_CODE:
                 {
-                        icmp = qbuff_ip_header_pointer(buff, 0, sizeof(_icmp), &_icmp);
+                        icmp = qbuff_l4_header_pointer(buff, qbuff_ip_version(buff) == 6 ? IPPROTO_ICMPV6 : IPPROTO_ICMP,
+                                                       0, sizeof(_icmp), &_icmp);
                         if (icmp == NULL)
                                 return Drop(buff);
 
@@ -374,40 +354,45 @@ steering_vlan_id(arguments_t args, struct qbuff * buff)
 }
 
 
+/* IPv4 limited broadcast; IPv6 has no broadcast address */
+
+static inline bool
+qbuff_flow_broadcast(struct qbuff * buff, struct qbuff_flow const *flow)
+{
+	return qbuff_ip_version(buff) == 4 &&
+		(flow->saddr == (__force __be32)0xffffffff ||
+		 flow->daddr == (__force __be32)0xffffffff);
+}
+
+
 static ActionQbuff
 steering_p2p(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
+	struct qbuff_flow flow;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
+	if (!qbuff_ip_flow(buff, &flow))
 		return Drop(buff);
 
-	if (ip->saddr == (__force __be32)0xffffffff ||
-	    ip->daddr == (__force __be32)0xffffffff)
+	if (qbuff_flow_broadcast(buff, &flow))
 		return Broadcast(buff);
 
-	return Steering(buff, (__force uint32_t)(ip->saddr ^ ip->daddr));
+	return Steering(buff, (__force uint32_t)(flow.saddr ^ flow.daddr));
 }
 
 
 static ActionQbuff
 double_steering_ip(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
+	struct qbuff_flow flow;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
+	if (!qbuff_ip_flow(buff, &flow))
 		return Drop(buff);
 
-	if (ip->saddr == (__force __be32)0xffffffff ||
-	    ip->daddr == (__force __be32)0xffffffff)
+	if (qbuff_flow_broadcast(buff, &flow))
 		return Broadcast(buff);
 
-	return DoubleSteering(buff, (__force uint32_t)ip->saddr,
-				   (__force uint32_t)ip->daddr);
+	return DoubleSteering(buff, (__force uint32_t)flow.saddr,
+				   (__force uint32_t)flow.daddr);
 }
 
 static int steering_local_ip_init(arguments_t args)
@@ -505,28 +490,104 @@ steering_local_net(arguments_t args, struct qbuff * buff)
 static ActionQbuff
 steering_flow(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
+	struct qbuff_flow flow;
 
-	struct udphdr _udp;
-	const struct udphdr *udp;
-	__be32 hash;
+	if (!qbuff_ip_flow(buff, &flow))
+		return Drop(buff);
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
+	return Steering(buff, qbuff_flow_hash(&flow));
+}
+
+
+/* per-CPU fragment table: (saddr, daddr, proto, id) of a datagram -> flow
+ * hash of its first fragment, so that the trailing ones follow the flow.
+ */
+
+#define Q_FRAG_TABLE_MAX	4096
+#define Q_FRAG_TIMEOUT		(HZ/2)
+
+struct pfq_frag_entry
+{
+	__be32		saddr;
+	__be32		daddr;
+	__be32		id;
+	int		proto;
+	uint32_t	hash;
+	unsigned long	stamp;
+};
+
+
+static int steering_frag_init(arguments_t args)
+{
+	unsigned int n = GET_ARG_0(unsigned int, args);
+	struct pfq_frag_entry __percpu *table = NULL;
+
+	if (n > Q_FRAG_TABLE_MAX) {
+		printk(KERN_INFO "[PFQ|init] steer_frag: table too big (max. %d entries)!\n", Q_FRAG_TABLE_MAX);
+		return -EINVAL;
+	}
+
+	if (n) {
+		n = roundup_pow_of_two(n);
+		table = __alloc_percpu(n * sizeof(struct pfq_frag_entry), __alignof__(struct pfq_frag_entry));
+		if (!table) {
+			printk(KERN_INFO "[PFQ|init] steer_frag: out of memory!\n");
+			return -ENOMEM;
+		}
+	}
+
+	SET_ARG_0(args, n);
+	SET_ARG_1(args, table);
+
+	pr_devel("[PFQ|init] steer_frag: table@%p %u entries per cpu\n", table, n);
+	return 0;
+}
+
+
+static int steering_frag_fini(arguments_t args)
+{
+	struct pfq_frag_entry __percpu *table = GET_ARG_1(struct pfq_frag_entry __percpu *, args);
+
+	free_percpu(table);
+	return 0;
+}
+
+
+static ActionQbuff
+steering_frag(arguments_t args, struct qbuff * buff)
+{
+	unsigned int n = GET_ARG_0(unsigned int, args);
+	struct pfq_frag_entry __percpu *table = GET_ARG_1(struct pfq_frag_entry __percpu *, args);
+	struct pfq_frag_entry *e;
+	struct qbuff_flow flow;
+
+	if (!qbuff_ip_flow(buff, &flow))
 		return Drop(buff);
 
-	if (ip->protocol != IPPROTO_UDP &&
-	    ip->protocol != IPPROTO_TCP) {
-		return Steering(buff, (__force uint32_t)ip->saddr ^ (__force uint32_t)ip->daddr);
+	if (!(flow.frag & (IP_MF|IP_OFFSET)) || !table)
+		return Steering(buff, qbuff_flow_hash(&flow));
+
+	e = this_cpu_ptr(table) + (jhash_3words((__force u32)flow.saddr ^ (__force u32)flow.daddr,
+					       (__force u32)flow.id, flow.proto, 0) & (n-1));
+
+	if (!(flow.frag & IP_OFFSET)) {
+
+		/* first fragment: ports are available */
+
+		e->saddr = flow.saddr;
+		e->daddr = flow.daddr;
+		e->id    = flow.id;
+		e->proto = flow.proto;
+		e->hash  = (__force uint32_t)(flow.saddr ^ flow.daddr ^ (__force __be32)flow.sport ^ (__force __be32)flow.dport);
+		e->stamp = jiffies;
+		return Steering(buff, e->hash);
 	}
 
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
-	if (udp == NULL)
-		return Drop(buff);  /* broken */
+	if (e->id == flow.id && e->saddr == flow.saddr && e->daddr == flow.daddr &&
+	    e->proto == flow.proto && time_before(jiffies, e->stamp + Q_FRAG_TIMEOUT))
+		return Steering(buff, e->hash);
 
-	hash = ip->saddr ^ ip->daddr ^ (__force __be32)udp->source ^ (__force __be32)udp->dest;
-	return Steering(buff, (__force uint32_t)hash);
+	return Steering(buff, qbuff_flow_hash(&flow));
 }
 
 
@@ -541,6 +602,7 @@ struct pfq_lang_function_descr steering_functions[] = {
 
 	{ "steer_p2p",   "Qbuff -> Action Qbuff", steering_p2p     , NULL, NULL },
 	{ "steer_flow",  "Qbuff -> Action Qbuff", steering_flow    , NULL, NULL },
+	{ "steer_frag",  "CInt   -> Qbuff -> Action Qbuff", steering_frag , steering_frag_init, steering_frag_fini },
 	{ "steer_to",    "CInt   -> Qbuff -> Action Qbuff", steering_to , NULL, NULL },
 
 	{ "steer_field", "Word32 -> Word32 -> Qbuff -> Action Qbuff", steering_field , NULL, NULL},
@@ -33,6 +33,8 @@
 
 extern struct pfq_lang_function_descr  filter_functions[];
 extern struct pfq_lang_function_descr  bloom_functions[];
+extern struct pfq_lang_function_descr  tunnel_functions[];
+extern struct pfq_lang_function_descr  limit_functions[];
 extern struct pfq_lang_function_descr  vlan_functions[];
 extern struct pfq_lang_function_descr  forward_functions[];
 extern struct pfq_lang_function_descr  steering_functions[];
@@ -221,6 +223,8 @@ pfq_lang_symtable_init(void)
         pfq_lang_symtable_register_functions(NULL, &global->functions, forward_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, steering_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, bloom_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, tunnel_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, limit_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, control_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, vlan_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, misc_functions);
@@ -0,0 +1,207 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/nethdr.h>
+#include <pfq/printk.h>
+
+
+#define Q_MAX_TUNNEL_DEPTH	4
+
+
+static inline bool
+is_gtp_port(struct qbuff * buff, uint16_t port)
+{
+	struct udphdr _udp;
+	const struct udphdr *udp;
+
+	udp = qbuff_l4_header_pointer(buff, IPPROTO_UDP, 0, sizeof(_udp), &_udp);
+	if (udp == NULL)
+		return false;
+
+	return udp->dest == cpu_to_be16(port) || udp->source == cpu_to_be16(port);
+}
+
+
+static bool
+is_gtp_up(arguments_t args, struct qbuff * buff)
+{
+	return is_gtp_port(buff, Q_GTP_U_PORT);
+}
+
+static bool
+is_gtp_cp(arguments_t args, struct qbuff * buff)
+{
+	return is_gtp_port(buff, Q_GTP_C_PORT);
+}
+
+static bool
+is_gtp(arguments_t args, struct qbuff * buff)
+{
+	return is_gtp_up(args, buff) || is_gtp_cp(args, buff);
+}
+
+
+static ActionQbuff
+filter_gtp(arguments_t args, struct qbuff * buff)
+{
+	return is_gtp(args, buff) ? Pass(buff) : Drop(buff);
+}
+
+static ActionQbuff
+filter_gtp_up(arguments_t args, struct qbuff * buff)
+{
+	return is_gtp_up(args, buff) ? Pass(buff) : Drop(buff);
+}
+
+static ActionQbuff
+filter_gtp_cp(arguments_t args, struct qbuff * buff)
+{
+	return is_gtp_cp(args, buff) ? Pass(buff) : Drop(buff);
+}
+
+
+/* move the monad to the IP header found n levels of encapsulation below
+ * the outer one, or to the innermost one if n < 0. Returns the level
+ * reached, -1 if the packet is not IP.
+ */
+
+static int
+qbuff_tunnel_enter(struct qbuff * buff, int n)
+{
+	int off = 0, proto = IPPROTO_NONE;
+	int last_off = -1, last_proto = IPPROTO_NONE;
+	int level;
+
+	for(level = -1; n < 0 ? level < Q_MAX_TUNNEL_DEPTH : level < n; level++)
+	{
+		off = qbuff_next_ip_offset(buff, off, &proto);
+		if (off < 0)
+			break;
+		last_off = off;
+		last_proto = proto;
+	}
+
+	if (n >= 0 && level != n)
+		return -1;
+
+	buff->monad->ipoff = last_off;
+	buff->monad->ipproto = last_proto;
+	return level;
+}
+
+
+static ActionQbuff
+steering_inner_flow(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_lang_monad saved = *buff->monad;
+	struct qbuff_flow flow;
+	bool ok;
+
+	ok = qbuff_tunnel_enter(buff, -1) >= 0 && qbuff_ip_flow(buff, &flow);
+
+	buff->monad->ipoff   = saved.ipoff;
+	buff->monad->ipproto = saved.ipproto;
+
+	if (!ok)
+		return Drop(buff);
+
+	return Steering(buff, qbuff_flow_hash(&flow));
+}
+
+
+static int
+steering_gtp_usr_init(arguments_t args)
+{
+	__be32 addr = GET_ARG_0(__be32, args);
+	int prefix  = GET_ARG_1(int, args);
+	__be32 mask = inet_make_mask(prefix);
+
+	SET_ARG_0(args, addr & mask);
+	SET_ARG_1(args, mask);
+
+	pr_devel("[PFQ|init] steer_gtp_usr: addr=%pI4 mask=%pI4\n", &addr, &mask);
+	return 0;
+}
+
+
+/* user-plane packets are steered by the address of the user (the inner
+ * address that belongs to the given network), control-plane ones are
+ * broadcast to all the sockets.
+ */
+
+static ActionQbuff
+steering_gtp_usr(arguments_t args, struct qbuff * buff)
+{
+	__be32 addr = GET_ARG_0(__be32, args);
+	__be32 mask = GET_ARG_1(__be32, args);
+
+	struct pfq_lang_monad saved;
+	struct iphdr _iph;
+	const struct iphdr *ip;
+	struct qbuff_flow flow;
+	ActionQbuff ret;
+
+	if (is_gtp_cp(args, buff))
+		return Broadcast(buff);
+
+	if (!is_gtp_up(args, buff))
+		return Drop(buff);
+
+	saved = *buff->monad;
+
+	if (qbuff_tunnel_enter(buff, saved.shift + 1) < 0 || !qbuff_ip_flow(buff, &flow))
+		ret = Drop(buff);
+	else if ((ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph)) == NULL)
+		ret = Steering(buff, (__force uint32_t)(flow.saddr ^ flow.daddr));
+	else if ((ip->saddr & mask) == addr)
+		ret = Steering(buff, (__force uint32_t)ip->saddr);
+	else if ((ip->daddr & mask) == addr)
+		ret = Steering(buff, (__force uint32_t)ip->daddr);
+	else
+		ret = Steering(buff, (__force uint32_t)(ip->saddr ^ ip->daddr));
+
+	buff->monad->ipoff   = saved.ipoff;
+	buff->monad->ipproto = saved.ipproto;
+	return ret;
+}
+
+
+struct pfq_lang_function_descr tunnel_functions[] = {
+
+	{ "is_gtp",		"Qbuff -> Bool",			is_gtp,			NULL, NULL },
+	{ "is_gtp_up",		"Qbuff -> Bool",			is_gtp_up,		NULL, NULL },
+	{ "is_gtp_cp",		"Qbuff -> Bool",			is_gtp_cp,		NULL, NULL },
+
+	{ "gtp",		"Qbuff -> Action Qbuff",		filter_gtp,		NULL, NULL },
+	{ "gtp_up",		"Qbuff -> Action Qbuff",		filter_gtp_up,		NULL, NULL },
+	{ "gtp_cp",		"Qbuff -> Action Qbuff",		filter_gtp_cp,		NULL, NULL },
+
+	{ "steer_gtp_usr",	"Word32 -> CInt -> Qbuff -> Action Qbuff", steering_gtp_usr,	steering_gtp_usr_init, NULL },
+	{ "steer_inner_flow",	"Qbuff -> Action Qbuff",		steering_inner_flow,	NULL, NULL },
+
+	{ NULL }};
+
@@ -60,6 +60,7 @@
 
 
 #define	QIOCTX					_IOR('Q', 0, int) /* flush Tx */
+#define	QIOCCTRL				_IO('Q', 1)       /* process the shared control ring */
 
 #define PFQ_VERSION(a,b,c)			(((a) << 16) + ((b) << 8) + (c))
 #define PFQ_MAJOR(a)				((a >> 16) & 0xff)
@@ -87,8 +88,9 @@ typedef uint8_t  pfq_qver_t;
 
 #define PFQ_SLOT_ALIGNMENT			32
 
-#define PFQ_SHARED_QUEUE_SLOT_SIZE(x)		ALIGN(sizeof(struct pfq_pkthdr) + x, PFQ_SLOT_ALIGNMENT)
-#define PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, fix) ((struct pfq_pkthdr *)((char *)(hdr) + fix))
+#define PFQ_SHARED_QUEUE_SLOT_SIZE(x)		ALIGN(sizeof(struct pfq_pkthdr) + (size_t)(x), (size_t)PFQ_SLOT_ALIGNMENT)
+#define PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, fix) ((struct pfq_pkthdr *)((char *)(hdr) + (fix)))
+#define PFQ_SHARED_QUEUE_NEXT_PACKED_PKTHDR(hdr) PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, PFQ_SHARED_QUEUE_SLOT_SIZE((hdr)->caplen))
 
 
 /* PFQ socket options */
@@ -104,6 +106,7 @@ typedef uint8_t  pfq_qver_t;
 #define Q_SO_SET_TX_LEN			6
 #define Q_SO_SET_TX_SLOTS		7
 #define Q_SO_SET_WEIGHT			8
+#define Q_SO_SET_RX_PACKED		9	/* variable-length Rx slots */
 
 #define Q_SO_GROUP_BIND			10
 #define Q_SO_GROUP_UNBIND		11
@@ -131,23 +134,33 @@ typedef uint8_t  pfq_qver_t;
 #define Q_SO_GET_GROUP_STATS		31
 #define Q_SO_GET_GROUP_COUNTERS		32
 #define Q_SO_GET_WEIGHT			33
+#define Q_SO_GET_RX_PACKED		34
+#define Q_SO_GET_TX_ZCOPY		35
 
 #define Q_SO_TX_BIND			40
 #define Q_SO_TX_UNBIND			41
 #define Q_SO_TX_QUEUE_XMIT	        42
+#define Q_SO_SET_TX_ZCOPY		43	/* zero-copy transmission from the shared queue */
+
+#define Q_SO_GROUP_BPF_PROG		44	/* eBPF program (fd) of socket filter type */
+#define Q_SO_GROUP_CLASS_TABLE		45	/* update an entry of the group class tables */
 
 /* general placeholders */
 
 #define Q_ANY_DEVICE			-1
 #define Q_ANY_QUEUE			-1
 #define Q_ANY_GROUP			-1
-#define Q_ANY_KTHREAD			0xbadbee
+#define Q_ANY_KTHREAD			0xbadbee	/* async queue selected by flow hash */
+#define Q_RR_KTHREAD			0xbadbef	/* async queues in round-robin, per batch */
 #define Q_NO_KTHREAD			-1
 
 /* timestamp */
 
 #define Q_TSTAMP_OFF			0	/*default*/
-#define Q_TSTAMP_ON			1
+#define Q_TSTAMP_ON			1	/* per-packet wall clock */
+#define Q_TSTAMP_BATCH			2	/* wall clock shared by the capture batch */
+#define Q_TSTAMP_TSC			3	/* raw TSC (see pfq_shared_tsc) */
+#define Q_TSTAMP_HW			4	/* hardware timestamp, if provided by the NIC (wall clock otherwise) */
 
 
 /* vlan */
@@ -181,7 +194,7 @@ typedef uint8_t  pfq_qver_t;
 /* additional constants */
 
 #define Q_MAX_COUNTERS			64
-#define Q_MAX_TX_QUEUES			4
+#define Q_MAX_TX_QUEUES			16
 #define Q_MAX_RX_NAPI			4
 
 
@@ -213,35 +226,157 @@ struct pfq_shared_rx_queue
         unsigned int            size;       /* queue size in bytes */
         unsigned int            slot_size;  /* sizeof(pfq_pkthdr) + caplen  */
 
+        unsigned int            packed;	    /* variable-length slots: len is in PFQ_SLOT_ALIGNMENT units */
+        unsigned int            commit_len[2]; /* packed: units committed in each half (atomic) */
+        unsigned int            commit_pkt[2]; /* packed: packets committed in each half (atomic) */
+        unsigned int            epoch[2];   /* commit value of the slots of each half (0 is never used) */
+        unsigned int            fwd_pending[2]; /* packets of each half forwarded zero-copy, not yet transmitted (atomic) */
+
 } ____pfq_cacheline_aligned;
 
 
 
 struct pfq_shared_tx_queue
 {
-        size_t				size;	    /* queue size in bytes */
+        size_t				size;	    /* ring size in bytes (fixed-size slots) */
 
 	struct
 	{
-		unsigned int		index;
-		ptrdiff_t		off0;
-		ptrdiff_t	        off1;
+		size_t			head;	    /* slots produced (free-running) */
+		ptrdiff_t		off;	    /* offset of the next slot to fill */
 
 	} prod  ____pfq_cacheline_aligned;
 
 	struct
 	{
-		unsigned int		index;
-		ptrdiff_t		off;
+		size_t			tail;	    /* slots consumed (free-running) */
+		ptrdiff_t		off;	    /* offset of the next slot to transmit */
+		unsigned int		need_wakeup; /* async: the Tx thread sleeps, ring the doorbell (Q_SO_TX_QUEUE_XMIT) */
 
 	} cons ____pfq_cacheline_aligned;
 
 } ____pfq_cacheline_aligned;
 
 
+/* pfq statistics for socket and groups */
+
+struct pfq_stats
+{
+        unsigned long int recv;		/* received by the queue/group/computation */
+        unsigned long int lost;		/* packets lost due to memory problem: buffer overrun/memory allocation */
+        unsigned long int drop;		/* dropped by filters or computation */
+
+        unsigned long int sent;		/* sent by the driver */
+        unsigned long int disc;		/* discarded due to driver congestion */
+        unsigned long int fail;		/* Tx failed due to hardware congestion */
+
+        unsigned long int frwd;		/* forwarded to devices */
+        unsigned long int kern;		/* passed to kernel */
+};
+
+
+/* pfq counters for groups */
+
+struct pfq_counters
+{
+        unsigned long int counter[Q_MAX_COUNTERS];
+};
+
+
+/* TSC to wall clock conversion:
+ * nsec = tsc.nsec + (((tstamp - tsc.cycles) * tsc.mult) >> tsc.shift)
+ *
+ * The reference is refreshed by the kernel every Q_TSC_REFRESH_PERIOD msec
+ * (seqlock: the table is consistent when seq is even and unchanged).
+ */
+
+#define Q_TSC_REFRESH_PERIOD		1000	/* msec */
+
+struct pfq_shared_tsc
+{
+	uint64_t		cycles;	    /* TSC at the reference time */
+	uint64_t		nsec;	    /* wall clock at the reference time, in nsec */
+	uint32_t		mult;
+	uint32_t		shift;
+	uint32_t		seq;
+
+} ____pfq_cacheline_aligned;
+
+
+/* shared control block: commands submitted through the shared memory,
+ * processed in batch by a single doorbell (QIOCCTRL), and stats snapshots
+ * refreshed by the kernel every Q_CTRL_STATS_PERIOD msec.
+ */
+
+#define Q_CTRL_RING_LEN			64	/* power of 2 */
+#define Q_CTRL_MAX_GROUPS		64	/* groups whose stats are published */
+#define Q_CTRL_STATS_PERIOD		100	/* msec */
+
+#define Q_CTRL_NOP			0
+#define Q_CTRL_TX_QUEUE_XMIT		1	/* arg: Tx queue, as in Q_SO_TX_QUEUE_XMIT */
+#define Q_CTRL_GROUP_WATCH		2	/* arg: group id, result: index of its stats */
+#define Q_CTRL_GROUP_UNWATCH		3	/* arg: group id */
+
+
+struct pfq_ctrl_sqe
+{
+	uint32_t		op;
+	int32_t			arg;
+	uint64_t		user_data;
+};
+
+
+struct pfq_ctrl_cqe
+{
+	uint64_t		user_data;
+	int32_t			result;	    /* >= 0 on success, -errno otherwise */
+	uint32_t		reserved;
+};
+
+
+struct pfq_shared_group_stats
+{
+	int			gid;	    /* -1 if not in use */
+	struct pfq_stats	stats;
+	struct pfq_counters	counters;
+};
+
+
+struct pfq_shared_ctrl
+{
+	struct
+	{
+		unsigned int	head;	    /* written by the user */
+		unsigned int	tail;	    /* written by the kernel */
+		struct pfq_ctrl_sqe ring[Q_CTRL_RING_LEN];
+
+	} sq ____pfq_cacheline_aligned;
+
+	struct
+	{
+		unsigned int	head;	    /* written by the kernel */
+		unsigned int	tail;	    /* written by the user */
+		struct pfq_ctrl_cqe ring[Q_CTRL_RING_LEN];
+
+	} cq ____pfq_cacheline_aligned;
+
+	struct
+	{
+		unsigned int	seq;	    /* odd while the kernel is updating the snapshot */
+		uint64_t	nsec;	    /* time of the snapshot */
+		struct pfq_stats sock;
+		struct pfq_shared_group_stats group[Q_CTRL_MAX_GROUPS];
+
+	} stats ____pfq_cacheline_aligned;
+
+} ____pfq_cacheline_aligned;
+
+
 struct pfq_shared_queue
 {
         struct pfq_shared_rx_queue rx;
+        struct pfq_shared_tsc	   tsc;
+        struct pfq_shared_ctrl	   ctrl;
         struct pfq_shared_tx_queue tx;
         struct pfq_shared_tx_queue tx_async[Q_MAX_TX_QUEUES];
 };
@@ -249,6 +384,19 @@ struct pfq_shared_queue
 
 /* packet headers */
 
+#define Q_PKTHDR_HW_TSTAMP		0x1	/* tstamp taken by the hardware */
+#define Q_PKTHDR_TX_FWD			0x2	/* Tx slot holding a pfq_fwd_descr: the payload is an Rx slot */
+
+
+/* zero-copy forward: reference to a packet in the Rx queue of a socket */
+
+struct pfq_fwd_descr
+{
+	int32_t		id;		/* socket id of the Rx queue */
+	uint32_t	reserved;
+	uint64_t	off;		/* offset of the packet in the shared memory of the socket */
+};
+
 
 struct pfq_pkthdr_info
 {
@@ -281,8 +429,9 @@ struct pfq_pkthdr_info
                 uint16_t     tci;
         } vlan;
 
-        uint16_t      queue;			/* hardware queue */
-        uint32_t     commit;                    /* commit round */
+        uint8_t       queue;			/* hardware queue */
+        uint8_t       flags;			/* Q_PKTHDR_* flags */
+        uint32_t     commit;                    /* Rx: commit epoch, Tx: slot busy until released by the kernel */
 };
 
 
@@ -429,28 +578,35 @@ struct pfq_so_fprog
 };
 
 
-/* pfq statistics for socket and groups */
+/* pfq_so_bpf_prog: per-group eBPF program, as returned by bpf(BPF_PROG_LOAD)
+ * (fd < 0 resets it)
+ */
 
-struct pfq_stats
+struct pfq_so_bpf_prog
 {
-        unsigned long int recv;		/* received by the queue/group/computation */
-        unsigned long int lost;		/* packets lost due to memory problem: buffer overrun/memory allocation */
-        unsigned long int drop;		/* dropped by filters or computation */
+        int gid;
+        int fd;
+};
 
-        unsigned long int sent;		/* sent by the driver */
-        unsigned long int disc;		/* discarded due to driver congestion */
-        unsigned long int fail;		/* Tx failed due to hardware congestion */
 
-        unsigned long int frwd;		/* forwarded to devices */
-        unsigned long int kern;		/* passed to kernel */
-};
+/* class tables: per-group tables that map a key (as returned by a property)
+ * to a class, looked up by the pfq-lang function class_table.
+ */
 
+#define Q_CLASS_TABLES			4
+#define Q_CLASS_TABLE_SIZE		1024	/* slots per table, up to 3/4 in use */
 
-/* pfq counters for groups */
+#define Q_CLASS_TABLE_DEL		-1	/* remove the key */
+#define Q_CLASS_TABLE_RESET		-2	/* remove all the keys of the table */
 
-struct pfq_counters
+struct pfq_so_class_table
 {
-        unsigned long int counter[Q_MAX_COUNTERS];
+        uint64_t key;	/* first: same layout for 32 and 64-bit userspace */
+        int gid;
+        int table;
+        int class_id;	/* class index, Q_CLASS_TABLE_DEL or Q_CLASS_TABLE_RESET */
+        int pad;
 };
 
+
 #endif /* PF_Q_LINUX_H */
@@ -54,6 +54,7 @@
 #include <lang/symtable.h>
 
 #include <pfq/global.h>
+#include <pfq/ctrl.h>
 #include <pfq/devmap.h>
 #include <pfq/percpu.h>
 #include <pfq/group.h>
@@ -115,6 +116,7 @@ pfq_release(struct socket *sock)
 
 	pr_devel("[PFQ|%d] disabling socket...\n", so->id);
 	pfq_sock_disable(so);
+	pfq_sock_set_tstamp(so, Q_TSTAMP_OFF);
 
 	/* release the socket id */
 
@@ -155,6 +157,9 @@ pfq_poll(struct file *file, struct socket *sock, poll_table * wait)
 
 	poll_wait(file, &so->waitqueue, wait);
 
+	/* paired with pfq_sk_queue_notify */
+	smp_mb();
+
         if(!pfq_sock_rx_shared_queue(so))
                 return mask;
 
@@ -185,9 +190,16 @@ static int pfq_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
 			return 0;
 		}
 
+		if (arg <= Q_MAX_TX_QUEUES && pfq_sock_tx_wakeup(so, (int)arg) == 0)
+			return 0;
+
 		printk(KERN_INFO "[PFQ|%d] QIOCTX queue: bad argument %lu!\n", so->id, arg);
 		return -EINVAL;
 	}
+	case QIOCCTRL:
+	{
+		return pfq_ctrl_doorbell(so);
+	}
 #ifdef CONFIG_INET
         case SIOCGIFFLAGS:
         case SIOCSIFFLAGS:
@@ -590,6 +602,9 @@ static void __exit pfq_exit_module(void)
 
 	pfq_groups_destruct();
 
+	/* free the devmap (empty unless a bind leaked) */
+	pfq_devmap_free();
+
         printk(KERN_INFO "[PFQ] unloaded.\n");
 }
 
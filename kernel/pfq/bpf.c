@@ -29,6 +29,8 @@
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <net/sock.h>
+#include <linux/bpf.h>
+#include <linux/err.h>
 
 #include <pfq/bpf.h>
 
@@ -82,3 +84,78 @@ pfq_free_sk_filter(struct sk_filter *filter)
 }
 
 
+/* two filters are equal when they run the same instructions (as loaded by the kernel) */
+
+bool
+pfq_sk_filter_equal(struct sk_filter const *a, struct sk_filter const *b)
+{
+	if (a == b)
+		return true;
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(3,15,0))
+	return a->len == b->len &&
+	       memcmp(a->insns, b->insns, a->len * sizeof(struct sock_filter)) == 0;
+#elif (LINUX_VERSION_CODE < KERNEL_VERSION(4,4,0))
+	return false;
+#else
+	return a->prog->len == b->prog->len &&
+	       memcmp(a->prog->insnsi, b->prog->insnsi, a->prog->len * sizeof(struct bpf_insn)) == 0;
+#endif
+}
+
+
+struct bpf_prog *
+pfq_get_bpf_prog(int fd)
+{
+#ifdef PFQ_EBPF_SUPPORT
+	struct bpf_prog *prog;
+
+	prog = bpf_prog_get_type(fd, BPF_PROG_TYPE_SOCKET_FILTER);
+	if (IS_ERR(prog)) {
+		pr_devel("[PFQ] eBPF: bad program fd=%d (%ld)!\n", fd, PTR_ERR(prog));
+		return NULL;
+	}
+
+        pr_devel("[PFQ] eBPF: new prog (type %d, %u insns%s)\n", prog->type, prog->len, prog->jited ? ", jited" : "");
+	return prog;
+#else
+	return NULL;
+#endif
+}
+
+
+void
+pfq_put_bpf_prog(struct bpf_prog *prog)
+{
+#ifdef PFQ_EBPF_SUPPORT
+	bpf_prog_put(prog);
+#endif
+}
+
+
+bool
+pfq_bpf_prog_equal(struct bpf_prog const *a, struct bpf_prog const *b)
+{
+	if (a == b)
+		return true;
+#ifdef PFQ_EBPF_SUPPORT
+	return a->len == b->len &&
+	       memcmp(a->insnsi, b->insnsi, a->len * sizeof(struct bpf_insn)) == 0;
+#else
+	return false;
+#endif
+}
+
+
+/* a program whose result can be shared among groups: a socket filter that
+ * uses no maps (the side effects would be lost for the groups that share it).
+ */
+
+bool
+pfq_bpf_prog_pure(struct bpf_prog const *prog)
+{
+#ifdef PFQ_EBPF_SUPPORT
+	return prog->type == BPF_PROG_TYPE_SOCKET_FILTER && prog->aux->used_map_cnt == 0;
+#else
+	return false;
+#endif
+}
@@ -26,8 +26,49 @@
 #define PFQ_BPF_H
 
 #include <linux/filter.h>
+#include <linux/version.h>
 
 extern struct sk_filter * pfq_alloc_sk_filter(struct sock_fprog *fprog);
 extern void pfq_free_sk_filter(struct sk_filter *filter);
+extern bool pfq_sk_filter_equal(struct sk_filter const *a, struct sk_filter const *b);
+
+
+/* eBPF programs loaded by the user (socket filter type) */
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,16,0))
+#define PFQ_EBPF_SUPPORT
+#endif
+
+struct bpf_prog;
+
+extern struct bpf_prog * pfq_get_bpf_prog(int fd);
+extern void pfq_put_bpf_prog(struct bpf_prog *prog);
+extern bool pfq_bpf_prog_equal(struct bpf_prog const *a, struct bpf_prog const *b);
+extern bool pfq_bpf_prog_pure(struct bpf_prog const *prog);
+
+
+#ifdef PFQ_EBPF_SUPPORT
+
+/* run the program: packets are dropped when it returns 0. Only socket
+ * filters are accepted, since the skb is shared with other groups and with
+ * the kernel: their helpers cannot modify it. The control buffer of the skb
+ * (used by PFQ pools) is preserved.
+ */
+
+static inline bool
+pfq_run_bpf_prog(struct bpf_prog const *prog, struct sk_buff *skb)
+{
+	return bpf_prog_run_save_cb(prog, skb) != 0;
+}
+
+#else
+
+static inline bool
+pfq_run_bpf_prog(struct bpf_prog const *prog, struct sk_buff *skb)
+{
+	return true;
+}
+
+#endif
 
 #endif /* PFQ_BPF_H */
@@ -0,0 +1,193 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/bottom_half.h>
+
+#include <pfq/class_table.h>
+
+
+#define Q_CLASS_TABLE_LOAD	(Q_CLASS_TABLE_SIZE/4*3)
+
+
+struct pfq_class_table *
+pfq_class_table_alloc(void)
+{
+	struct pfq_class_table *table = kzalloc(sizeof(struct pfq_class_table), GFP_KERNEL);
+	if (table)
+		seqcount_init(&table->seq);
+	return table;
+}
+
+
+static struct pfq_class_entry *
+__pfq_class_table_find(struct pfq_class_table *table, uint64_t key)
+{
+	unsigned int i, n;
+
+	for(n = 0, i = hash_64(key, Q_CLASS_TABLE_BITS); n < Q_CLASS_TABLE_SIZE; n++, i = (i + 1) & (Q_CLASS_TABLE_SIZE - 1))
+	{
+		struct pfq_class_entry *e = &table->entry[i];
+
+		if (e->state == Q_CLASS_ENTRY_FREE)
+			break;
+
+		if (e->state == Q_CLASS_ENTRY_USED && e->key == key)
+			return e;
+	}
+	return NULL;
+}
+
+
+/* to be called within the write section */
+
+static void
+__pfq_class_table_insert(struct pfq_class_table *table, uint64_t key, int class_id)
+{
+	unsigned int i;
+
+	for(i = hash_64(key, Q_CLASS_TABLE_BITS);; i = (i + 1) & (Q_CLASS_TABLE_SIZE - 1))
+	{
+		struct pfq_class_entry *e = &table->entry[i];
+
+		if (e->state != Q_CLASS_ENTRY_USED) {
+			if (e->state == Q_CLASS_ENTRY_DELETED)
+				table->deleted--;
+			e->key = key;
+			e->class_id = class_id;
+			e->state = Q_CLASS_ENTRY_USED;
+			table->used++;
+			return;
+		}
+	}
+}
+
+
+/* readers running on this cpu (in softirq) must not interrupt the writer */
+
+static inline void
+__pfq_class_table_write_begin(struct pfq_class_table *table)
+{
+	local_bh_disable();
+	write_seqcount_begin(&table->seq);
+}
+
+static inline void
+__pfq_class_table_write_end(struct pfq_class_table *table)
+{
+	write_seqcount_end(&table->seq);
+	local_bh_enable();
+}
+
+
+/* reclaim the deleted entries */
+
+static int
+__pfq_class_table_rehash(struct pfq_class_table *table)
+{
+	struct pfq_class_entry *used;
+	unsigned int i, n = 0;
+
+	used = kmalloc(table->used * sizeof(struct pfq_class_entry) + 1, GFP_KERNEL);
+	if (used == NULL)
+		return -ENOMEM;
+
+	for(i = 0; i < Q_CLASS_TABLE_SIZE; i++)
+	{
+		if (table->entry[i].state == Q_CLASS_ENTRY_USED)
+			used[n++] = table->entry[i];
+	}
+
+	__pfq_class_table_write_begin(table);
+
+	memset(table->entry, 0, sizeof(table->entry));
+	table->used = 0;
+	table->deleted = 0;
+
+	for(i = 0; i < n; i++)
+		__pfq_class_table_insert(table, used[i].key, used[i].class_id);
+
+	__pfq_class_table_write_end(table);
+
+	kfree(used);
+	return 0;
+}
+
+
+int
+pfq_class_table_set(struct pfq_class_table *table, uint64_t key, int class_id)
+{
+	struct pfq_class_entry *e;
+
+	e = __pfq_class_table_find(table, key);
+	if (e) {
+		__pfq_class_table_write_begin(table);
+		e->class_id = class_id;
+		__pfq_class_table_write_end(table);
+		return 0;
+	}
+
+	if (table->used >= Q_CLASS_TABLE_LOAD)
+		return -ENOSPC;
+
+	if (table->used + table->deleted >= Q_CLASS_TABLE_LOAD) {
+		int err = __pfq_class_table_rehash(table);
+		if (err < 0)
+			return err;
+	}
+
+	__pfq_class_table_write_begin(table);
+	__pfq_class_table_insert(table, key, class_id);
+	__pfq_class_table_write_end(table);
+	return 0;
+}
+
+
+void
+pfq_class_table_del(struct pfq_class_table *table, uint64_t key)
+{
+	struct pfq_class_entry *e;
+
+	e = __pfq_class_table_find(table, key);
+	if (e == NULL)
+		return;
+
+	__pfq_class_table_write_begin(table);
+	e->state = Q_CLASS_ENTRY_DELETED;
+	table->used--;
+	table->deleted++;
+	__pfq_class_table_write_end(table);
+}
+
+
+void
+pfq_class_table_reset(struct pfq_class_table *table)
+{
+	__pfq_class_table_write_begin(table);
+	memset(table->entry, 0, sizeof(table->entry));
+	table->used = 0;
+	table->deleted = 0;
+	__pfq_class_table_write_end(table);
+}
@@ -0,0 +1,100 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#ifndef PFQ_CLASS_TABLE_H
+#define PFQ_CLASS_TABLE_H
+
+#include <linux/kernel.h>
+#include <linux/hash.h>
+#include <linux/seqlock.h>
+
+#include <linux/pf_q.h>
+
+/* class table: open addressing (linear probing) hash table from a 64 bit key
+ * to a class index. Lookups are lock-free, updates are serialized by the
+ * caller and retried by the readers by means of a sequence counter.
+ */
+
+#define Q_CLASS_TABLE_BITS	ilog2(Q_CLASS_TABLE_SIZE)
+
+#define Q_CLASS_ENTRY_FREE	0
+#define Q_CLASS_ENTRY_USED	1
+#define Q_CLASS_ENTRY_DELETED	2
+
+
+struct pfq_class_entry
+{
+	uint64_t	key;
+	int		class_id;
+	int		state;
+};
+
+
+struct pfq_class_table
+{
+	seqcount_t	seq;
+	unsigned int	used;		/* entries in use */
+	unsigned int	deleted;	/* deleted entries, reclaimed on rehash */
+	struct pfq_class_entry entry[Q_CLASS_TABLE_SIZE];
+};
+
+
+/* return the class index associated with the key, -1 if not found */
+
+static inline int
+pfq_class_table_lookup(struct pfq_class_table *table, uint64_t key)
+{
+	unsigned int seq, i, n;
+	int ret;
+
+	do {
+		seq = read_seqcount_begin(&table->seq);
+		ret = -1;
+
+		for(n = 0, i = hash_64(key, Q_CLASS_TABLE_BITS); n < Q_CLASS_TABLE_SIZE; n++, i = (i + 1) & (Q_CLASS_TABLE_SIZE - 1))
+		{
+			struct pfq_class_entry const *e = &table->entry[i];
+
+			if (e->state == Q_CLASS_ENTRY_FREE)
+				break;
+
+			if (e->state == Q_CLASS_ENTRY_USED && e->key == key) {
+				ret = e->class_id;
+				break;
+			}
+		}
+	}
+	while (read_seqcount_retry(&table->seq, seq));
+
+	return ret;
+}
+
+
+extern struct pfq_class_table * pfq_class_table_alloc(void);
+extern int  pfq_class_table_set(struct pfq_class_table *table, uint64_t key, int class_id);
+extern void pfq_class_table_del(struct pfq_class_table *table, uint64_t key);
+extern void pfq_class_table_reset(struct pfq_class_table *table);
+
+
+#endif /* PFQ_CLASS_TABLE_H */
@@ -0,0 +1,265 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <pfq/ctrl.h>
+#include <pfq/global.h>
+#include <pfq/group.h>
+#include <pfq/io.h>
+#include <pfq/queue.h>
+#include <pfq/sock.h>
+#include <pfq/stats.h>
+
+
+/*
+ * publish the stats of the socket and of the watched groups
+ * (seqlock: the snapshot is consistent when seq is even and unchanged).
+ */
+
+static void
+pfq_ctrl_stats_snapshot(struct pfq_sock *so, struct pfq_shared_ctrl *ctrl)
+{
+	unsigned int seq = ctrl->stats.seq;
+	int n, i;
+
+	__atomic_store_n(&ctrl->stats.seq, seq + 1, __ATOMIC_RELAXED);
+	smp_wmb();
+
+	pfq_kernel_stats_read(so->stats, &ctrl->stats.sock);
+
+	for(n = 0; n < Q_CTRL_MAX_GROUPS; n++)
+	{
+		struct pfq_shared_group_stats *gs = &ctrl->stats.group[n];
+		struct pfq_group *group;
+
+		gs->gid = so->ctrl_gid[n];
+		if (gs->gid < 0)
+			continue;
+
+		group = pfq_group_get((__force pfq_gid_t)gs->gid);
+		if (group == NULL)
+			continue;
+
+		pfq_kernel_stats_read(group->stats, &gs->stats);
+
+		for(i = 0; i < Q_MAX_COUNTERS; i++)
+			gs->counters.counter[i] = (unsigned long int)sparse_read(group->counters, value[i]);
+	}
+
+	ctrl->stats.nsec = ktime_to_ns(ktime_get_real());
+
+	smp_wmb();
+	__atomic_store_n(&ctrl->stats.seq, seq + 2, __ATOMIC_RELAXED);
+}
+
+
+static void
+pfq_ctrl_timer(unsigned long data)
+{
+	struct pfq_sock *so = (struct pfq_sock *)data;
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+
+	if (sq == NULL)
+		return;
+
+	spin_lock(&so->ctrl_lock);
+	pfq_ctrl_stats_snapshot(so, &sq->ctrl);
+
+	/* the TSC drifts from the wall clock: refresh the conversion table */
+
+	if (so->tstamp == Q_TSTAMP_TSC && time_after_eq(jiffies, so->tsc_refresh)) {
+		pfq_shared_queue_tsc_init(so, sq);
+		so->tsc_refresh = jiffies + msecs_to_jiffies(Q_TSC_REFRESH_PERIOD);
+	}
+
+	spin_unlock(&so->ctrl_lock);
+
+	mod_timer(&so->ctrl_timer, jiffies + msecs_to_jiffies(Q_CTRL_STATS_PERIOD));
+}
+
+
+void
+pfq_ctrl_init(struct pfq_sock *so)
+{
+	int n;
+
+	spin_lock_init(&so->ctrl_lock);
+
+	init_timer_deferrable(&so->ctrl_timer);
+	so->ctrl_timer.function = pfq_ctrl_timer;
+	so->ctrl_timer.data = (unsigned long)so;
+
+	for(n = 0; n < Q_CTRL_MAX_GROUPS; n++)
+		so->ctrl_gid[n] = -1;
+}
+
+
+void
+pfq_ctrl_start(struct pfq_sock *so)
+{
+	mod_timer(&so->ctrl_timer, jiffies + msecs_to_jiffies(Q_CTRL_STATS_PERIOD));
+}
+
+
+void
+pfq_ctrl_stop(struct pfq_sock *so)
+{
+	int n;
+
+	del_timer_sync(&so->ctrl_timer);
+
+	for(n = 0; n < Q_CTRL_MAX_GROUPS; n++)
+		so->ctrl_gid[n] = -1;
+}
+
+
+/* commands */
+
+static int
+pfq_ctrl_tx_queue_xmit(struct pfq_sock *so, int queue)
+{
+	if (queue == 0) {
+		tx_response_t tx = pfq_sk_queue_xmit(so, -1, Q_NO_KTHREAD);
+
+		sparse_add(so->stats, sent, tx.ok);
+		sparse_add(so->stats, fail, tx.fail);
+		sparse_add(global->percpu_stats, sent, tx.ok);
+		sparse_add(global->percpu_stats, fail, tx.fail);
+		return (int)tx.ok;
+	}
+
+	if (queue > 0 && pfq_sock_tx_wakeup(so, queue) == 0)
+		return 0;
+
+	return -EINVAL;
+}
+
+
+static int
+pfq_ctrl_group_watch(struct pfq_sock *so, int gid)
+{
+	int n, free = -1;
+
+	if (pfq_group_get((__force pfq_gid_t)gid) == NULL ||
+	    pfq_group_is_free((__force pfq_gid_t)gid))
+		return -EINVAL;
+
+	if (!pfq_group_access((__force pfq_gid_t)gid, so->id))
+		return -EACCES;
+
+	for(n = 0; n < Q_CTRL_MAX_GROUPS; n++)
+	{
+		if (so->ctrl_gid[n] == gid)
+			return n;
+		if (so->ctrl_gid[n] < 0 && free < 0)
+			free = n;
+	}
+
+	if (free < 0)
+		return -ENOSPC;
+
+	so->ctrl_gid[free] = gid;
+	return free;
+}
+
+
+static int
+pfq_ctrl_group_unwatch(struct pfq_sock *so, int gid)
+{
+	int n;
+
+	for(n = 0; n < Q_CTRL_MAX_GROUPS; n++)
+	{
+		if (so->ctrl_gid[n] == gid) {
+			so->ctrl_gid[n] = -1;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+
+/*
+ * process the commands submitted in the shared memory and refresh the stats:
+ * return the number of commands completed.
+ */
+
+int
+pfq_ctrl_doorbell(struct pfq_sock *so)
+{
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+	struct pfq_shared_ctrl *ctrl;
+	unsigned int head, tail, cq_head;
+	int done = 0;
+
+	if (sq == NULL) {
+		printk(KERN_INFO "[PFQ|%d] ctrl: socket not enabled!\n", so->id);
+		return -EPERM;
+	}
+
+	ctrl = &sq->ctrl;
+
+	spin_lock_bh(&so->ctrl_lock);
+
+	head    = __atomic_load_n(&ctrl->sq.head, __ATOMIC_ACQUIRE);
+	tail    = ctrl->sq.tail;
+	cq_head = ctrl->cq.head;
+
+	for(; tail != head; tail++, cq_head++, done++)
+	{
+		struct pfq_ctrl_sqe sqe;
+		struct pfq_ctrl_cqe *cqe;
+
+		/* stop when the completion ring is full */
+
+		if (cq_head - __atomic_load_n(&ctrl->cq.tail, __ATOMIC_ACQUIRE) >= Q_CTRL_RING_LEN)
+			break;
+
+		sqe = ctrl->sq.ring[tail & (Q_CTRL_RING_LEN-1)];
+		cqe = &ctrl->cq.ring[cq_head & (Q_CTRL_RING_LEN-1)];
+
+		switch(sqe.op)
+		{
+		case Q_CTRL_NOP:
+			cqe->result = 0; break;
+		case Q_CTRL_TX_QUEUE_XMIT:
+			cqe->result = pfq_ctrl_tx_queue_xmit(so, sqe.arg); break;
+		case Q_CTRL_GROUP_WATCH:
+			cqe->result = pfq_ctrl_group_watch(so, sqe.arg); break;
+		case Q_CTRL_GROUP_UNWATCH:
+			cqe->result = pfq_ctrl_group_unwatch(so, sqe.arg); break;
+		default:
+			cqe->result = -EINVAL;
+		}
+
+		cqe->user_data = sqe.user_data;
+	}
+
+	__atomic_store_n(&ctrl->sq.tail, tail, __ATOMIC_RELEASE);
+	__atomic_store_n(&ctrl->cq.head, cq_head, __ATOMIC_RELEASE);
+
+	pfq_ctrl_stats_snapshot(so, ctrl);
+
+	spin_unlock_bh(&so->ctrl_lock);
+	return done;
+}
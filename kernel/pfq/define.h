@@ -41,8 +41,10 @@
 #define Q_MAX_QUEUE_MASK		(Q_MAX_QUEUE-1)
 
 #define Q_MAX_TX_SKB_COPY		256
+#define Q_TX_SKB_BULK			32	/* skbs prepared per Tx burst */
 
 #define Q_GRACE_PERIOD			200 /* msec */
+#define Q_TX_ZCOPY_TIMEOUT		5000 /* msec */
 
 #define Q_FUN_SYMB_LEN			256
 #define Q_FUN_SIGN_LEN			1024
@@ -25,29 +25,143 @@
 #include <pfq/devmap.h>
 #include <pfq/group.h>
 #include <pfq/kcompat.h>
+#include <pfq/netdev.h>
 #include <pfq/printk.h>
 #include <pfq/thread.h>
 
 
 void pfq_devmap_toggle_update(void)
 {
-    int i,j;
+    bool any = rcu_access_pointer(global->devmap_any) != NULL;
+    int i;
+
     for(i=0; i < Q_MAX_DEVICE; ++i)
     {
-        unsigned long val = 0;
-        for(j=0; j < Q_MAX_QUEUE; ++j)
-        {
-            val |= (unsigned long)atomic_long_read(&global->devmap[i][j]);
+        bool val = any || rcu_access_pointer(global->devmap[i]) != NULL;
+        atomic_set(&global->devmap_toggle[i], val ? 1 : 0);
+    }
+}
+
+
+/* number of Rx queues of a device (the map of Q_ANY_DEVICE grows on demand) */
+
+static unsigned int
+pfq_devmap_dev_queues(int index)
+{
+    unsigned int n = 0;
+#ifdef CONFIG_RPS
+    struct net_device *dev;
+
+    if (index == Q_ANY_DEVICE)
+        return 0;
+
+    dev = pfq_dev_get_by_index(index);
+    if (dev) {
+        n = dev->real_num_rx_queues;
+        dev_put(dev);
+    }
+#endif
+    return n;
+}
+
+
+static bool
+pfq_devmap_dev_empty(struct pfq_devmap_dev const *map)
+{
+    unsigned int q;
+
+    if (map->any)
+        return false;
+    for(q = 0; q < map->nr_queues; ++q)
+        if (map->queue[q])
+            return false;
+    return true;
+}
+
+
+/* copy-on-write update of a single map, called with devmap_lock held.
+ * Return 1 if the map changed, 0 otherwise, -ENOMEM on failure.
+ */
+
+static int
+__pfq_devmap_update(struct pfq_devmap_dev __rcu **pmap, int action, int index, int queue, pfq_gid_t gid)
+{
+    struct pfq_devmap_dev *old, *map;
+    unsigned long bit = 1UL << (__force int)gid;
+    unsigned int nr_queues, q;
+
+    old = rcu_dereference_protected(*pmap, lockdep_is_held(&global->devmap_lock));
+
+    if (action == Q_DEVMAP_RESET) {
+        if (old == NULL)
+            return 0;
+        if (!(old->any & bit)) {
+            if (queue == Q_ANY_QUEUE) {
+                for(q = 0; q < old->nr_queues; ++q)
+                    if (old->queue[q] & bit)
+                        break;
+                if (q == old->nr_queues)
+                    return 0;
+            }
+            else if ((unsigned int)queue >= old->nr_queues || !(old->queue[queue] & bit))
+                return 0;
         }
+    }
 
-        atomic_set(&global->devmap_toggle[i], val ? 1 : 0);
+    nr_queues = max_t(unsigned int, old ? old->nr_queues : 0, pfq_devmap_dev_queues(index));
+    if (queue != Q_ANY_QUEUE)
+        nr_queues = max_t(unsigned int, nr_queues, (unsigned int)queue + 1);
+
+    map = kzalloc(sizeof(*map) + nr_queues * sizeof(unsigned long), GFP_KERNEL);
+    if (map == NULL) {
+        printk(KERN_WARNING "[PFQ] devmap_update: out of memory (ifindex=%d)!\n", index);
+        return -ENOMEM;
+    }
+
+    map->nr_queues = nr_queues;
+    if (old) {
+        map->any = old->any;
+        memcpy(map->queue, old->queue, old->nr_queues * sizeof(unsigned long));
+    }
+
+    if (action == Q_DEVMAP_SET) {
+        if (queue == Q_ANY_QUEUE)
+            map->any |= bit;
+        else
+            map->queue[queue] |= bit;
     }
+    else {
+        if (queue == Q_ANY_QUEUE) {
+            map->any &= ~bit;
+            for(q = 0; q < nr_queues; ++q)
+                map->queue[q] &= ~bit;
+        }
+        else {
+            /* unbind a single queue of a group bound to any queue */
+            if (map->any & bit) {
+                map->any &= ~bit;
+                for(q = 0; q < nr_queues; ++q)
+                    map->queue[q] |= bit;
+            }
+            map->queue[queue] &= ~bit;
+        }
+
+        if (pfq_devmap_dev_empty(map)) {
+            kfree(map);
+            map = NULL;
+        }
+    }
+
+    rcu_assign_pointer(*pmap, map);
+    if (old)
+        kfree_rcu(old, rcu);
+    return 1;
 }
 
 
 int pfq_devmap_update(int action, int index, int queue, pfq_gid_t gid)
 {
-    int n = 0, i,q;
+    int n = 0, i, ret;
 
     if (unlikely((__force int)gid >= Q_MAX_GID ||
 		 (__force int)gid < 0)) {
@@ -55,43 +169,73 @@ int pfq_devmap_update(int action, int index, int queue, pfq_gid_t gid)
         return 0;
     }
 
+    if (unlikely(queue != Q_ANY_QUEUE && (queue < 0 || queue >= Q_MAX_QUEUE))) {
+        pr_devel("[PF_Q] devmap_update: bad queue (%d)\n",queue);
+        return 0;
+    }
+
     mutex_lock(&global->devmap_lock);
 
-    for(i=0; i < Q_MAX_DEVICE; ++i)
-    {
-        for(q=0; q < Q_MAX_QUEUE; ++q)
-        {
-            long tmp;
+    /* stop at the first failure: the maps updated so far are kept (each
+     * one is replaced atomically), and the caches are invalidated anyway */
 
-            if (!pfq_devmap_equal(i, q, index, queue))
-                continue;
+    if (index == Q_ANY_DEVICE) {
 
-            /* map_set... */
-            if (action == Q_DEVMAP_SET) {
+        ret = __pfq_devmap_update(&global->devmap_any, action, index, queue, gid);
+        if (ret < 0)
+            goto out;
+        n += ret;
 
-                tmp = atomic_long_read(&global->devmap[i][q]);
-                tmp |= 1L << (__force int)gid;
-                atomic_long_set(&global->devmap[i][q], tmp);
-                n++;
-                continue;
-            }
+        /* unbind the group from every device */
 
-            /* map_reset */
-            tmp = atomic_long_read(&global->devmap[i][q]);
-            if (tmp & (1L << (__force int)gid)) {
-                tmp &= ~(1L << (__force int)gid);
-                atomic_long_set(&global->devmap[i][q], tmp);
-                n++;
-                continue;
+        if (action == Q_DEVMAP_RESET) {
+            for(i=0; i < Q_MAX_DEVICE; ++i)
+            {
+                ret = __pfq_devmap_update(&global->devmap[i], action, i, queue, gid);
+                if (ret < 0)
+                    goto out;
+                n += ret;
             }
         }
     }
+    else {
+        ret = __pfq_devmap_update(&global->devmap[index & Q_MAX_DEVICE_MASK], action, index, queue, gid);
+        if (ret < 0)
+            goto out;
+        n += ret;
+    }
+
+    ret = n;
+out:
+
+    /* invalidate the per-cpu caches... */
+
+    smp_wmb();
+    atomic_inc(&global->devmap_gen);
 
     /* update capture toggle filter... */
 
     pfq_devmap_toggle_update();
 
     mutex_unlock(&global->devmap_lock);
-    return n;
+    return ret;
 }
 
+
+void pfq_devmap_free(void)
+{
+    int i;
+
+    mutex_lock(&global->devmap_lock);
+
+    for(i=0; i < Q_MAX_DEVICE; ++i)
+    {
+        kfree(rcu_dereference_protected(global->devmap[i], 1));
+        RCU_INIT_POINTER(global->devmap[i], NULL);
+    }
+
+    kfree(rcu_dereference_protected(global->devmap_any, 1));
+    RCU_INIT_POINTER(global->devmap_any, NULL);
+
+    mutex_unlock(&global->devmap_lock);
+}
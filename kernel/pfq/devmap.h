@@ -25,13 +25,23 @@
 #ifndef PFQ_DEVMAP_H
 #define PFQ_DEVMAP_H
 
+#include <pfq/bitops.h>
 #include <pfq/global.h>
 #include <pfq/group.h>
 #include <pfq/define.h>
 #include <pfq/kcompat.h>
+#include <pfq/percpu.h>
 
+#include <linux/rcupdate.h>
 
-/* pfq devmap */
+
+/* pfq devmap
+ *
+ * Sparse map (ifindex, queue) -> group mask: each device bound to a group
+ * has a small RCU-published array sized to its number of Rx queues (bindings
+ * to Q_ANY_DEVICE live in a map of their own). Maps are copied on update
+ * and a device without bindings has no map.
+ */
 
 enum
 {      Q_DEVMAP_RESET,
@@ -39,26 +49,71 @@ enum
 };
 
 
-/* called from u-context
+struct pfq_devmap_dev
+{
+	struct rcu_head	rcu;
+	unsigned long	any;		/* groups bound to any queue */
+	unsigned int	nr_queues;
+	unsigned long	queue[];	/* groups bound to a single queue */
+};
+
+
+/* called from u-context: return the number of maps changed, or -ENOMEM
 */
 
 extern int  pfq_devmap_update(int action, int index, int queue, pfq_gid_t gid);
+extern void pfq_devmap_free(void);
 
 
 static inline
-int pfq_devmap_equal(int i1, int q1, int i2, int q2)
+unsigned long __pfq_devmap_mask(struct pfq_devmap_dev const *map, int queue)
 {
-        return  (i1 == i2 && q1 == q2) ||
-                (i1 == i2 && q2 == -1) ||
-                (i2 == -1 && q1 == q2) ||
-                (i2 == -1 && q2 == -1);
+	if (map == NULL)
+		return 0;
+	return map->any | ((unsigned int)queue < map->nr_queues ? map->queue[queue] : 0);
 }
 
 
+/* the group mask of the last (dev, queue) looked up is cached per-cpu,
+ * until the devmap generation changes.
+ */
+
+static inline
+unsigned long pfq_devmap_get_groups(struct pfq_percpu_data *data, int dev, int queue)
+{
+	struct pfq_devmap_cache *cache = &data->devmap_cache;
+	unsigned int gen = (unsigned int)atomic_read(&global->devmap_gen);
+	unsigned long mask;
+
+	if (likely(cache->gen == gen && cache->dev == dev && cache->queue == queue))
+		return cache->mask;
+
+	smp_rmb();
+
+	rcu_read_lock();
+	mask = __pfq_devmap_mask(rcu_dereference(global->devmap[dev & Q_MAX_DEVICE_MASK]), queue) |
+	       __pfq_devmap_mask(rcu_dereference(global->devmap_any), queue);
+	rcu_read_unlock();
+
+	cache->dev   = dev;
+	cache->queue = queue;
+	cache->mask  = mask;
+	cache->gen   = gen;
+	return mask;
+}
+
+
+/* return the id of the socket eligible for the fast path (-1 otherwise):
+ * the devmap entry must be bound to a single group without filters nor
+ * computation, joined by a single socket.
+ */
+
 static inline
-unsigned long pfq_devmap_get_groups(int dev, int queue)
+int pfq_devmap_get_fast_id(unsigned long group_mask)
 {
-        return (long unsigned)atomic_long_read(&global->devmap[dev & Q_MAX_DEVICE_MASK][queue & Q_MAX_QUEUE_MASK]);
+        if (group_mask == 0 || (group_mask & (group_mask - 1)))
+                return -1;
+        return atomic_read(&global->groups[pfq_ctz(group_mask)].fast_id);
 }
 
 
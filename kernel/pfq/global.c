@@ -41,12 +41,17 @@ struct pfq_global_data default_global =
 	.tx_cpu			= {0},
 	.tx_cpu_nr		= 0,
 	.tx_retry		= 1,
+	.tx_idle_spin		= 100,
 
 	.socket_ptr		= {{0}},
 	.socket_count		= {0},
+	.tstamp_wallclock	= {0},
+	.tstamp_tsc		= {0},
      // .socket_lock		= {{0}},
 
-	.devmap			= {{{0}}},
+	.devmap			= {0},
+	.devmap_any		= NULL,
+	.devmap_gen		= {0},
 	.devmap_toggle		= {{0}},
      // .devmap_lock		= {{0}},
 
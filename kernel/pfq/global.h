@@ -35,6 +35,7 @@ struct pfq_kernel_stats __percpu;
 struct pfq_memory_stats __percpu;
 struct pfq_percpu_data  __percpu;
 struct pfq_percpu_pool  __percpu;
+struct pfq_devmap_dev;
 
 
 struct pfq_global_data
@@ -53,12 +54,17 @@ struct pfq_global_data
 	int tx_cpu[Q_MAX_CPU];
 	int tx_cpu_nr;
 	int tx_retry;
+	int tx_idle_spin;
 
 	atomic_long_t   socket_ptr[Q_MAX_ID];
 	atomic_t        socket_count;
+	atomic_t	tstamp_wallclock;	/* sockets with per-packet wall clock timestamps */
+	atomic_t	tstamp_tsc;		/* sockets with TSC timestamps */
 	struct mutex	socket_lock;
 
-	atomic_long_t   devmap [Q_MAX_DEVICE][Q_MAX_QUEUE];
+	struct pfq_devmap_dev __rcu *devmap [Q_MAX_DEVICE];
+	struct pfq_devmap_dev __rcu *devmap_any;	/* Q_ANY_DEVICE bindings */
+	atomic_t        devmap_gen;			/* bumped on update (per-cpu caches) */
 	atomic_t        devmap_toggle [Q_MAX_DEVICE];
 	struct mutex	devmap_lock;
 
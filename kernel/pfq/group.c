@@ -27,6 +27,7 @@
 #include <pfq/atomic.h>
 #include <pfq/bitops.h>
 #include <pfq/bpf.h>
+#include <pfq/class_table.h>
 #include <pfq/devmap.h>
 #include <pfq/global.h>
 #include <pfq/group.h>
@@ -51,7 +52,7 @@ pfq_group_unlock(void)
 int
 pfq_groups_init(void)
 {
-	int n;
+	int n, i;
 	for(n = 0; n < Q_MAX_GID; n++)
 	{
 		struct pfq_group * group = &global->groups[n];
@@ -62,6 +63,13 @@ pfq_groups_init(void)
 		group->owner = Q_INVALID_ID;
 		group->policy = Q_POLICY_GROUP_UNDEFINED;
 
+		atomic_set(&group->fast_id, -1);
+		atomic_long_set(&group->vlan_filters, 0L);
+		atomic_long_set(&group->sock_id_ext, 0L);
+
+		for(i = 0; i < Q_CLASS_TABLES; i++)
+			atomic_long_set(&group->class_table[i], 0L);
+
 		group->stats = alloc_percpu(pfq_group_stats_t);
 		if (group->stats == NULL) {
 			goto err;
@@ -107,6 +115,28 @@ bool __pfq_group_is_empty(pfq_gid_t gid)
 }
 
 
+/* a group is eligible for the plain capture fast path when it has no
+ * bp/vlan filters nor computation and it is joined by a single socket.
+ */
+
+static void
+__pfq_group_fast_update(struct pfq_group *group)
+{
+        unsigned long mask = (unsigned long)atomic_long_read(&group->sock_id[0]);
+        int id = -1;
+
+        if (group->enabled &&
+            !atomic_long_read(&group->vlan_filters) &&
+            !atomic_long_read(&group->bp_filter) &&
+            !atomic_long_read(&group->bpf_prog) &&
+            !atomic_long_read(&group->comp) &&
+            mask && !(mask & (mask - 1)))
+                id = (int)pfq_ctz(mask);
+
+        atomic_set(&group->fast_id, id);
+}
+
+
 bool
 pfq_group_policy_access(pfq_gid_t gid, pfq_id_t id, int policy)
 {
@@ -170,24 +200,22 @@ __pfq_group_init(struct pfq_group *group, pfq_gid_t gid)
         group->owner  = Q_INVALID_ID;
         group->policy = Q_POLICY_GROUP_UNDEFINED;
 
-        for(i = 0; i < Q_CLASS_MAX; i++)
+        for(i = 0; i < Q_GROUP_INLINE_CLASSES; i++)
         {
                 atomic_long_set(&group->sock_id[i], 0);
         }
 
         atomic_long_set(&group->bp_filter,0L);
+        atomic_long_set(&group->bpf_prog, 0L);
+        atomic_long_set(&group->bp_filter_key, 0L);
+        atomic_long_set(&group->bpf_prog_key,  0L);
         atomic_long_set(&group->comp,     0L);
         atomic_long_set(&group->comp_ctx, 0L);
+        atomic_set(&group->fast_id, -1);
 
 	pfq_group_stats_reset(group->stats);
 	pfq_group_counters_reset(group->counters);
 
-	group->vlan_filt = false;
-
-	for(i = 0; i < 4096; i++) {
-		group->vid_filters[i] = 0;
-	}
-
 	group->enabled = true;
         printk(KERN_INFO "[PFQ] Group (%d) enabled.\n", gid);
 }
@@ -197,9 +225,13 @@ static void
 __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
 {
         struct sk_filter *filter;
+        struct bpf_prog *prog;
         struct pfq_lang_computation_tree *old_comp;
-        void *old_ctx;
-        size_t i;
+        void *old_ctx, *old_vlan, *old_ext;
+        void *old_table[Q_CLASS_TABLES];
+        int i;
+
+        atomic_set(&group->fast_id, -1);
 
         /* remove this gid from devmap matrix */
 
@@ -211,9 +243,18 @@ __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
         group->owner  = Q_INVALID_ID;
         group->policy = Q_POLICY_GROUP_UNDEFINED;
 
+        atomic_long_set(&group->bp_filter_key, 0L);
+        atomic_long_set(&group->bpf_prog_key,  0L);
+
         filter   = (struct sk_filter *)atomic_long_xchg(&group->bp_filter, 0L);
+        prog     = (struct bpf_prog *)atomic_long_xchg(&group->bpf_prog, 0L);
         old_comp = (struct pfq_lang_computation_tree *)atomic_long_xchg(&group->comp, 0L);
         old_ctx  = (void *)atomic_long_xchg(&group->comp_ctx, 0L);
+        old_vlan = (void *)atomic_long_xchg(&group->vlan_filters, 0L);
+        old_ext  = (void *)atomic_long_xchg(&group->sock_id_ext, 0L);
+
+        for(i = 0; i < Q_CLASS_TABLES; i++)
+                old_table[i] = (void *)atomic_long_xchg(&group->class_table[i], 0L);
 
         msleep(Q_GRACE_PERIOD);   /* sleeping is possible here: user-context */
 
@@ -229,15 +270,44 @@ __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
 	if (filter)
 		pfq_free_sk_filter(filter);
 
-        group->vlan_filt = false;
-	for(i = 0; i < 4096; i++) {
-		group->vid_filters[i] = 0;
-	}
+	if (prog)
+		pfq_put_bpf_prog(prog);
+
+	kfree(old_vlan);
+	kfree(old_ext);
+
+	for(i = 0; i < Q_CLASS_TABLES; i++)
+		kfree(old_table[i]);
 
         printk(KERN_INFO "[PFQ] Group (%d) disabled.\n", gid);
 }
 
 
+/* return the socket mask of a class (index), the classes not stored inline
+ * are allocated on first use (NULL on failure).
+ */
+
+static atomic_long_t *
+__pfq_group_sock_id(struct pfq_group *group, unsigned int class, bool alloc)
+{
+	atomic_long_t *ext;
+
+	if (class < Q_GROUP_INLINE_CLASSES)
+		return &group->sock_id[class];
+
+	ext = (atomic_long_t *)atomic_long_read(&group->sock_id_ext);
+	if (ext == NULL && alloc) {
+		ext = kzalloc(sizeof(atomic_long_t) * (Q_CLASS_MAX - Q_GROUP_INLINE_CLASSES), GFP_KERNEL);
+		if (ext == NULL)
+			return NULL;
+		smp_wmb();
+		atomic_long_set(&group->sock_id_ext, (long)ext);
+	}
+
+	return ext ? &ext[class - Q_GROUP_INLINE_CLASSES] : NULL;
+}
+
+
 static int
 __pfq_group_join(pfq_gid_t gid, pfq_id_t id, unsigned long class_mask, int policy)
 {
@@ -249,26 +319,38 @@ __pfq_group_join(pfq_gid_t gid, pfq_id_t id, unsigned long class_mask, int polic
         if (group == NULL)
                 return -EINVAL;
 
+	if (group->enabled && !pfq_group_policy_access(gid, id, policy)) {
+		pr_devel("[PFQ] join group gid=%d: permission denied with policy %d\n", gid, policy);
+		return -EACCES;
+	}
+
+	/* allocate the classes not stored inline first: on failure the group is left untouched */
+
+	if (policy != Q_POLICY_GROUP_UNDEFINED)
+	{
+		pfq_bitwise_foreach(class_mask, bit,
+		{
+			 if (__pfq_group_sock_id(group, pfq_ctz(bit), true) == NULL) {
+				 printk(KERN_WARNING "[PFQ|%d] join group gid=%d: class %u: out of memory!\n", id, gid, pfq_ctz(bit));
+				 return -ENOMEM;
+			 }
+		});
+	}
+
 	/* if this group is unused, initializes it */
 
         if (!group->enabled) {
                 __pfq_group_init(group, gid);
 	}
-	else {
-		if (!pfq_group_policy_access(gid, id, policy)) {
-			pr_devel("[PFQ] join group gid=%d: permission denied with policy %d\n", gid, policy);
-			return -EACCES;
-		}
-	}
 
 	if (policy != Q_POLICY_GROUP_UNDEFINED)
 	{
 		pfq_bitwise_foreach(class_mask, bit,
 		{
-			 unsigned int class = pfq_ctz(bit);
-			 tmp = atomic_long_read(&group->sock_id[class]);
+			 atomic_long_t *sock_id = __pfq_group_sock_id(group, pfq_ctz(bit), false);
+			 tmp = atomic_long_read(sock_id);
 			 tmp |= 1L << (__force int)id;
-			 atomic_long_set(&group->sock_id[class], tmp);
+			 atomic_long_set(sock_id, tmp);
 		});
 
 		if (group->owner == Q_INVALID_ID)
@@ -279,12 +361,14 @@ __pfq_group_join(pfq_gid_t gid, pfq_id_t id, unsigned long class_mask, int polic
 			group->policy = policy;
 	}
 
+	__pfq_group_fast_update(group);
+
 	pr_devel("[PFQ|%d] group %d, sock_ids { %lu %lu %lu %lu %lu...\n", id, gid,
-		 atomic_long_read(&group->sock_id[0]),
-		 atomic_long_read(&group->sock_id[1]),
-		 atomic_long_read(&group->sock_id[2]),
-		 atomic_long_read(&group->sock_id[3]),
-		 atomic_long_read(&group->sock_id[4]));
+		 pfq_group_sock_mask(group, 0),
+		 pfq_group_sock_mask(group, 1),
+		 pfq_group_sock_mask(group, 2),
+		 pfq_group_sock_mask(group, 3),
+		 pfq_group_sock_mask(group, 4));
 
         return 0;
 }
@@ -303,11 +387,16 @@ __pfq_group_leave(pfq_gid_t gid, pfq_id_t id)
 
         for(i = 0; i < Q_CLASS_MAX; ++i)
         {
-                tmp = atomic_long_read(&group->sock_id[i]);
+		atomic_long_t *sock_id = __pfq_group_sock_id(group, (unsigned int)i, false);
+		if (sock_id == NULL)
+			break;
+                tmp = atomic_long_read(sock_id);
                 tmp &= ~(1L << (__force int)id);
-                atomic_long_set(&group->sock_id[i], tmp);
+                atomic_long_set(sock_id, tmp);
         }
 
+	__pfq_group_fast_update(group);
+
 	if (group->enabled && __pfq_group_is_empty(gid))
 		__pfq_group_free(group, gid);
 
@@ -328,12 +417,118 @@ pfq_group_get_all_sock_mask(pfq_gid_t gid)
 
         for(i = 0; i < Q_CLASS_MAX; ++i)
         {
-                mask |= atomic_long_read(&group->sock_id[i]);
+                mask |= (long)pfq_group_sock_mask(group, (unsigned int)i);
         }
         return (unsigned long)mask;
 }
 
 
+/* shared keys: groups running the same bp filter, eBPF program or
+ * leading filters of a computation are given the same key, such that
+ * the result is evaluated once per packet (see pfq_group_shared).
+ * Keys are never reused, and are assigned with groups_lock held.
+ */
+
+static unsigned long pfq_shared_key;
+
+
+static unsigned long
+__pfq_group_filter_key(struct pfq_group *group, struct sk_filter *filter)
+{
+	int n;
+
+	if (!filter)
+		return 0;
+
+	for(n = 0; n < Q_MAX_GID; n++)
+	{
+		struct pfq_group *that = &global->groups[n];
+		struct sk_filter *f = (struct sk_filter *)atomic_long_read(&that->bp_filter);
+		unsigned long key = (unsigned long)atomic_long_read(&that->bp_filter_key);
+
+		if (that != group && f && key && pfq_sk_filter_equal(f, filter))
+			return key;
+	}
+
+	return ++pfq_shared_key;
+}
+
+
+static unsigned long
+__pfq_group_bpf_prog_key(struct pfq_group *group, struct bpf_prog *prog)
+{
+	int n;
+
+	if (!prog || !pfq_bpf_prog_pure(prog))
+		return 0;
+
+	for(n = 0; n < Q_MAX_GID; n++)
+	{
+		struct pfq_group *that = &global->groups[n];
+		struct bpf_prog *p = (struct bpf_prog *)atomic_long_read(&that->bpf_prog);
+		unsigned long key = (unsigned long)atomic_long_read(&that->bpf_prog_key);
+
+		if (that != group && p && key && pfq_bpf_prog_equal(p, prog))
+			return key;
+	}
+
+	return ++pfq_shared_key;
+}
+
+
+static bool
+__pfq_lang_prefix_equal(struct pfq_lang_computation_tree const *a, struct pfq_lang_computation_tree const *b, size_t len)
+{
+	struct pfq_lang_functional const *fa = &a->entry_point->fun;
+	struct pfq_lang_functional const *fb = &b->entry_point->fun;
+	size_t n;
+
+	if (a->prefix_len < len || b->prefix_len < len)
+		return false;
+
+	for(n = 0; n < len; n++, fa = fa->next, fb = fb->next)
+	{
+		size_t i;
+
+		if (fa->run != fb->run)
+			return false;
+
+		for(i = 0; i < sizeof(fa->arg)/sizeof(fa->arg[0]); i++)
+		{
+			if (fa->arg[i].value != fb->arg[i].value ||
+			    fa->arg[i].nelem != fb->arg[i].nelem)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+static void
+__pfq_group_prefix_keys(struct pfq_group *group, struct pfq_lang_computation_tree *comp)
+{
+	size_t len;
+
+	for(len = 1; len <= comp->prefix_len; len++)
+	{
+		unsigned long key = 0;
+		int n;
+
+		for(n = 0; n < Q_MAX_GID && !key; n++)
+		{
+			struct pfq_group *that = &global->groups[n];
+			struct pfq_lang_computation_tree *c = (struct pfq_lang_computation_tree *)atomic_long_read(&that->comp);
+
+			if (that != group && c && __pfq_lang_prefix_equal(c, comp, len))
+				key = c->prefix_key[len-1];
+		}
+
+		comp->prefix_key[len-1] = key ? key : ++pfq_shared_key;
+	}
+}
+
+
 void
 pfq_group_set_filter(pfq_gid_t gid, struct sk_filter *filter)
 {
@@ -346,15 +541,98 @@ pfq_group_set_filter(pfq_gid_t gid, struct sk_filter *filter)
                 return;
         }
 
+        mutex_lock(&global->groups_lock);
+
+	/* stop sharing the result before replacing the filter */
+
+        atomic_long_set(&group->bp_filter_key, 0L);
         old_filter = (void *)atomic_long_xchg(&group->bp_filter, (long)filter);
 
+        __pfq_group_fast_update(group);
+
         msleep(Q_GRACE_PERIOD);
 
+        atomic_long_set(&group->bp_filter_key, (long)__pfq_group_filter_key(group, filter));
+
+        mutex_unlock(&global->groups_lock);
+
 	if (old_filter)
 		pfq_free_sk_filter(old_filter);
 }
 
 
+void
+pfq_group_set_bpf_prog(pfq_gid_t gid, struct bpf_prog *prog)
+{
+        struct pfq_group * group;
+        struct bpf_prog * old_prog;
+
+	group = pfq_group_get(gid);
+        if (group == NULL) {
+		if (prog)
+			pfq_put_bpf_prog(prog);
+                return;
+        }
+
+        mutex_lock(&global->groups_lock);
+
+        atomic_long_set(&group->bpf_prog_key, 0L);
+        old_prog = (void *)atomic_long_xchg(&group->bpf_prog, (long)prog);
+
+        __pfq_group_fast_update(group);
+
+        msleep(Q_GRACE_PERIOD);
+
+        atomic_long_set(&group->bpf_prog_key, (long)__pfq_group_bpf_prog_key(group, prog));
+
+        mutex_unlock(&global->groups_lock);
+
+	if (old_prog)
+		pfq_put_bpf_prog(old_prog);
+}
+
+
+/* update the class table: the table is allocated on first use */
+
+int
+pfq_group_set_class_table(pfq_gid_t gid, int table, uint64_t key, int class_id)
+{
+        struct pfq_group * group;
+        struct pfq_class_table *t;
+        int ret = 0;
+
+	group = pfq_group_get(gid);
+        if (group == NULL || table < 0 || table >= Q_CLASS_TABLES)
+                return -EINVAL;
+
+        mutex_lock(&global->groups_lock);
+
+        t = (struct pfq_class_table *)atomic_long_read(&group->class_table[table]);
+        if (t == NULL) {
+                if (class_id < 0)
+                        goto out;
+
+                t = pfq_class_table_alloc();
+                if (t == NULL) {
+                        ret = -ENOMEM;
+                        goto out;
+                }
+                smp_wmb();
+                atomic_long_set(&group->class_table[table], (long)t);
+        }
+
+        if (class_id == Q_CLASS_TABLE_RESET)
+                pfq_class_table_reset(t);
+        else if (class_id == Q_CLASS_TABLE_DEL)
+                pfq_class_table_del(t, key);
+        else
+                ret = pfq_class_table_set(t, key, class_id);
+out:
+        mutex_unlock(&global->groups_lock);
+        return ret;
+}
+
+
 int
 pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *comp, void *ctx)
 {
@@ -368,9 +646,16 @@ pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *comp, void *
 
         mutex_lock(&global->groups_lock);
 
+	/* the keys are part of the computation, published along with it */
+
+	if (comp)
+		__pfq_group_prefix_keys(group, comp);
+
         old_comp = (struct pfq_lang_computation_tree *)atomic_long_xchg(&group->comp, (long)comp);
         old_ctx  = (void *)atomic_long_xchg(&group->comp_ctx, (long)ctx);
 
+        __pfq_group_fast_update(group);
+
         msleep(Q_GRACE_PERIOD);   /* sleeping is possible here: user-context */
 
 	/* call fini on old computation */
@@ -418,9 +703,9 @@ pfq_group_join_free(pfq_id_t id, unsigned long class_mask, int policy)
 		pfq_gid_t gid = (__force pfq_gid_t)n;
 
                 if(!pfq_group_get(gid)->enabled) {
-                        __pfq_group_join(gid, id, class_mask, policy);
+                        int rc = __pfq_group_join(gid, id, class_mask, policy);
                         mutex_unlock(&global->groups_lock);
-                        return n;
+                        return rc < 0 ? rc : n;
                 }
         }
         mutex_unlock(&global->groups_lock);
@@ -499,7 +784,7 @@ pfq_group_vlan_filters_enabled(pfq_gid_t gid)
         group = pfq_group_get(gid);
         if (group == NULL)
 		return false;
-        return group->vlan_filt;
+        return atomic_long_read(&group->vlan_filters) != 0;
 }
 
 
@@ -507,12 +792,14 @@ bool
 pfq_group_check_vlan_filter(pfq_gid_t gid, int vid)
 {
         struct pfq_group *group;
+        unsigned long *filters;
 
         group= pfq_group_get(gid);
         if (group == NULL)
                 return false;
 
-        return group->vid_filters[vid & 4095];
+        filters = (unsigned long *)atomic_long_read(&group->vlan_filters);
+        return filters && test_bit(vid & 4095, filters);
 }
 
 
@@ -520,17 +807,31 @@ bool
 pfq_group_toggle_vlan_filters(pfq_gid_t gid, bool value)
 {
         struct pfq_group *group;
+        unsigned long *filters;
 
         group = pfq_group_get(gid);
         if (group == NULL)
                 return false;
 
-        if (value)
-                memset(group->vid_filters, 0, 4096);
+        /* the bitmap is allocated only while vlan filtering is enabled */
+
+        if (value) {
+                filters = kzalloc(Q_GROUP_VLAN_BITMAP_SIZE, GFP_KERNEL);
+                if (filters == NULL)
+                        return false;
+                smp_wmb();
+        }
+        else
+                filters = NULL;
 
-        smp_wmb();
+        filters = (unsigned long *)atomic_long_xchg(&group->vlan_filters, (long)filters);
 
-        group->vlan_filt = value;
+        __pfq_group_fast_update(group);
+
+        if (filters) {
+                msleep(Q_GRACE_PERIOD);
+                kfree(filters);
+        }
         return true;
 }
 
@@ -539,11 +840,18 @@ void
 pfq_group_set_vlan_filter(pfq_gid_t gid, bool value, int vid)
 {
         struct pfq_group *group;
+        unsigned long *filters;
 
         group = pfq_group_get(gid);
         if (group == NULL)
                 return;
 
-        group->vid_filters[vid & 4095] = value;
-}
+        filters = (unsigned long *)atomic_long_read(&group->vlan_filters);
+        if (filters == NULL)
+                return;
 
+        if (value)
+                set_bit(vid & 4095, filters);
+        else
+                clear_bit(vid & 4095, filters);
+}
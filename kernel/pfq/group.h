@@ -36,32 +36,126 @@
 typedef struct pfq_kernel_stats pfq_group_stats_t;
 struct pfq_group_counters;
 
+/* classes whose socket masks are stored inline in the group (default, user
+ * plane, control plane...): the others are allocated on first join.
+ */
+
+#define Q_GROUP_INLINE_CLASSES		4
+
+#define Q_GROUP_VLAN_BITMAP_SIZE	(4096/8)
+
+
+/* the per-packet state of a group fits a single cacheline (but the socket
+ * mask of the last inline class), the configuration and the classes not in
+ * use are kept apart.
+ */
+
 struct pfq_group
 {
-        int policy;                                     /* group policy */
-        int pid;	                                /* process id/tgid */
+	/* hot: read for each packet */
 
-	pfq_id_t owner;					/* owner's pfq id */
+	pfq_group_stats_t __percpu *stats;
 
-        atomic_long_t sock_id[Q_CLASS_MAX];		/* list of (bitwise) socket ids that joined this group, for each different class:
+        atomic_long_t bp_filter;			/* struct sk_filter pointer */
+        atomic_long_t bpf_prog;				/* struct bpf_prog pointer (eBPF program, from fd) */
+        atomic_long_t vlan_filters;			/* unsigned long *: bitmap of vlan ids, NULL if vlan filtering is disabled */
+        atomic_long_t comp;                             /* struct pfq_lang_computation_tree *  (new functional program) */
+
+        atomic_long_t sock_id[Q_GROUP_INLINE_CLASSES];	/* (bitwise) socket ids that joined this group, for each class:
         						   Q_CLASS_DEFAULT, Q_CLASS_USER_PLANE, Q_CLASS_CONTROL_PLANE etc... */
 
-        atomic_long_t bp_filter;			/* struct sk_filter pointer */
+	/* warm: read by computations, and by filters when installed */
 
-        atomic_long_t comp;                             /* struct pfq_lang_computation_tree *  (new functional program) */
-        atomic_long_t comp_ctx;                         /* void *: storage context (new functional program) */
+        atomic_long_t bp_filter_key;			/* shared key of the bp filter, 0 if not shared (see pfq_group_shared) */
+        atomic_long_t bpf_prog_key;			/* shared key of the eBPF program, 0 if not shared */
 
-	pfq_group_stats_t __percpu *stats;
 	struct pfq_group_counters __percpu *counters;
+        atomic_long_t comp_ctx;                         /* void *: storage context (new functional program) */
+        atomic_long_t sock_id_ext;                      /* atomic_long_t *: socket ids of the classes >= Q_GROUP_INLINE_CLASSES, indexed from it */
+        atomic_long_t class_table[Q_CLASS_TABLES];	/* struct pfq_class_table *: allocated on first update */
+
+        atomic_t fast_id;                               /* socket id for the plain capture fast path, -1 if not eligible */
+
+	/* cold: configuration */
+
+        int policy;                                     /* group policy */
+        int pid;	                                /* process id/tgid */
+
+	pfq_id_t owner;					/* owner's pfq id */
 
         bool   enabled;
-        bool   vlan_filt;                               /* enable/disable vlan filtering */
-        char   vid_filters[4096];                       /* vlan filters */
 
+} ____pfq_cacheline_aligned;
+
+
+/* return the sockets of the group that joined the given class (index) */
+
+static inline
+unsigned long pfq_group_sock_mask(struct pfq_group const *group, unsigned int class)
+{
+	atomic_long_t *ext;
+
+	if (likely(class < Q_GROUP_INLINE_CLASSES))
+		return (unsigned long)atomic_long_read(&group->sock_id[class]);
+
+	ext = (atomic_long_t *)atomic_long_read(&group->sock_id_ext);
+	return ext ? (unsigned long)atomic_long_read(&ext[class - Q_GROUP_INLINE_CLASSES]) : 0;
+}
+
+
+/* per-packet results shared among the groups bound to the same device queue:
+ * identical bp filters, eBPF programs (without maps) and leading filters of the computations
+ * are given the same key when installed, and evaluated once per packet.
+ */
+
+#define Q_GROUP_SHARED_MAX		16
+
+struct pfq_group_shared
+{
+	unsigned long	key[Q_GROUP_SHARED_MAX];
+	unsigned long	pass;				/* bitmask: result of key[n] */
+	unsigned int	len;
 };
 
 
+static inline
+void pfq_group_shared_reset(struct pfq_group_shared *sh)
+{
+	sh->len = 0;
+}
+
+/* return 1 (pass), 0 (drop) or -1 if the key has not been evaluated yet */
+
+static inline
+int pfq_group_shared_lookup(struct pfq_group_shared const *sh, unsigned long key)
+{
+	unsigned int n;
+
+	for(n = 0; n < sh->len; n++)
+	{
+		if (sh->key[n] == key)
+			return (sh->pass >> n) & 1;
+	}
+	return -1;
+}
+
+static inline
+void pfq_group_shared_store(struct pfq_group_shared *sh, unsigned long key, bool pass)
+{
+	if (!key || sh->len == Q_GROUP_SHARED_MAX)
+		return;
+
+	if (pass)
+		sh->pass |= 1UL << sh->len;
+	else
+		sh->pass &= ~(1UL << sh->len);
+
+	sh->key[sh->len++] = key;
+}
+
+
 struct pfq_lang_computation_tree;
+struct bpf_prog;
 
 extern int  pfq_group_join_free(pfq_id_t id, unsigned long class_mask, int policy);
 extern int  pfq_group_join(pfq_gid_t gid, pfq_id_t id, unsigned long class_mask, int policy);
@@ -74,6 +168,8 @@ extern unsigned long pfq_group_get_all_sock_mask(pfq_gid_t gid);
 
 extern int  pfq_group_get_context(pfq_gid_t gid, int level, int size, void __user *context);
 extern void pfq_group_set_filter(pfq_gid_t gid, struct sk_filter *filter);
+extern void pfq_group_set_bpf_prog(pfq_gid_t gid, struct bpf_prog *prog);
+extern int  pfq_group_set_class_table(pfq_gid_t gid, int table, uint64_t key, int class_id);
 
 extern struct pfq_group * pfq_group_get(pfq_gid_t gid);
 
@@ -35,6 +35,7 @@
 #include <pfq/devmap.h>
 #include <pfq/global.h>
 #include <pfq/io.h>
+#include <pfq/kcompat.h>
 #include <pfq/memory.h>
 #include <pfq/netdev.h>
 #include <pfq/percpu.h>
@@ -46,6 +47,12 @@
 #include <pfq/thread.h>
 #include <pfq/vlan.h>
 
+#include <linux/version.h>
+#include <linux/timex.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)
+#include <linux/sched/clock.h>
+#endif
+
 
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(3,13,0))
 static uint16_t __pfq_pick_tx_default(struct net_device *dev, struct sk_buff *skb)
@@ -163,53 +170,52 @@ ktime_t wait_until(uint64_t tv64, ktime_t now, struct pfq_dev_queue *dev_queue,
 #endif
 
 
-static inline
-ptrdiff_t acquire_sk_tx_prod_off_by(int index, struct pfq_shared_tx_queue *tx_queue)
+/* check whether a socket queue has packets to transmit */
+
+bool
+pfq_sk_queue_xmit_pending(struct pfq_sock *so, int sock_queue)
 {
-	return __atomic_load_n((index & 1) ? &tx_queue->prod.off1 : &tx_queue->prod.off0, __ATOMIC_ACQUIRE);
+	struct pfq_shared_tx_queue *tx_queue = pfq_sock_tx_shared_queue(so, sock_queue);
+
+	if (unlikely(tx_queue == NULL))
+		return false;
+
+	return __atomic_load_n(&tx_queue->prod.head, __ATOMIC_ACQUIRE) != tx_queue->cons.tail;
 }
 
 
-static inline
-ptrdiff_t maybe_swap_sk_tx_queue(struct pfq_shared_tx_queue *tx_queue, unsigned int *cons_idx_ret)
+/* ask the producer of a socket queue to ring the doorbell (async queues) */
+
+void
+pfq_sk_queue_need_wakeup(struct pfq_sock *so, int sock_queue, unsigned int value)
 {
-	unsigned int prod_idx = __atomic_load_n(&tx_queue->prod.index, __ATOMIC_ACQUIRE);
-	unsigned int cons_idx = __atomic_load_n(&tx_queue->cons.index, __ATOMIC_RELAXED);
+	struct pfq_shared_tx_queue *tx_queue = pfq_sock_tx_shared_queue(so, sock_queue);
 
-	ptrdiff_t prod_off = acquire_sk_tx_prod_off_by(cons_idx, tx_queue);
+	if (likely(tx_queue != NULL))
+		__atomic_store_n(&tx_queue->cons.need_wakeup, value, __ATOMIC_RELAXED);
+}
 
-	if (prod_idx != cons_idx && tx_queue->cons.off == prod_off) /* swap this queue */
-	{
-		__atomic_store_n(&tx_queue->cons.index, prod_idx, __ATOMIC_RELAXED);
-		tx_queue->cons.off = 0;
-		*cons_idx_ret = prod_idx;
-		return acquire_sk_tx_prod_off_by(prod_idx, tx_queue);
-	}
-	else
-	{
-		*cons_idx_ret = cons_idx;
-	}
 
-	return prod_off;
+static inline
+unsigned int dev_tx_max_skb_copies(struct net_device *dev)
+{
+	return (dev->priv_flags & IFF_TX_SKB_SHARING) ? Q_MAX_TX_SKB_COPY : 1;
 }
 
 
 static inline
-unsigned int dev_tx_max_skb_copies(struct net_device *dev, unsigned int req_copies)
+unsigned int pfq_tx_skb_copies(struct net_device *dev, unsigned int req_copies, unsigned int max_copies)
 {
-	if (likely(req_copies == 1 || req_copies == 0))
+	if (likely(req_copies <= 1))
 		return 1;
 
-	if (unlikely(!(dev->priv_flags & IFF_TX_SKB_SHARING))) {
-		if (printk_ratelimit())
+	if (unlikely(req_copies > max_copies)) {
+		if (max_copies == 1 && printk_ratelimit())
 			printk(KERN_INFO "[PFQ] tx_skb_copies: device '%s' does not support TX_SKB_SHARING!\n",
 			       dev->name);
-		return 1;
+		return max_copies;
 	}
 
-	if (unlikely(req_copies > Q_MAX_TX_SKB_COPY))
-		return Q_MAX_TX_SKB_COPY;
-
 	return req_copies;
 }
 
@@ -272,38 +278,21 @@ pfq_xmit(struct qbuff *buff, struct net_device *dev, int queue, int more)
 
 
 /*
- * transmit a buff with copies
+ * transmit a buff with copies, by means of an skb prepared in bulk
  */
 
 static tx_response_t
-__pfq_slot_xmit(const void *buf,
+__pfq_slot_xmit(struct sk_buff *skb,
+		const void *buf,
 		size_t len,
 		struct pfq_dev_queue *dev_queue,
 		struct pfq_xmit_context *ctx)
 {
-	struct sk_buff *skb;
         tx_response_t rc = { 0 };
 
-	if (unlikely(!dev_queue->dev))
-		return (tx_response_t){.ok = 0, .fail = ctx->copies};
-
-	/* allocate a new socket buffer */
-
-	skb = pfq_alloc_skb_pool( len + LL_RESERVED_SPACE(dev_queue->dev)
-				, GFP_KERNEL
-				, ctx->node
-				, 1
-				, ctx->tx);
-
-	if (unlikely(skb == NULL)) {
-		if (printk_ratelimit())
-			printk(KERN_INFO "[PFQ] Tx could not allocate an skb!\n");
-		return (tx_response_t){.ok = 0, .fail = ctx->copies};
-	}
-
 	/* fill the socket buffer */
 
-	skb_reserve(skb, LL_RESERVED_SPACE(dev_queue->dev));
+	skb_reserve(skb, ctx->reserved);
 	skb_reset_tail_pointer(skb);
 
 	skb->dev = dev_queue->dev;
@@ -314,7 +303,7 @@ __pfq_slot_xmit(const void *buf,
 	/* set the Tx queue */
 
 	skb_set_queue_mapping(skb, dev_queue->mapping);
-	skb_store_bits(skb, 0, buf, len);
+	skb_copy_to_linear_data(skb, buf, len);
 
 	/* transmit the packet + copies */
 
@@ -336,14 +325,227 @@ __pfq_slot_xmit(const void *buf,
 	/* release the packet */
 
 	pfq_free_skb_pool(skb, ctx->tx);
+	return rc;
+}
 
-	if (rc.ok)
-	     dev_queue->queue->trans_start = ctx->jiffies;
+
+/*
+ * transmit a slot of the shared queue without copying the payload:
+ * the skb references the slot memory as frags marked SKBTX_DEV_ZEROCOPY,
+ * and the slot is released by the ubuf_info callback, when the frags are
+ * no longer referenced. The skb destructor is not suitable: it runs as soon
+ * as the skb is orphaned (veth, tun, bridge...), possibly while the frags
+ * are still in use. Paths that need to keep the skb copy the frags first
+ * (skb_orphan_frags), and then release the slot.
+ */
+
+static inline void
+pfq_tx_zcopy_slot_release(struct pfq_tx_zcopy_slot *zslot)
+{
+	struct pfq_sock *fwd_sock = zslot->fwd_sock;
+
+	if (fwd_sock) {
+		__atomic_fetch_sub(zslot->fwd_pending, 1, __ATOMIC_RELEASE);
+		atomic_dec(&fwd_sock->tx_zcopy_inflight);
+	}
+
+	/* the Tx slot (and this descriptor) can be reused from now on */
+
+	__atomic_store_n(zslot->busy, 0, __ATOMIC_RELEASE);
+}
+
+
+static void
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(3,14,0))
+pfq_tx_zcopy_complete(struct ubuf_info *ubuf)
+#else
+pfq_tx_zcopy_complete(struct ubuf_info *ubuf, bool zerocopy)
+#endif
+{
+	struct pfq_tx_zcopy_slot *zslot = container_of(ubuf, struct pfq_tx_zcopy_slot, ubuf);
+	struct pfq_sock *so = zslot->sock;
+
+	pfq_tx_zcopy_slot_release(zslot);
+	atomic_dec(&so->tx_zcopy_inflight);
+}
+
+
+static inline bool
+pfq_dev_tx_zcopy(struct net_device const *dev)
+{
+	return dev->features & NETIF_F_SG;
+}
+
+
+static tx_response_t
+__pfq_slot_xmit_zcopy(struct pfq_sock *so,
+		      struct pfq_tx_zcopy_slot *zslot,
+		      const void *buf,
+		      size_t len,
+		      struct pfq_dev_queue *dev_queue,
+		      struct pfq_xmit_context *ctx)
+{
+	const char *data = buf;
+	struct sk_buff *skb;
+        tx_response_t rc = { 0 };
+	size_t hlen;
+	int nr_frags = 0;
+
+	/* the link-layer header is copied into the linear part of the skb */
+
+	hlen = min_t(size_t, len, dev_queue->dev->hard_header_len);
+
+	skb = __alloc_skb(hlen + ctx->reserved, GFP_ATOMIC, 0, ctx->node);
+	if (unlikely(skb == NULL)) {
+		if (printk_ratelimit())
+			printk(KERN_INFO "[PFQ] Tx could not allocate an skb!\n");
+		pfq_tx_zcopy_slot_release(zslot);
+		return (tx_response_t){.ok = 0, .fail = ctx->copies};
+	}
+
+	skb_reserve(skb, ctx->reserved);
+	skb_reset_tail_pointer(skb);
+
+	skb->dev = dev_queue->dev;
+	skb_set_queue_mapping(skb, dev_queue->mapping);
+
+	__skb_put(skb, hlen);
+	skb_copy_to_linear_data(skb, data, hlen);
+
+	/* the payload is attached as page fragments of the shared memory */
+
+	for(data += hlen, len -= hlen; len > 0; nr_frags++)
+	{
+		struct page *page;
+		size_t off, chunk;
+
+		if (unlikely(nr_frags == MAX_SKB_FRAGS)) {
+			if (printk_ratelimit())
+				printk(KERN_INFO "[PFQ] Tx zero-copy: too many fragments!\n");
+			kfree_skb(skb);
+			pfq_tx_zcopy_slot_release(zslot);
+			return (tx_response_t){.ok = 0, .fail = ctx->copies};
+		}
+
+		page  = pfq_shared_memory_page(data);
+		off   = offset_in_page(data);
+		chunk = min_t(size_t, len, PAGE_SIZE - off);
+
+		get_page(page);
+		skb_fill_page_desc(skb, nr_frags, page, off, chunk);
+
+		skb->len      += chunk;
+		skb->data_len += chunk;
+		skb->truesize += chunk;
+
+		data += chunk;
+		len  -= chunk;
+	}
+
+	/* the slot stays busy until the frags are released */
+
+	zslot->sock = so;
+	zslot->ubuf.callback = pfq_tx_zcopy_complete;
+	zslot->ubuf.ctx = NULL;
+	zslot->ubuf.desc = 0;
+
+	skb_shinfo(skb)->destructor_arg = &zslot->ubuf;
+	skb_shinfo(skb)->tx_flags |= SKBTX_DEV_ZEROCOPY;
+
+	atomic_inc(&so->tx_zcopy_inflight);
+
+	/* transmit the packet + copies: the last reference is held by the driver */
+
+	atomic_set(&skb->users, ctx->copies);
+
+	do {
+		const bool xmit_more_ = ctx->xmit_more || ctx->copies != 1;
+
+		if (__pfq_xmit(skb, dev_queue->dev, xmit_more_, global->tx_retry) == NETDEV_TX_OK)
+			rc.ok++;
+		else
+			rc.fail++;
+
+		ctx->copies--;
+	}
+	while (ctx->copies > 0);
 
 	return rc;
 }
 
 
+/* completion descriptor of a Tx slot */
+
+static inline struct pfq_tx_zcopy_slot *
+pfq_tx_zcopy_slot(struct pfq_sock *so, int sock_queue, ptrdiff_t off)
+{
+	return &so->tx_zcopy_slots[(size_t)(1 + sock_queue) * pfq_spsc_queue_len(so) + (size_t)off / so->tx_slot_size];
+}
+
+
+/*
+ * resolve the Rx slot referenced by a forward descriptor: the Rx socket must
+ * belong to the same user and is held (along with its half) until the Tx slot
+ * is released. Return the kernel address of the packet.
+ *
+ * The caplen is the copy taken by the caller: the header of the Tx slot is
+ * writable by the user and must not be read again here.
+ *
+ * On failure the half pinned by pfq_forward is given back, whenever the
+ * descriptor references a valid half of a queue owned by the same user.
+ */
+
+static const void *
+pfq_tx_fwd_resolve(struct pfq_sock *so, struct pfq_pkthdr *hdr, size_t caplen, struct pfq_tx_zcopy_slot *zslot)
+{
+	struct pfq_fwd_descr descr = *(struct pfq_fwd_descr *)(hdr+1);
+	struct pfq_shared_queue *rx_queue;
+	struct pfq_sock *rx;
+	size_t rx_size, half;
+	uint64_t off;
+
+	rx = pfq_sock_get_by_id((__force pfq_id_t)descr.id);
+	if (unlikely(rx == NULL))
+		return NULL;
+
+	if (unlikely(!uid_eq(sock_i_uid(&rx->sk), sock_i_uid(&so->sk))))
+		return NULL;
+
+	/* hold the shared memory of the Rx socket, then ensure it is enabled */
+
+	atomic_inc(&rx->tx_zcopy_inflight);
+
+	rx_queue = pfq_sock_shared_queue(rx);
+	if (unlikely(rx_queue == NULL))
+		goto err;
+
+	/* the packet must lie in a half of the Rx queue */
+
+	rx_size = pfq_mpsc_queue_mem(rx) / 2;
+
+	if (unlikely(descr.off < sizeof(struct pfq_shared_queue)))
+		goto err;
+
+	off = descr.off - sizeof(struct pfq_shared_queue);
+	if (unlikely(off >= rx_size * 2))
+		goto err;
+
+	half = off / rx_size;
+	if (unlikely(off + caplen > (half + 1) * rx_size))
+		goto err_half;
+
+	zslot->fwd_sock    = rx;
+	zslot->fwd_pending = &rx_queue->rx.fwd_pending[half];
+
+	return (const char *)rx_queue + descr.off;
+err_half:
+	__atomic_fetch_sub(&rx_queue->rx.fwd_pending[half], 1, __ATOMIC_RELEASE);
+err:
+	atomic_dec(&rx->tx_zcopy_inflight);
+	return NULL;
+}
+
+
 /*
  * transmit packets from a socket queue..
  */
@@ -357,12 +559,16 @@ pfq_sk_queue_xmit( struct pfq_sock *so
 	struct pfq_dev_queue dev_queue = {.dev = NULL, .queue = NULL, .mapping = 0};
 	struct pfq_xmit_context ctx;
 	struct pfq_percpu_pool *pool;
-	int batch_cntr = 0, cons_idx;
+	struct sk_buff *skbs[Q_TX_SKB_BULK];
+	size_t skb_idx = 0, skb_num = 0;
+	size_t max_len, skb_size;
+	size_t head, tail, n;
+	int batch_cntr = 0;
 	struct pfq_shared_tx_queue *tx_queue;
 	struct pfq_pkthdr *hdr;
-	ptrdiff_t prod_off;
-        char *begin, *end;
-        void *tx_queue_mem;
+	ptrdiff_t off, size;
+	bool zcopy;
+        char *tx_queue_mem;
         tx_response_t rc = {0};
 
 	/* get the Tx queue descriptor */
@@ -374,6 +580,27 @@ pfq_sk_queue_xmit( struct pfq_sock *so
 	tx_queue_mem = pfq_sock_tx_queue_mem(so,sock_queue);
 	BUG_ON(tx_queue_mem == NULL);
 
+	/* the slots produced so far: the producer never waits for this consumer */
+
+	head = __atomic_load_n(&tx_queue->prod.head, __ATOMIC_ACQUIRE);
+	tail = tx_queue->cons.tail;
+	off  = tx_queue->cons.off;
+	size = (ptrdiff_t)pfq_spsc_queue_mem(so);
+
+	if (unlikely(off < 0 || off >= size))
+		off = 0;
+
+	if (head == tail)
+		return rc;
+
+	/* the producer index is user memory: more slots than the ring holds means corruption */
+
+	if (unlikely(head - tail > pfq_spsc_queue_len(so))) {
+		if (printk_ratelimit())
+			printk(KERN_INFO "[PFQ|%d] sk_queue_xmit: bad producer index (head:%zu tail:%zu)!\n", so->id, head, tail);
+		__atomic_store_n(&tx_queue->cons.tail, head, __ATOMIC_RELEASE);
+		return rc;
+	}
 
 	/* enable skb_pool for Tx threads */
 
@@ -389,12 +616,6 @@ pfq_sk_queue_xmit( struct pfq_sock *so
 		cpu = smp_processor_id();
 	}
 
-	/* initialize the boundaries of this queue */
-
-	prod_off = maybe_swap_sk_tx_queue(tx_queue, &cons_idx);
-	begin    = tx_queue_mem + (cons_idx & 1) * tx_queue->size + tx_queue->cons.off;
-	end      = tx_queue_mem + (cons_idx & 1) * tx_queue->size + prod_off;
-
         /* setup the context */
 
         ctx.net	    = sock_net(&so->sk);
@@ -415,82 +636,183 @@ pfq_sk_queue_xmit( struct pfq_sock *so
 
 	/* prefetch packets... */
 
-	hdr  = (struct pfq_pkthdr *)begin;
+	hdr  = (struct pfq_pkthdr *)(tx_queue_mem + off);
         prefetch_r3(hdr);
         prefetch_r3((char *)hdr+64);
 
+	/* validate the device once per burst: packets are dropped when it is down */
+
+	if (unlikely(!netif_running(dev_queue.dev) || !netif_carrier_ok(dev_queue.dev))) {
+		pfq_dev_queue_put(&dev_queue);
+		local_bh_enable();
+		spin_unlock(&pool->tx_lock);
+		goto drop;
+	}
+
+	ctx.max_copies = dev_tx_max_skb_copies(dev_queue.dev);
+	ctx.reserved   = LL_RESERVED_SPACE(dev_queue.dev);
+
+	zcopy    = so->tx_zcopy && pfq_dev_tx_zcopy(dev_queue.dev);
+	max_len  = so->tx_slot_size - sizeof(struct pfq_pkthdr) - (zcopy ? 0 : ctx.reserved);
+	skb_size = so->tx_slot_size - sizeof(struct pfq_pkthdr);
+
 	/* disable bottom half and lock the queue */
 
 	HARD_TX_LOCK(dev_queue.dev, dev_queue.queue, cpu);
 
-	for_each_sk_slot(hdr, end, so->tx_slot_size)
+	for(n = head - tail; n > 0; n--)
 	{
+		struct pfq_tx_zcopy_slot *zslot;
 		struct pfq_pkthdr *next;
-                tx_response_t tmp = {0};
+		const void *buf;
+		size_t caplen, len;
+
+		off += (ptrdiff_t)so->tx_slot_size;
+		if (off >= size)
+			off = 0;
 
-		next = PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, so->tx_slot_size);
+		next = (struct pfq_pkthdr *)(tx_queue_mem + off);
 		prefetch_r3(next);
 		prefetch_r3((char *)next+64);
 
-		/* because of dynamic slot size, ensure the caplen is not set to 0 */
+		/* get the number of copies to transmit */
+
+                ctx.copies = pfq_tx_skb_copies(dev_queue.dev, hdr->info.data.copies, ctx.max_copies);
+		batch_cntr += ctx.copies;
+
+                /* set the xmit_more bit */
+
+		ctx.xmit_more = batch_cntr < global->xmit_batch_len ? n > 1 : (batch_cntr = 0, false);
 
-		if (unlikely(!hdr->caplen)) {
+		/* transmit this packet */
+
+		/* the caplen is read once: the slot is writable by the user */
+
+		caplen = READ_ONCE(hdr->caplen);
+
+		buf = hdr+1;
+		len = min_t(size_t, caplen, max_len);
+
+		zslot = pfq_tx_zcopy_slot(so, sock_queue, (char *)hdr - tx_queue_mem);
+		zslot->busy = &hdr->info.commit;
+		zslot->fwd_sock = NULL;
+
+		if (unlikely(hdr->info.flags & Q_PKTHDR_TX_FWD)) {
+
+			/* forward: the payload is an Rx slot of a socket */
+
+			buf = pfq_tx_fwd_resolve(so, hdr, caplen, zslot);
+			if (unlikely(buf == NULL)) {
+				if (printk_ratelimit())
+					printk(KERN_INFO "[PFQ|%d] Tx forward: bad descriptor!\n", so->id);
+				__atomic_store_n(&hdr->info.commit, 0, __ATOMIC_RELEASE);
+				rc.fail += ctx.copies;
+				hdr = next;
+				continue;
+			}
+
+			len = caplen;
+		}
+
+		/* because of dynamic slot size, ensure the caplen is neither 0 nor beyond the slot */
+
+		if (unlikely(!caplen || (zslot->fwd_sock == NULL && caplen > skb_size))) {
 			if (printk_ratelimit()) {
-				printk(KERN_INFO "[PFQ] sk_queue_xmit: zero caplen! len:%u queue:%u commit:%u copies:%u\n"
+				printk(KERN_INFO "[PFQ] sk_queue_xmit: bad caplen:%zu! len:%u queue:%u commit:%u copies:%u\n"
+						      , caplen
 						      , hdr->len
 						      , hdr->info.queue
 						      , hdr->info.commit
 						      , hdr->info.data.copies);
 			}
 
-			break;
+			pfq_tx_zcopy_slot_release(zslot);
+			rc.fail += ctx.copies;
+			hdr = next;
+			continue;
 		}
 
-		/* get the number of copies to transmit */
-
-                ctx.copies = dev_tx_max_skb_copies(dev_queue.dev, hdr->info.data.copies);
-		batch_cntr += ctx.copies;
+		if (zcopy || (zslot->fwd_sock && pfq_dev_tx_zcopy(dev_queue.dev))) {
+			/* the slot is released once the frags of the skb are no longer referenced */
+			tx_response_t tmp = __pfq_slot_xmit_zcopy(so, zslot, buf, len, &dev_queue, &ctx);
+			rc.value += tmp.value;
+			hdr = next;
+			continue;
+		}
 
-                /* set the xmit_more bit */
+		/* prepare the skbs in bulk from the pool */
 
-		ctx.xmit_more = batch_cntr < global->xmit_batch_len ?
-				PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, so->tx_slot_size) < (struct pfq_pkthdr *)end : (batch_cntr = 0, false);
+		if (skb_idx == skb_num) {
+			skb_idx = 0;
+			skb_num = pfq_alloc_skb_pool_bulk(skb_size, GFP_ATOMIC, ctx.node, 1, ctx.tx, skbs, Q_TX_SKB_BULK);
+		}
 
-		/* transmit this packet */
+		if (likely(skb_idx < skb_num)) {
+			tx_response_t tmp = __pfq_slot_xmit(skbs[skb_idx++], buf, min_t(size_t, len, skb_size - ctx.reserved), &dev_queue, &ctx);
+			rc.value += tmp.value;
+		}
+		else {
+			if (printk_ratelimit())
+				printk(KERN_INFO "[PFQ] Tx could not allocate an skb!\n");
+			rc.fail += ctx.copies;
+		}
 
-		if (likely(netif_running(dev_queue.dev) && netif_carrier_ok(dev_queue.dev))) {
+		/* the payload has been copied: release the slot */
 
-			size_t len = min_t( size_t
-					  , hdr->caplen
-					  , so->tx_slot_size - sizeof(struct pfq_pkthdr) - LL_RESERVED_SPACE(dev_queue.dev));
+		pfq_tx_zcopy_slot_release(zslot);
+		hdr = next;
+	}
 
-			tmp = __pfq_slot_xmit(hdr+1, len, &dev_queue, &ctx);
+	/* update trans_start once per burst */
 
-			rc.value += tmp.value;
-		}
-	}
+	if (rc.ok)
+	     dev_queue.queue->trans_start = ctx.jiffies;
 
 	/* unlock the current queue, enable bottom half */
 
 	HARD_TX_UNLOCK(dev_queue.dev, dev_queue.queue);
+
+	/* give back the skbs not used in this burst */
+
+	while (skb_idx < skb_num)
+		pfq_free_skb_pool(skbs[skb_idx++], ctx.tx);
+
 	local_bh_enable();
 
 	pfq_dev_queue_put(&dev_queue);
 	spin_unlock(&pool->tx_lock);
 
-	/* update the local consumer offset */
+	/* update the consumer index */
 
-	tx_queue->cons.off = prod_off;
+	tx_queue->cons.off = off;
+	__atomic_store_n(&tx_queue->cons.tail, head, __ATOMIC_RELEASE);
+	return rc;
 
-	/* count the packets left in the shared queue */
+drop:
+	/* the device is down: release the slots and account the packets as failed */
 
-	for_each_sk_slot(hdr, end, so->tx_slot_size) {
-		/* dynamic slot size: ensure the caplen is not zero! */
-		if (unlikely(!hdr->caplen))
-			break;
+	for(n = head - tail; n > 0; n--)
+	{
+		struct pfq_tx_zcopy_slot *zslot = pfq_tx_zcopy_slot(so, sock_queue, off);
+
+		zslot->busy = &hdr->info.commit;
+		zslot->fwd_sock = NULL;
+
+		if (unlikely(hdr->info.flags & Q_PKTHDR_TX_FWD))
+			pfq_tx_fwd_resolve(so, hdr, READ_ONCE(hdr->caplen), zslot);
+
+		pfq_tx_zcopy_slot_release(zslot);
+
+		off += (ptrdiff_t)so->tx_slot_size;
+		if (off >= size)
+			off = 0;
+
+		hdr = (struct pfq_pkthdr *)(tx_queue_mem + off);
 		rc.fail++;
 	}
 
+	tx_queue->cons.off = off;
+	__atomic_store_n(&tx_queue->cons.tail, head, __ATOMIC_RELEASE);
 	return rc;
 }
 
@@ -746,13 +1068,15 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 	if (likely(skb)) /* ensure this is not the timer heartbeat */
 	{
+		struct pfq_group_shared shared;
 		struct pfq_lang_monad monad;
-		unsigned long group_mask;
+		unsigned long group_mask, full_mask;
 		struct qbuff *buff;
 		ktime_t current_rx;
+		int fast_id;
 
-		/* if required, timestamp the packet now */
-		if (ktime_to_ns(skb->tstamp) == 0)
+		/* if required by any socket, timestamp the packet now */
+		if (ktime_to_ns(skb->tstamp) == 0 && atomic_read(&global->tstamp_wallclock))
 			__net_timestamp(skb);
 
 		/* if vlan header is present, remove it */
@@ -779,13 +1103,28 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 			  , &monad
 			  , data->counter++);
 
+		buff->tsc = atomic_read(&global->tstamp_tsc) ? get_cycles() : 0;
+
 		/* get the eligible groups */
 
-		group_mask = pfq_devmap_get_groups( qbuff_get_ifindex(buff)
+		group_mask = pfq_devmap_get_groups( data
+						  , qbuff_get_ifindex(buff)
 						  , qbuff_get_rx_queue(buff));
 
+		/* plain capture fast path: a single group, with a single socket and neither filters nor computation */
+
+		fast_id = pfq_devmap_get_fast_id(group_mask);
+		if (fast_id >= 0) {
+			__sparse_inc(global->groups[pfq_ctz(group_mask)].stats, recv, cpu);
+			buff->fwd_mask = 1UL << fast_id;
+			group_mask = 0;
+		}
+
+		/* process all groups for this qbuff: identical filters and
+		 * prefixes of computations are evaluated once */
 
-		/* process all groups for this qbuff */
+		pfq_group_shared_reset(&shared);
+		full_mask = 0;
 
 		pfq_bitwise_foreach(group_mask, bit,
 		{
@@ -803,7 +1142,16 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 			/* check if bp filter is enabled */
 
 			if (atomic_long_read(&this_group->bp_filter)) {
-				if (!qbuff_run_bp_filter(buff, this_group)) {
+				if (!qbuff_run_bp_filter_shared(buff, this_group, &shared)) {
+					__sparse_inc(this_group->stats, drop, cpu);
+					continue;
+				}
+			}
+
+			/* check if eBPF program is loaded */
+
+			if (atomic_long_read(&this_group->bpf_prog)) {
+				if (!qbuff_run_bpf_prog_shared(buff, this_group, &shared)) {
 					__sparse_inc(this_group->stats, drop, cpu);
 					continue;
 				}
@@ -811,7 +1159,7 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 			/* check vlan filter */
 
-			if (pfq_group_vlan_filters_enabled(gid)) {
+			if (atomic_long_read(&this_group->vlan_filters)) {
 				if (!qbuff_run_vlan_filter(buff, (pfq_gid_t)gid)) {
 					__sparse_inc(this_group->stats, drop, cpu);
 					continue;
@@ -822,7 +1170,7 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 			prg = (struct pfq_lang_computation_tree *)atomic_long_read(&this_group->comp);
 			if (prg) {
-				unsigned long cbit, elig_mask = 0;
+				unsigned long cbit, elig_mask = 0, sock_mask = 0;
 				size_t to_kernel = buff->to_kernel;
 				size_t num_fwd = buff->fwd_dev_num;
 
@@ -836,10 +1184,11 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 			 	monad.ipoff = 0;
 			 	monad.ipproto = IPPROTO_NONE;
 			 	monad.ep_ctx = EPOINT_SRC | EPOINT_DST;
+			 	monad.snaplen = 0;
 
 			 	/* run the functional program */
 
-			 	if (!pfq_lang_run(buff, prg).qbuff) {
+			 	if (!pfq_lang_run_shared(buff, prg, &shared).qbuff) {
 			 		__sparse_inc(this_group->stats, drop, cpu);
 			 		continue;
 			 	}
@@ -860,8 +1209,7 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 			 	pfq_bitwise_foreach(monad.fanout.class_mask, cbit,
 			 	{
-			 		int class = (int)pfq_ctz(cbit);
-			 		elig_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[class]);
+			 		elig_mask |= pfq_group_sock_mask(this_group, pfq_ctz(cbit));
 			 	});
 
 
@@ -882,31 +1230,62 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 							steer_mask[steer_mask_numb++] = sbit;
 			 		});
 
-					buff->fwd_mask |= steer_mask[pfq_fold(hash_int(monad.fanout.hash), (unsigned int)steer_mask_numb)];
+					sock_mask |= steer_mask[pfq_fold(hash_int(monad.fanout.hash), (unsigned int)steer_mask_numb)];
 
 					if (is_double_steering(monad.fanout))
-						buff->fwd_mask |= steer_mask[pfq_fold(hash_int(monad.fanout.hash2), (unsigned int)steer_mask_numb)];
+						sock_mask |= steer_mask[pfq_fold(hash_int(monad.fanout.hash2), (unsigned int)steer_mask_numb)];
 
 			 	}
 			 	else {  /* broadcast */
 
-			 		buff->fwd_mask |= elig_mask;
+			 		sock_mask = elig_mask;
 			 	}
 
+				buff->fwd_mask |= sock_mask;
+
+				/* snap length, per socket: a socket that receives the packet from more
+				 * groups gets the largest snap, and is not truncated if any group
+				 * does not snap the packet */
+
+				if (monad.snaplen) {
+					uint16_t snaplen = (uint16_t)min_t(unsigned int, monad.snaplen, 0xffff);
+					unsigned long snap_bit;
+
+					pfq_bitwise_foreach(sock_mask, snap_bit,
+					{
+						int id = pfq_ctz(snap_bit);
+
+						if (!(buff->snap_mask & snap_bit) || buff->snaplen[id] < snaplen)
+							buff->snaplen[id] = snaplen;
+					});
+
+					buff->snap_mask |= sock_mask;
+				}
+				else
+					full_mask |= sock_mask;
+
 			} else {
 				buff->fwd_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[0]);
+				full_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[0]);
 			}
 		}
 		);
 
-		/* get the current timestamp */
+		buff->snap_mask &= ~full_mask;
+
+		/* get the current time (packets are not necessarily timestamped) */
 
-		current_rx = qbuff_get_ktime(buff);
+		current_rx = ns_to_ktime(local_clock());
 
 		/* this packet is ready to be enqueued for transmission or possibly dropped */
 
 		if (buff->fwd_mask || buff->fwd_dev_num || buff->to_kernel) {
 			/* commit this buff to the queue */
+			if (data->qbuff_queue->len == 0)
+				data->fast_id = fast_id;
+			else if (data->fast_id != fast_id)
+				data->fast_id = -1;
+
 			data->qbuff_queue->len++;
 		}
 		else {  /* or drop and release it */
@@ -938,6 +1317,35 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 
 
+static bool
+pfq_receive_run_fast( struct pfq_percpu_data *data
+		    , struct pfq_percpu_pool *pool
+		    , int cpu)
+{
+	struct pfq_sock *so = pfq_sock_get_by_id((__force pfq_id_t)data->fast_id);
+        struct qbuff *buff;
+	size_t n;
+
+	if (unlikely(!so || so->egress_type != Q_ENDPOINT_SOCKET))
+		return false;
+
+	/* no transpose nor endpoint scan is required here */
+
+	pfq_copy_to_endpoint_qbuffs( so
+				   , PFQ_QBUFF_QUEUE(data->qbuff_queue)
+				   , ((unsigned __int128)1 << data->qbuff_queue->len) - 1
+				   , cpu);
+
+	for_each_qbuff(PFQ_QBUFF_QUEUE(data->qbuff_queue), buff, n)
+	{
+		qbuff_free(buff, &pool->rx);
+	}
+
+	data->qbuff_queue->len = 0;
+	return true;
+}
+
+
 int pfq_receive_run( struct pfq_percpu_data *data
 		   , struct pfq_percpu_pool *pool
 		   , int cpu)
@@ -960,6 +1368,11 @@ int pfq_receive_run( struct pfq_percpu_data *data
 	return 0;
 #endif
 
+	/* fast path: the whole batch is bound to a single socket */
+
+	if (data->fast_id >= 0 && pfq_receive_run_fast(data, pool, cpu))
+		return 0;
+
 	/* transpose the forward matrix */
 
 	for(n = 0; n < data->qbuff_queue->len; n++)
@@ -1037,6 +1450,250 @@ int pfq_copy_bits(const struct sk_buff *skb, int offset, void *to, int len)
 }
 
 
+static inline
+void pfq_sk_fill_pkthdr( struct pfq_sock *so
+		       , struct pfq_pkthdr *hdr
+		       , struct qbuff *buff
+		       , size_t bytes
+		       , struct timespec const *batch_ts)
+{
+	struct sk_buff *skb = QBUFF_SKB(buff);
+
+	hdr->info.flags = 0;
+
+	switch(so->tstamp)
+	{
+	case Q_TSTAMP_HW: {
+		ktime_t hwtstamp = skb_hwtstamps(skb)->hwtstamp;
+		if (ktime_to_ns(hwtstamp)) {
+			struct timespec ts = ktime_to_timespec(hwtstamp);
+			hdr->tstamp.tv.sec  = (uint32_t)ts.tv_sec;
+			hdr->tstamp.tv.nsec = (uint32_t)ts.tv_nsec;
+			hdr->info.flags |= Q_PKTHDR_HW_TSTAMP;
+			break;
+		}
+	} /* fall through: software timestamp */
+	case Q_TSTAMP_ON: {
+		struct timespec ts;
+		skb_get_timestampns(skb, &ts);
+		hdr->tstamp.tv.sec  = (uint32_t)ts.tv_sec;
+		hdr->tstamp.tv.nsec = (uint32_t)ts.tv_nsec;
+	} break;
+	case Q_TSTAMP_BATCH: {
+		hdr->tstamp.tv.sec  = (uint32_t)batch_ts->tv_sec;
+		hdr->tstamp.tv.nsec = (uint32_t)batch_ts->tv_nsec;
+	} break;
+	case Q_TSTAMP_TSC: {
+		hdr->tstamp.tv64 = buff->tsc;
+	} break;
+	}
+
+	hdr->caplen = (uint16_t)bytes;
+	hdr->len = (uint16_t)skb->len;
+
+	/* copy state from pfq_cb annotation */
+
+	hdr->info.data.mark  = skb->mark;
+
+	/* setup the header */
+
+	hdr->info.ifindex = skb->dev->ifindex;
+	hdr->info.vlan.tci = skb->vlan_tci & ~VLAN_TAG_PRESENT;
+	hdr->info.queue	= skb_rx_queue_recorded(skb) ? (uint8_t)skb_get_rx_queue(skb) : 0;
+}
+
+
+/*
+ * bytes copied to the socket: the caplen of the socket, possibly reduced
+ * by the snap length set by the computation of the group.
+ */
+
+static inline
+size_t pfq_sk_caplen(struct pfq_sock *so, struct qbuff const *buff)
+{
+	size_t bytes = min_t(size_t, QBUFF_SKB(buff)->len, so->rx_len);
+
+	if (unlikely(buff->snap_mask & (1UL << (__force int)so->id)))
+		bytes = min_t(size_t, bytes, buff->snaplen[(__force int)so->id]);
+
+	return bytes;
+}
+
+
+/*
+ * wake up the consumer sleeping in poll/epoll: the full barrier orders the
+ * commit of the slots with the check of the waitqueue (paired with poll_wait).
+ */
+
+static inline
+void pfq_sk_queue_notify(struct pfq_sock *so)
+{
+	smp_mb();
+	if (waitqueue_active(&so->waitqueue))
+		wake_up_interruptible(&so->waitqueue);
+}
+
+
+/*
+ * commit epoch of the round reserved with version qver. The epoch is not
+ * part of shinfo: the consumer may swap the queue between the reservation
+ * and the load of the epoch. It is therefore read along with a stable
+ * version and walked back to the round of the reservation (epochs grow by
+ * one per swap and skip 0). Once the half has been given back to the
+ * producers again, the round is over and the slots are committed with 0,
+ * a value never matched by the consumer.
+ */
+
+static inline
+unsigned int pfq_sk_queue_epoch(struct pfq_shared_rx_queue *rx_queue, pfq_qver_t qver)
+{
+	unsigned long data = __atomic_load_n(&rx_queue->shinfo, __ATOMIC_ACQUIRE);
+	unsigned int epoch;
+	pfq_qver_t ver;
+	int retry;
+
+	for(retry = 0; retry < 4; retry++)
+	{
+		ver = (pfq_qver_t)PFQ_SHARED_QUEUE_VER(data);
+		epoch = __atomic_load_n(&rx_queue->epoch[ver & 1], __ATOMIC_ACQUIRE);
+		data = __atomic_load_n(&rx_queue->shinfo, __ATOMIC_ACQUIRE);
+
+		if (likely((pfq_qver_t)PFQ_SHARED_QUEUE_VER(data) == ver)) {
+			switch((pfq_qver_t)(ver - qver))
+			{
+			case 0:  return epoch;
+			case 1:  return likely(epoch != 1) ? epoch - 1 : UINT_MAX;
+			default: return 0;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * packed Rx queue: slots are variable-length (the size of each slot is
+ * computed from its caplen), and the queue length is expressed in
+ * PFQ_SLOT_ALIGNMENT units.
+ */
+
+static inline
+size_t pfq_sk_packed_slot_units(struct pfq_sock *so, struct qbuff const *buff)
+{
+	return PFQ_SHARED_QUEUE_SLOT_SIZE(pfq_sk_caplen(so, buff)) / PFQ_SLOT_ALIGNMENT;
+}
+
+
+static
+size_t pfq_sk_packed_queue_recv(struct pfq_sock *so,
+				struct pfq_shared_rx_queue *rx_queue,
+				struct pfq_qbuff_queue *buffs,
+				unsigned __int128 mask)
+{
+	const size_t max_units = pfq_mpsc_queue_mem(so) / (2 * PFQ_SLOT_ALIGNMENT);
+	unsigned __int128 tmp_mask;
+	struct pfq_pkthdr *hdr;
+	struct qbuff *buff;
+	struct timespec batch_ts;
+	unsigned long data;
+	size_t n, qlen, units, total = 0, count = 0, copied = 0;
+	unsigned int epoch;
+	pfq_qver_t qver;
+
+	/* compute the room required by the batch */
+
+	tmp_mask = mask;
+	for_each_qbuff_with_mask(tmp_mask, buffs, buff, n)
+	{
+		total += pfq_sk_packed_slot_units(so, buff);
+	}
+
+	/* reserve the room for the batch (or for the part of it that fits into the queue) */
+
+	data = __atomic_load_n(&rx_queue->shinfo, __ATOMIC_RELAXED);
+	do
+	{
+		qlen  = PFQ_SHARED_QUEUE_LEN(data);
+		units = total;
+		count = pfq_popcount(mask);
+
+		if (unlikely(qlen + units > max_units)) {
+
+			units = 0;
+			count = 0;
+
+			tmp_mask = mask;
+			for_each_qbuff_with_mask(tmp_mask, buffs, buff, n)
+			{
+				size_t u = pfq_sk_packed_slot_units(so, buff);
+				if (qlen + units + u > max_units)
+					break;
+				units += u;
+				count++;
+			}
+
+			if (count == 0) {
+				/* the queue is full: make sure the consumer is awake */
+				pfq_sk_queue_notify(so);
+				return 0;
+			}
+		}
+	}
+	while (!__atomic_compare_exchange_n(&rx_queue->shinfo, &data, data + units, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+	qver = PFQ_SHARED_QUEUE_VER(data);
+	epoch = pfq_sk_queue_epoch(rx_queue, qver);
+
+	hdr = (struct pfq_pkthdr *)((char *)pfq_sock_rx_queue_mem(so) + (qver & 1) * (pfq_mpsc_queue_mem(so)/2)
+								     + qlen * PFQ_SLOT_ALIGNMENT);
+
+	if (so->tstamp == Q_TSTAMP_BATCH)
+		getnstimeofday(&batch_ts);
+
+	for_each_qbuff_with_mask(mask, buffs, buff, n)
+	{
+		struct sk_buff *skb = QBUFF_SKB(buff);
+		size_t bytes;
+
+		if (copied == count)
+			break;
+
+		bytes = pfq_sk_caplen(so, buff);
+
+		prefetch_w0(hdr);
+		prefetch_w0((char *)hdr + 64);
+
+		/* the room is reserved: in case of error the slot is committed anyway */
+
+		if (pfq_copy_bits(skb, 0, hdr+1, bytes) != 0) {
+			printk(KERN_WARNING "[PFQ] error: BUG! skb_copy_bits failed (bytes=%zu, skb_len=%d mac_len=%d)!\n",
+			       bytes, skb->len, skb->mac_len);
+		}
+
+		pfq_sk_fill_pkthdr(so, hdr, buff, bytes, &batch_ts);
+
+		__atomic_store_n(&hdr->info.commit, epoch, __ATOMIC_RELEASE);
+
+		copied++;
+
+		hdr = PFQ_SHARED_QUEUE_NEXT_PACKED_PKTHDR(hdr);
+	}
+
+	/* publish the batch to the consumer (release semantic) */
+
+	__atomic_fetch_add(&rx_queue->commit_pkt[qver & 1], (unsigned int)count, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&rx_queue->commit_len[qver & 1], (unsigned int)units, __ATOMIC_RELEASE);
+
+	/* edge notification: the batch turned the queue non-empty */
+
+	if (qlen == 0)
+		pfq_sk_queue_notify(so);
+
+	return copied;
+}
+
+
 size_t pfq_sk_queue_recv(struct pfq_sock *so,
 			 struct pfq_qbuff_queue *buffs,
 			 unsigned __int128 mask,
@@ -1045,22 +1702,35 @@ size_t pfq_sk_queue_recv(struct pfq_sock *so,
 	struct pfq_shared_rx_queue *rx_queue = pfq_sock_rx_shared_queue(so);
 	struct pfq_pkthdr *hdr;
 	struct qbuff *buff;
+	struct timespec batch_ts;
 	unsigned long data;
 	size_t n, copied = 0;
+	unsigned int epoch;
 	pfq_qver_t qver;
 	int qlen;
 
 	if (unlikely(rx_queue == NULL))
 		return 0;
 
-	data = __atomic_fetch_add(&rx_queue->shinfo, burst_len, __ATOMIC_RELAXED);
+	if (so->rx_packed)
+		return pfq_sk_packed_queue_recv(so, rx_queue, buffs, mask);
+
+	/* reserve the slots: the epoch of the round is resolved right after */
+
+	data = __atomic_fetch_add(&rx_queue->shinfo, burst_len, __ATOMIC_ACQUIRE);
 	qlen = PFQ_SHARED_QUEUE_LEN(data);
 	qver = PFQ_SHARED_QUEUE_VER(data);
+	epoch = pfq_sk_queue_epoch(rx_queue, qver);
 
 	hdr  = (struct pfq_pkthdr *) pfq_mpsc_slot_ptr(so, qver, qlen);
 	if (unlikely(hdr == NULL))
 		return 0;
 
+	/* a single timestamp is shared by the whole batch */
+
+	if (so->tstamp == Q_TSTAMP_BATCH)
+		getnstimeofday(&batch_ts);
+
 	for_each_qbuff_with_mask(mask, buffs, buff, n)
 	{
 		struct sk_buff *skb = QBUFF_SKB(buff);
@@ -1069,7 +1739,7 @@ size_t pfq_sk_queue_recv(struct pfq_sock *so,
 
 		/* compute the boundaries */
 
-		bytes = min_t(size_t, skb->len, so->tx_len);
+		bytes = pfq_sk_caplen(so, buff);
 		pkt = (char *)(hdr+1);
 		slot_index = qlen + copied;
 
@@ -1077,12 +1747,9 @@ size_t pfq_sk_queue_recv(struct pfq_sock *so,
 		prefetch_w0((char *)hdr + 64);
 
 		if (unlikely(slot_index >= so->rx_queue_len)) {
-#ifdef PFQ_USE_POLL
-			if (waitqueue_active(&so->waitqueue)) {
-				wake_up_interruptible(&so->waitqueue);
-			}
-#endif
-			return copied;
+			/* the queue is full: make sure the consumer is awake */
+			pfq_sk_queue_notify(so);
+			break;
 		}
 
 
@@ -1091,7 +1758,7 @@ size_t pfq_sk_queue_recv(struct pfq_sock *so,
 		if (pfq_copy_bits(skb, 0, pkt, bytes) != 0) {
 			printk(KERN_WARNING "[PFQ] error: BUG! skb_copy_bits failed (bytes=%zu, skb_len=%d mac_len=%d)!\n",
 			       bytes, skb->len, skb->mac_len);
-			return copied;
+			break;
 		}
 #else
 		skb_copy_from_linear_data_offset(skb, 0, pkt, bytes);
@@ -1099,44 +1766,21 @@ size_t pfq_sk_queue_recv(struct pfq_sock *so,
 
 		/* fill pkt header */
 
-		if (likely(so->tstamp != 0)) {
-			struct timespec ts;
-			skb_get_timestampns(skb, &ts);
-			hdr->tstamp.tv.sec  = (uint32_t)ts.tv_sec;
-			hdr->tstamp.tv.nsec = (uint32_t)ts.tv_nsec;
-		}
-
-		hdr->caplen = (uint16_t)bytes;
-		hdr->len = (uint16_t)skb->len;
-
-		/* copy state from pfq_cb annotation */
-
-		hdr->info.data.mark  = skb->mark;
-
-		/* setup the header */
-
-		hdr->info.ifindex = skb->dev->ifindex;
-		hdr->info.vlan.tci = skb->vlan_tci & ~VLAN_TAG_PRESENT;
-		hdr->info.queue	= skb_rx_queue_recorded(skb) ? (uint16_t)skb_get_rx_queue(skb) : 0;
+		pfq_sk_fill_pkthdr(so, hdr, buff, bytes, &batch_ts);
 
 		/* commit the slot (release semantic) */
 
-		__atomic_store_n(&hdr->info.commit, qver, __ATOMIC_RELEASE);
-
-		/* check for pending waitqueue... */
-
-#ifdef PFQ_USE_POLL
-		if ((slot_index & 127) == 0 &&
-		    waitqueue_active(&so->waitqueue)) {
-			wake_up_interruptible(&so->waitqueue);
-		}
-#endif
+		__atomic_store_n(&hdr->info.commit, epoch, __ATOMIC_RELEASE);
 
 		copied++;
 
 		hdr = PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, so->rx_slot_size);
 	}
 
+	/* edge notification: the batch turned the queue non-empty */
+
+	if (qlen == 0 && copied)
+		pfq_sk_queue_notify(so);
+
 	return copied;
 }
-
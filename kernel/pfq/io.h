@@ -45,11 +45,6 @@
 	})
 
 
-#define for_each_sk_slot(hdr, end, fix) \
-        for(; (hdr < (struct pfq_pkthdr *)end); \
-               hdr = PFQ_SHARED_QUEUE_NEXT_PKTHDR(hdr, fix))
-
-
 typedef union
 {
 	uint64_t value;
@@ -81,6 +76,8 @@ struct pfq_xmit_context
 	unsigned long		jiffies;
 	int			node;
 	int			copies;
+	unsigned int		max_copies;
+	unsigned int		reserved;
 	bool			*intr;
 	bool			xmit_more;
 };
@@ -104,6 +101,9 @@ pfq_count_fwd_devs(struct net_device *dev, struct net_device **devs, size_t num_
 extern tx_response_t
 pfq_sk_queue_xmit(struct pfq_sock *so, int qindex, int cpu);
 
+extern bool pfq_sk_queue_xmit_pending(struct pfq_sock *so, int qindex);
+extern void pfq_sk_queue_need_wakeup(struct pfq_sock *so, int qindex, unsigned int value);
+
 
 /* skb queues */
 
@@ -55,5 +55,9 @@ netdev_notifier_info_to_dev(void *data)
 #  define PFQ_BUILD_BUG_ON_MSG(...)
 #endif
 
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(3,19,0))
+#  define READ_ONCE(x) ACCESS_ONCE(x)
+#endif
+
 
 #endif /* PFQ_KCOMPACT_H */
@@ -316,5 +316,46 @@ pfq_alloc_skb_pool(unsigned int size, gfp_t priority, int node, int idx, struct
 }
 
 
+/* bulk pool allocation: fill skbs with up to n buffers, return the number allocated */
+
+static inline
+size_t
+pfq_alloc_skb_pool_bulk(unsigned int size, gfp_t priority, int node, int idx, struct pfq_skb_pool *pool,
+			struct sk_buff **skbs, size_t n)
+{
+	size_t i = 0, pooled;
+
+#ifdef PFQ_USE_SKB_POOL
+	if (likely(pool->fifo)) {
+		for(; i < n; i++)
+		{
+			struct sk_buff *skb = pfq_spsc_peek(pool->fifo);
+			if (unlikely(!skb || !pfq_skb_is_recycleable(skb)))
+				break;
+
+			pfq_spsc_consume(pool->fifo);
+			pfq_skb_release_data(skb);
+			skbs[i] = pfq_skb_recycle(skb);
+		}
+
+		if (i)
+			sparse_add(global->percpu_memory, pool_pop[idx], i);
+	}
+#endif
+	pooled = i;
+
+	for(; i < n; i++)
+	{
+		skbs[i] = __alloc_skb(size, priority, 0, node);
+		if (unlikely(skbs[i] == NULL))
+			break;
+	}
+
+	if (i > pooled)
+		sparse_add(global->percpu_memory, os_alloc, i - pooled);
+
+	return i;
+}
+
 
 #endif /* PFQ_MEMORY_H */
@@ -25,15 +25,61 @@
 #define PFQ_NET_HEADERS_H
 
 #include <net/ip.h>
+#include <net/ipv6.h>
 
 #include <linux/ip.h>
 #include <linux/ipv6.h>
 #include <linux/udp.h>
 #include <linux/tcp.h>
 #include <linux/icmp.h>
+#include <linux/icmpv6.h>
 #include <linux/if_vlan.h>
 #include <linux/in.h>
 #include <linux/etherdevice.h>
 
+
+/* tunnel encapsulations */
+
+#define Q_GTP_C_PORT		2123
+#define Q_GTP_U_PORT		2152
+#define Q_VXLAN_PORT		4789
+
+#define Q_GTP_VERSION(f)	((f) >> 5)
+#define Q_GTP_FLAG_PT		0x10
+#define Q_GTP_FLAG_E		0x04
+#define Q_GTP_FLAG_OPT		0x07	/* E, S or PN: optional fields present */
+#define Q_GTP_TYPE_GPDU		0xff
+
+struct pfq_gtp1hdr
+{
+	uint8_t		flags;
+	uint8_t		type;
+	__be16		length;
+	__be32		teid;
+} __attribute__((packed));
+
+
+struct pfq_vxlanhdr
+{
+	__be32		flags;
+	__be32		vni;
+};
+
+
+#define Q_GRE_CSUM		0x8000
+#define Q_GRE_KEY		0x2000
+#define Q_GRE_SEQ		0x1000
+#define Q_GRE_VERSION		0x0007
+
+struct pfq_grehdr
+{
+	__be16		flags;
+	__be16		protocol;
+};
+
+
+#define Q_MPLS_BOS		0x00000100
+#define Q_MPLS_MAX_LABELS	8
+
 #endif /* PFQ_NET_HEADERS_H */
 
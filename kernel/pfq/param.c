@@ -39,6 +39,7 @@ module_param_named(skb_tx_pool_size,	 default_global.skb_tx_pool_size,	int, 0644
 module_param_named(skb_rx_pool_size,	 default_global.skb_rx_pool_size,	int, 0644);
 module_param_named(vlan_untag,		 default_global.vlan_untag,		int, 0644);
 module_param_named(tx_retry,		 default_global.tx_retry,		int, 0644);
+module_param_named(tx_idle_spin,	 default_global.tx_idle_spin,		int, 0644);
 
 module_param_array_named(tx_cpu,	 default_global.tx_cpu,	  int, &default_global.tx_cpu_nr, 0644);
 
@@ -55,4 +56,5 @@ MODULE_PARM_DESC(skb_rx_pool_size,	" Socket buffer Rx pool size (default=1024)")
 
 MODULE_PARM_DESC(tx_cpu,		" Tx k-threads cpu");
 MODULE_PARM_DESC(tx_retry,		" Tx retry attempts (default 1)");
+MODULE_PARM_DESC(tx_idle_spin,		" Tx k-threads busy polling before sleeping, in usec (default 100, -1 = never sleep)");
 
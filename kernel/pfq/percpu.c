@@ -98,6 +98,12 @@ int pfq_percpu_init(void)
                 data = per_cpu_ptr(global->percpu_data, cpu);
 
 		data->counter = 0;
+		data->fast_id = -1;
+
+		data->devmap_cache.dev = -1;
+		data->devmap_cache.queue = -1;
+		data->devmap_cache.gen = 0;
+		data->devmap_cache.mask = 0;
 
 		data->qbuff_queue = pfq_malloc_pages(sizeof(struct pfq_qbuff_long_queue), GFP_KERNEL);
 		if (!data->qbuff_queue)
@@ -55,6 +55,15 @@ int  pfq_percpu_alloc(void);
 void pfq_percpu_free(void);
 
 
+struct pfq_devmap_cache
+{
+	int		dev;
+	int		queue;
+	unsigned int	gen;		/* devmap generation of the entry */
+	unsigned long	mask;
+};
+
+
 struct pfq_percpu_data
 {
 	struct pfq_qbuff_long_queue  *qbuff_queue;
@@ -62,6 +71,9 @@ struct pfq_percpu_data
 	ktime_t			last_rx;
 	struct timer_list	timer;
 	uint32_t		counter;
+	int			fast_id;	/* socket id of the fast-path batch, -1 if mixed */
+
+	struct pfq_devmap_cache devmap_cache;	/* last (dev, queue) -> groups */
 
 } ____pfq_cacheline_aligned;
 
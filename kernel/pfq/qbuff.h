@@ -23,7 +23,9 @@
 #ifndef PFQ_QBUFF_H
 #define PFQ_QBUFF_H
 
+#include <pfq/bpf.h>
 #include <pfq/global.h>
+#include <pfq/group.h>
 #include <pfq/vlan.h>
 #include <pfq/types.h>
 #include <pfq/skbuff.h>
@@ -43,7 +45,10 @@ struct qbuff
 	struct net_device      *fwd_dev[Q_BUFF_QUEUE_LEN];	/* fwd to devs */
 	size_t			fwd_dev_num;
         unsigned long		fwd_mask;			/* fwd to sockets */
+        unsigned long		snap_mask;			/* sockets that receive snaplen bytes at most */
+        uint64_t		tsc;				/* arrival TSC (Q_TSTAMP_TSC only) */
         uint32_t		counter;			/* unique id */
+        uint16_t		snaplen[Q_MAX_ID];		/* per socket, valid if set in snap_mask */
         bool			to_kernel;			/* fwd to kernel */
 };
 
@@ -60,6 +65,7 @@ qbuff_init( struct qbuff *buff
 	buff->fwd_dev_num = 0;
 	buff->counter = id;
 	buff->fwd_mask = 0;
+	buff->snap_mask = 0;
 	buff->to_kernel = false;
 }
 
@@ -299,6 +305,44 @@ qbuff_run_bp_filter(struct qbuff *buff, struct pfq_group *this_group)
 
 }
 
+static inline bool
+qbuff_run_bpf_prog(struct qbuff *buff, struct pfq_group *this_group)
+{
+	struct bpf_prog *prog = (struct bpf_prog *)atomic_long_read(&this_group->bpf_prog);
+
+	if (!prog) return true;
+
+	return pfq_run_bpf_prog(prog, QBUFF_SKB(buff));
+}
+
+/* the same, sharing the result with the groups that run identical programs */
+
+static inline bool
+qbuff_run_bp_filter_shared(struct qbuff *buff, struct pfq_group *this_group, struct pfq_group_shared *sh)
+{
+	unsigned long key = (unsigned long)atomic_long_read(&this_group->bp_filter_key);
+	int pass = pfq_group_shared_lookup(sh, key);
+
+	if (pass < 0) {
+		pass = qbuff_run_bp_filter(buff, this_group);
+		pfq_group_shared_store(sh, key, pass);
+	}
+	return pass;
+}
+
+static inline bool
+qbuff_run_bpf_prog_shared(struct qbuff *buff, struct pfq_group *this_group, struct pfq_group_shared *sh)
+{
+	unsigned long key = (unsigned long)atomic_long_read(&this_group->bpf_prog_key);
+	int pass = pfq_group_shared_lookup(sh, key);
+
+	if (pass < 0) {
+		pass = qbuff_run_bpf_prog(buff, this_group);
+		pfq_group_shared_store(sh, key, pass);
+	}
+	return pass;
+}
+
 static inline bool
 qbuff_run_vlan_filter(struct qbuff const *buff, pfq_gid_t gid)
 {
@@ -29,6 +29,12 @@
 #include <pfq/shmem.h>
 #include <pfq/queue.h>
 
+#include <linux/clocksource.h>
+#include <linux/timex.h>
+#ifdef CONFIG_X86_TSC
+#include <asm/tsc.h>
+#endif
+
 
 int
 pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr, size_t user_size, size_t hugepage_size)
@@ -55,41 +61,68 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr, size_t use
 		mapped_queue->rx.len       = (unsigned int)so->rx_queue_len;
 		mapped_queue->rx.size      = (unsigned int)pfq_mpsc_queue_mem(so)/2;
 		mapped_queue->rx.slot_size = (unsigned int)so->rx_slot_size;
-
-		/* reset Rx slots */
+		mapped_queue->rx.packed    = (unsigned int)so->rx_packed;
 
 		for(i = 0; i < 2; i++)
 		{
-			char * raw = so->shmem.addr + sizeof(struct pfq_shared_queue) + i * mapped_queue->rx.size;
-			char * end = raw + mapped_queue->rx.size;
-			const int rst = !i;
-			for(;raw < end; raw += mapped_queue->rx.slot_size)
-				((struct pfq_pkthdr *)raw)->info.commit = (uint16_t)rst;
+			mapped_queue->rx.commit_len[i] = 0;
+			mapped_queue->rx.commit_pkt[i] = 0;
 		}
 
+		/* the first round is committed with epoch 1, the next ones are set by the consumer */
+
+		mapped_queue->rx.epoch[0] = 1;
+		mapped_queue->rx.epoch[1] = 0;
+
+		mapped_queue->rx.fwd_pending[0] = 0;
+		mapped_queue->rx.fwd_pending[1] = 0;
+
+		/* clear Rx slots: the memory (e.g. HugePages) may hold the epochs of a previous session */
+
+		memset(so->shmem.addr + sizeof(struct pfq_shared_queue), 0, mapped_queue->rx.size * 2);
+
+		/* initialize TSC conversion table: the memory (e.g. HugePages) may hold an odd seq */
+
+		so->tsc_seq = 0;
+		mapped_queue->tsc.seq = 0;
+
+		pfq_shared_queue_tsc_init(so, mapped_queue);
+
+		/* initialize the control ring and the stats snapshot */
+
+		memset(&mapped_queue->ctrl, 0, sizeof(mapped_queue->ctrl));
+
+		for(n = 0; n < Q_CTRL_MAX_GROUPS; n++)
+			mapped_queue->ctrl.stats.group[n].gid = -1;
+
 		/* initialize TX queues */
 
-		mapped_queue->tx.size  = pfq_spsc_queue_mem(so)/2;
+		mapped_queue->tx.size  = pfq_spsc_queue_mem(so);
 
-		mapped_queue->tx.prod.index = 0;
-		mapped_queue->tx.prod.off0  = 0;
-		mapped_queue->tx.prod.off1  = 0;
-		mapped_queue->tx.cons.index = 0;
-		mapped_queue->tx.cons.off   = 0;
+		mapped_queue->tx.prod.head = 0;
+		mapped_queue->tx.prod.off  = 0;
+		mapped_queue->tx.cons.tail = 0;
+		mapped_queue->tx.cons.off  = 0;
+		mapped_queue->tx.cons.need_wakeup = 0;
 
 		/* initialize TX async queues */
 
 		for(n = 0; n < Q_MAX_TX_QUEUES; n++)
 		{
-			mapped_queue->tx_async[n].size  = pfq_spsc_queue_mem(so)/2;
+			mapped_queue->tx_async[n].size  = pfq_spsc_queue_mem(so);
 
-			mapped_queue->tx_async[n].prod.index = 0;
-			mapped_queue->tx_async[n].prod.off0  = 0;
-			mapped_queue->tx_async[n].prod.off1  = 0;
-			mapped_queue->tx_async[n].cons.index = 0;
-			mapped_queue->tx_async[n].cons.off   = 0;
+			mapped_queue->tx_async[n].prod.head = 0;
+			mapped_queue->tx_async[n].prod.off  = 0;
+			mapped_queue->tx_async[n].cons.tail = 0;
+			mapped_queue->tx_async[n].cons.off  = 0;
+			mapped_queue->tx_async[n].cons.need_wakeup = 0;
 		}
 
+		/* clear Tx slots: all of them must be released (commit == 0) */
+
+		memset(so->shmem.addr + sizeof(struct pfq_shared_queue) + mapped_queue->rx.size * 2, 0,
+		       pfq_spsc_queue_mem(so) * (1 + so->txq_num_async));
+
 		/* commit queues */
 
 		smp_wmb();
@@ -110,18 +143,51 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr, size_t use
 			 so->tx_len,
 			 pfq_spsc_queue_mem(so));
 
-		pr_devel("[PFQ|%d] Tx async queues: len=%zu slot_size=%zu xmitlen=%zu, mem=%zu bytes (%d queues)\n",
+		pr_devel("[PFQ|%d] Tx async queues: len=%zu slot_size=%zu xmitlen=%zu, mem=%zu bytes (%zu queues)\n",
 			 so->id,
 			 so->tx_queue_len,
 			 so->tx_slot_size,
 			 so->tx_len,
-			 pfq_spsc_queue_mem(so) * Q_MAX_TX_QUEUES, Q_MAX_TX_QUEUES);
+			 pfq_spsc_queue_mem(so) * so->txq_num_async, so->txq_num_async);
 	}
 
 	return 0;
 }
 
 
+/* the seq is advanced from the kernel copy, never from the (user-writable) shared memory */
+
+void
+pfq_shared_queue_tsc_init(struct pfq_sock *so, struct pfq_shared_queue *queue)
+{
+#ifdef CONFIG_X86_TSC
+	unsigned long flags;
+	u32 mult, shift;
+	u64 cycles, nsec;
+
+	clocks_calc_mult_shift(&mult, &shift, tsc_khz, NSEC_PER_MSEC, 600);
+
+	local_irq_save(flags);
+	cycles = get_cycles();
+	nsec = ktime_to_ns(ktime_get_real());
+	local_irq_restore(flags);
+
+	__atomic_store_n(&queue->tsc.seq, ++so->tsc_seq, __ATOMIC_RELAXED);
+	smp_wmb();
+
+	queue->tsc.cycles = cycles;
+	queue->tsc.nsec   = nsec;
+	queue->tsc.mult   = mult;
+	queue->tsc.shift  = shift;
+
+	smp_wmb();
+	__atomic_store_n(&queue->tsc.seq, ++so->tsc_seq, __ATOMIC_RELAXED);
+#else
+	memset(&queue->tsc, 0, sizeof(queue->tsc));
+#endif
+}
+
+
 int
 pfq_shared_queue_unmap(struct pfq_sock *so)
 {
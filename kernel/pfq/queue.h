@@ -34,6 +34,7 @@
 
 extern int pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr, size_t user_size, size_t hugepage_size);
 extern int pfq_shared_queue_unmap(struct pfq_sock *so);
+extern void pfq_shared_queue_tsc_init(struct pfq_sock *so, struct pfq_shared_queue *queue);
 
 
 static inline size_t pfq_mpsc_queue_mem(struct pfq_sock *so)
@@ -46,6 +47,11 @@ static inline size_t pfq_spsc_queue_mem(struct pfq_sock *so)
         return so->tx_queue_len * so->tx_slot_size * 2;
 }
 
+static inline size_t pfq_spsc_queue_len(struct pfq_sock *so)
+{
+        return so->tx_queue_len * 2;	/* slots of a Tx ring */
+}
+
 
 static inline
 size_t pfq_mpsc_queue_len(struct pfq_sock *p)
@@ -308,9 +308,23 @@ pfq_shared_memory_free(struct pfq_shmem_descr *shmem)
 }
 
 
+/* return the page backing an address of the shared memory:
+ * vmalloc'd memory and HugePages mapped by vm_map_ram are in the vmalloc area,
+ * 1G HugePages are linearly mapped.
+ */
+
+struct page *
+pfq_shared_memory_page(const void *addr)
+{
+	if (is_vmalloc_addr(addr))
+		return vmalloc_to_page(addr);
+	return virt_to_page(addr);
+}
+
+
 size_t pfq_total_queue_mem(struct pfq_sock *so)
 {
-        return sizeof(struct pfq_shared_queue) + pfq_mpsc_queue_mem(so) + pfq_spsc_queue_mem(so) * (1 + Q_MAX_TX_QUEUES);
+        return sizeof(struct pfq_shared_queue) + pfq_mpsc_queue_mem(so) + pfq_spsc_queue_mem(so) * (1 + so->txq_num_async);
 }
 
 
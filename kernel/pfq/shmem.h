@@ -68,6 +68,7 @@ extern int    pfq_hugepages_unmap(struct pfq_shmem_descr *shmem);
 
 extern int    pfq_shared_memory_alloc(pfq_id_t, struct pfq_shmem_descr *shmem, unsigned long user_addr, size_t user_size, size_t huge_size, size_t req_size);
 extern void   pfq_shared_memory_free(struct pfq_shmem_descr *shmem);
+extern struct page *pfq_shared_memory_page(const void *addr);
 
 
 #endif /* PFQ_SHMEM_H */
@@ -22,6 +22,7 @@
  ****************************************************************/
 
 #include <pfq/atomic.h>
+#include <pfq/ctrl.h>
 #include <pfq/global.h>
 #include <pfq/kcompat.h>
 #include <pfq/pool.h>
@@ -174,7 +175,23 @@ int pfq_sock_init(struct pfq_sock *so, pfq_id_t id, size_t caplen, size_t xmitle
 
         /* disable tiemstamping by default */
 
-        so->tstamp = false;
+        so->tstamp = Q_TSTAMP_OFF;
+        so->tsc_refresh = 0;
+        so->tsc_seq = 0;
+
+        /* fixed-size Rx slots by default */
+
+        so->rx_packed = 0;
+
+        /* Tx copies packets by default */
+
+        so->tx_zcopy = 0;
+        atomic_set(&so->tx_zcopy_inflight, 0);
+        so->tx_zcopy_slots = NULL;
+
+        /* shared control ring and stats snapshot */
+
+        pfq_ctrl_init(so);
 
         /* initialize waitqueue */
 
@@ -202,6 +219,7 @@ int pfq_sock_init(struct pfq_sock *so, pfq_id_t id, size_t caplen, size_t xmitle
 	for(i = 0; i < Q_MAX_TX_QUEUES; ++i)
 	{
 		pfq_queue_info_init(&so->tx_async[i]);
+		so->tx_async_tid[i] = -1;
 	}
         return 0;
 }
@@ -220,6 +238,7 @@ pfq_sock_tx_bind(struct pfq_sock *so, int tid, int ifindex, int qindex)
 
 	so->tx_async[queue].ifindex = ifindex;
 	so->tx_async[queue].queue = qindex;
+	so->tx_async_tid[queue] = tid;
 	so->txq_num_async++;
 
 	smp_wmb();
@@ -228,6 +247,7 @@ pfq_sock_tx_bind(struct pfq_sock *so, int tid, int ifindex, int qindex)
 	{
 		so->tx_async[queue].ifindex = -1;
 		so->tx_async[queue].queue = -1;
+		so->tx_async_tid[queue] = -1;
 		so->txq_num_async--;
 		return err;
 	}
@@ -253,6 +273,78 @@ pfq_sock_tx_unbind(struct pfq_sock *so)
 	{
 		so->tx_async[n].ifindex = -1;
 		so->tx_async[n].queue = -1;
+		so->tx_async_tid[n] = -1;
+	}
+
+	so->txq_num_async = 0;
+	return 0;
+}
+
+
+/* doorbell: wake up the Tx thread of an async queue (1..txq_num_async) */
+
+int
+pfq_sock_tx_wakeup(struct pfq_sock *so, int queue)
+{
+	if (queue < 1 || queue > (int)so->txq_num_async)
+		return -EINVAL;
+
+	return pfq_wakeup_tx_thread(so->tx_async_tid[queue-1]);
+}
+
+
+static atomic_t *
+pfq_tstamp_counter(int tstamp)
+{
+	switch(tstamp)
+	{
+	case Q_TSTAMP_ON:
+	case Q_TSTAMP_HW:  return &global->tstamp_wallclock;
+	case Q_TSTAMP_TSC: return &global->tstamp_tsc;
+	}
+	return NULL;
+}
+
+
+int
+pfq_sock_set_tstamp(struct pfq_sock *so, int tstamp)
+{
+	struct pfq_shared_queue *queue;
+	atomic_t *counter;
+	int old;
+
+	/* legacy callers enable timestamps with any non-zero value */
+
+	if (tstamp < Q_TSTAMP_OFF || tstamp > Q_TSTAMP_HW)
+		tstamp = Q_TSTAMP_ON;
+
+#ifndef CONFIG_X86_TSC
+	if (tstamp == Q_TSTAMP_TSC)
+		return -EOPNOTSUPP;
+#endif
+
+	/* update the global counters used by pfq_receive to stamp packets on arrival:
+	 * the exchange accounts each transition once, even with concurrent callers.
+	 */
+
+	old = xchg(&so->tstamp, tstamp);
+
+	counter = pfq_tstamp_counter(old);
+	if (counter)
+		atomic_dec(counter);
+
+	counter = pfq_tstamp_counter(tstamp);
+	if (counter)
+		atomic_inc(counter);
+
+	/* refresh the TSC conversion table (then periodically refreshed by the ctrl timer) */
+
+	queue = pfq_sock_shared_queue(so);
+	if (tstamp == Q_TSTAMP_TSC && queue) {
+		spin_lock_bh(&so->ctrl_lock);
+		pfq_shared_queue_tsc_init(so, queue);
+		so->tsc_refresh = jiffies + msecs_to_jiffies(Q_TSC_REFRESH_PERIOD);
+		spin_unlock_bh(&so->ctrl_lock);
 	}
 
 	return 0;
@@ -264,29 +356,57 @@ pfq_sock_enable(struct pfq_sock *so, struct pfq_so_enable *mem)
 {
         int err;
 
+	if (pfq_sock_shared_queue(so)) {
+		pr_devel("[PFQ|%d] socket (already) enabled.\n", so->id);
+		return 0;
+	}
+
 	printk(KERN_INFO "[PFQ|%d] enable: mapping user_addr=%p user_size=%zu hugepage_size=%zu...\n", so->id,
 		(void *)mem->user_addr, mem->user_size, mem->hugepage_size);
 
+	/* completion of zero-copy Tx slots */
+
+	so->tx_zcopy_slots = kcalloc(pfq_spsc_queue_len(so) * (1 + so->txq_num_async),
+				     sizeof(struct pfq_tx_zcopy_slot), GFP_KERNEL);
+	if (so->tx_zcopy_slots == NULL) {
+                printk(KERN_INFO "[PFQ|%d] enable error: out of memory!\n", so->id);
+		return -ENOMEM;
+	}
+
         err = pfq_shared_queue_enable(so, mem->user_addr, mem->user_size, mem->hugepage_size);
         if (err < 0) {
                 printk(KERN_INFO "[PFQ|%d] enable error!\n", so->id);
-                return err;
+		goto err_slots;
         }
 
 	if (mem->hugepage_size) {
 		if (!so->shmem.hugepages_descr) {
 			printk(KERN_INFO "[PFQ|%d] enable error (null HugePages descriptor)!\n", so->id);
-			return -EFAULT;
+			err = -EFAULT;
+			goto err_queue;
 		}
 	}
 
+	/* start publishing the stats in the shared memory */
+
+	pfq_ctrl_start(so);
 	return 0;
+
+err_queue:
+	atomic_long_set(&so->shmem_addr, 0);
+	pfq_shared_queue_unmap(so);
+err_slots:
+	kfree(so->tx_zcopy_slots);
+	so->tx_zcopy_slots = NULL;
+	return err;
 }
 
 
 int
 pfq_sock_disable(struct pfq_sock *so)
 {
+	int wait;
+
 	pr_devel("[PFQ|%d] leaving all groups...\n", so->id);
 	pfq_group_leave_all(so->id);
 
@@ -304,8 +424,35 @@ pfq_sock_disable(struct pfq_sock *so)
 		pr_devel("[PFQ|%d] disabling shared queue...\n", so->id);
 		atomic_long_set(&so->shmem_addr, 0);
 
+		pfq_ctrl_stop(so);
+
 		msleep(Q_GRACE_PERIOD);
 
+		/* zero-copy skbs (sent or forwarded from this socket) still reference the shared memory */
+
+		for(wait = 0; atomic_read(&so->tx_zcopy_inflight) && wait < Q_TX_ZCOPY_TIMEOUT; wait += Q_GRACE_PERIOD) {
+			pr_devel("[PFQ|%d] waiting for %d zero-copy skbs...\n", so->id, atomic_read(&so->tx_zcopy_inflight));
+			msleep(Q_GRACE_PERIOD);
+		}
+
+		if (atomic_read(&so->tx_zcopy_inflight)) {
+
+			/* skbs held by a stuck driver or qdisc: their completion may still
+			 * come, so the socket, the Tx slots and the shared memory are leaked
+			 * rather than freed under them. */
+
+			printk(KERN_WARNING "[PFQ|%d] %d zero-copy skbs not released after %d msec: leaking the shared queue!\n",
+			       so->id, atomic_read(&so->tx_zcopy_inflight), Q_TX_ZCOPY_TIMEOUT);
+
+			sock_hold(&so->sk);
+			so->tx_zcopy_slots = NULL;
+			memset(&so->shmem, 0, sizeof(so->shmem));
+			return 0;
+		}
+
+		kfree(so->tx_zcopy_slots);
+		so->tx_zcopy_slots = NULL;
+
 		pr_devel("[PFQ|%d] unmapping shared queue...\n", so->id);
 		pfq_shared_queue_unmap(so);
 	}
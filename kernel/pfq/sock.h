@@ -36,6 +36,7 @@
 #include <pfq/types.h>
 
 #include <linux/wait.h>
+#include <linux/timer.h>
 
 #ifdef __KERNEL__
 #include <net/sock.h>
@@ -64,6 +65,18 @@ void pfq_queue_info_init(struct pfq_queue_info *info)
 }
 
 
+/* zero-copy Tx: completion of the skb of a Tx slot (owned by the kernel) */
+
+struct pfq_tx_zcopy_slot
+{
+	struct ubuf_info	ubuf;		/* completion of the frags, once no longer referenced */
+	struct pfq_sock		*sock;		/* owner of the Tx slot */
+	uint32_t		*busy;		/* flag of the Tx slot, released on completion */
+	unsigned int		*fwd_pending;	/* forward: counter of the Rx half held */
+	struct pfq_sock		*fwd_sock;	/* forward: owner of the Rx queue */
+};
+
+
 struct pfq_sock
 {
         struct sock		sk;
@@ -74,6 +87,11 @@ struct pfq_sock
         int			egress_queue;
 	int			weight;
 	int			tstamp;
+	int			rx_packed;
+	int			tx_zcopy;
+
+	atomic_t		tx_zcopy_inflight;  /* zero-copy skbs not yet released by drivers */
+	struct pfq_tx_zcopy_slot *tx_zcopy_slots;   /* one per Tx slot, allocated when enabled */
 
 	size_t			rx_len;
 	size_t			tx_len;
@@ -89,6 +107,7 @@ struct pfq_sock
         size_t			txq_num_async;
 
 	struct pfq_queue_info	tx_async[Q_MAX_TX_QUEUES];
+	int			tx_async_tid[Q_MAX_TX_QUEUES];
 	struct pfq_queue_info	tx;
 	struct pfq_queue_info	rx;
 
@@ -96,6 +115,12 @@ struct pfq_sock
 
 	atomic_long_t		shmem_addr;
 
+	spinlock_t		ctrl_lock;	    /* shared control ring and stats snapshot */
+	struct timer_list	ctrl_timer;	    /* periodic stats snapshot (and TSC table refresh) */
+	unsigned long		tsc_refresh;	    /* jiffies: next refresh of the TSC conversion table */
+	u32			tsc_seq;	    /* seqlock of the TSC conversion table (kernel copy) */
+	int			ctrl_gid[Q_CTRL_MAX_GROUPS]; /* groups whose stats are published (-1 = none) */
+
         pfq_sock_stats_t __percpu *stats;
 
 } ____pfq_cacheline_aligned;
@@ -166,6 +191,8 @@ extern int	pfq_sock_counter(void);
 extern void	pfq_sock_release_id(pfq_id_t id);
 extern int	pfq_sock_tx_bind(struct pfq_sock *so, int tid, int if_index, int queue);
 extern int	pfq_sock_tx_unbind(struct pfq_sock *so);
+extern int	pfq_sock_tx_wakeup(struct pfq_sock *so, int queue);
+extern int	pfq_sock_set_tstamp(struct pfq_sock *so, int tstamp);
 
 extern int	pfq_sock_enable(struct pfq_sock *so, struct pfq_so_enable *mem);
 extern int	pfq_sock_disable(struct pfq_sock *so);
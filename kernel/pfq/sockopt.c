@@ -80,12 +80,13 @@ int pfq_getsockopt(struct socket *sock,
 
                         group.gid = pfq_group_join_free(so->id, group.class_mask, group.policy);
                         if (group.gid < 0)
-                                return -EFAULT;
+                                return group.gid == -ENOMEM ? -ENOMEM : -EFAULT;
                         if (copy_to_user(optval, &group, (unsigned long)len))
                                 return -EFAULT;
                 }
                 else {
 			pfq_gid_t gid = (__force pfq_gid_t)group.gid;
+			int err;
 
 			if (!pfq_group_get(gid)) {
 				printk(KERN_INFO "[PFQ|%d] join group error: invalid group id %d!\n",
@@ -93,7 +94,10 @@ int pfq_getsockopt(struct socket *sock,
 				return -EFAULT;
 			}
 
-                        if (pfq_group_join(gid, so->id, group.class_mask, group.policy) < 0) {
+                        err = pfq_group_join(gid, so->id, group.class_mask, group.policy);
+                        if (err == -ENOMEM)
+                                return err;
+                        if (err < 0) {
                                 printk(KERN_INFO "[PFQ|%d] join group error: permission denied (gid=%d)!\n",
                                        so->id, group.gid);
                                 return -EACCES;
@@ -156,6 +160,22 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_RX_PACKED:
+        {
+                if (len != sizeof(so->rx_packed))
+                        return -EINVAL;
+                if (copy_to_user(optval, &so->rx_packed, sizeof(so->rx_packed)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_TX_ZCOPY:
+        {
+                if (len != sizeof(so->tx_zcopy))
+                        return -EINVAL;
+                if (copy_to_user(optval, &so->tx_zcopy, sizeof(so->tx_zcopy)))
+                        return -EFAULT;
+        } break;
+
         case Q_SO_GET_RX_TSTAMP:
         {
                 if (len != sizeof(so->tstamp))
@@ -359,6 +379,7 @@ int pfq_setsockopt(struct socket *sock,
         {
                 struct pfq_so_binding bind;
 		pfq_gid_t gid;
+		int err;
 
                 if (optlen != sizeof(bind))
                         return -EINVAL;
@@ -385,7 +406,11 @@ int pfq_setsockopt(struct socket *sock,
                         return -EACCES;
                 }
 
-                pfq_devmap_update(Q_DEVMAP_SET, bind.ifindex, bind.qindex, gid);
+                err = pfq_devmap_update(Q_DEVMAP_SET, bind.ifindex, bind.qindex, gid);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] bind: devmap update error (%d)!\n", so->id, err);
+                        return err;
+                }
 
                 pr_devel("[PFQ|%d] group id=%d bind: device ifindex=%d qindex=%d\n",
 					so->id, bind.gid, bind.ifindex, bind.qindex);
@@ -396,6 +421,7 @@ int pfq_setsockopt(struct socket *sock,
         {
                 struct pfq_so_binding bind;
 		pfq_gid_t gid;
+		int err;
 
                 if (optlen != sizeof(bind))
                         return -EINVAL;
@@ -417,7 +443,11 @@ int pfq_setsockopt(struct socket *sock,
 		}
 #endif
 
-                pfq_devmap_update(Q_DEVMAP_RESET, bind.ifindex, bind.qindex, gid);
+                err = pfq_devmap_update(Q_DEVMAP_RESET, bind.ifindex, bind.qindex, gid);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] unbind: devmap update error (%d)!\n", so->id, err);
+                        return err;
+                }
 
                 pr_devel("[PFQ|%d] group id=%d unbind: device ifindex=%d qindex=%d\n",
 					so->id, gid, bind.ifindex, bind.qindex);
@@ -464,17 +494,39 @@ int pfq_setsockopt(struct socket *sock,
 
         case Q_SO_SET_RX_TSTAMP:
         {
-                int tstamp;
+                int tstamp, err;
                 if (optlen != sizeof(so->tstamp))
                         return -EINVAL;
 
                 if (copy_from_user(&tstamp, optval, optlen))
                         return -EFAULT;
 
-                tstamp = tstamp ? 1 : 0;
-                so->tstamp = tstamp;
+                err = pfq_sock_set_tstamp(so, tstamp);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] timestamp: precision %d not supported!\n", so->id, tstamp);
+                        return err;
+                }
 
-                pr_devel("[PFQ|%d] timestamp enabled.\n", so->id);
+                pr_devel("[PFQ|%d] timestamp precision %d.\n", so->id, tstamp);
+        } break;
+
+        case Q_SO_SET_RX_PACKED:
+        {
+                int packed;
+                if (optlen != sizeof(so->rx_packed))
+                        return -EINVAL;
+
+                if (copy_from_user(&packed, optval, optlen))
+                        return -EFAULT;
+
+                if (pfq_sock_shared_queue(so)) {
+                        printk(KERN_INFO "[PFQ|%d] Rx packed: socket enabled!\n", so->id);
+                        return -EPERM;
+                }
+
+                so->rx_packed = packed ? 1 : 0;
+
+                pr_devel("[PFQ|%d] Rx packed slots %s.\n", so->id, so->rx_packed ? "enabled" : "disabled");
         } break;
 
         case Q_SO_SET_RX_LEN:
@@ -665,6 +717,86 @@ int pfq_setsockopt(struct socket *sock,
 
         } break;
 
+        case Q_SO_GROUP_BPF_PROG:
+        {
+                struct pfq_so_bpf_prog bprog;
+                struct bpf_prog *prog = NULL;
+		pfq_gid_t gid;
+
+                if (optlen != sizeof(bprog))
+                        return -EINVAL;
+
+                if (copy_from_user(&bprog, optval, optlen))
+                        return -EFAULT;
+
+		gid = (__force pfq_gid_t)bprog.gid;
+
+		if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] bpf prog: gid=%d not joined!\n", so->id, bprog.gid);
+			return -EACCES;
+		}
+
+                if (bprog.fd >= 0) {
+
+#ifndef PFQ_EBPF_SUPPORT
+                        printk(KERN_INFO "[PFQ|%d] bpf prog: eBPF not supported by this kernel!\n", so->id);
+                        return -EOPNOTSUPP;
+#endif
+                        prog = pfq_get_bpf_prog(bprog.fd);
+                        if (prog == NULL) {
+                                printk(KERN_INFO "[PFQ|%d] bpf prog error: fd=%d is not a socket filter program (gid=%d)\n",
+                                       so->id, bprog.fd, bprog.gid);
+                                return -EINVAL;
+                        }
+
+                        pr_devel("[PFQ|%d] bpf prog: gid=%d fd=%d\n", so->id, bprog.gid, bprog.fd);
+                }
+                else {
+                        pr_devel("[PFQ|%d] bpf prog: gid=%d (resetting program)\n", so->id, bprog.gid);
+                }
+
+                pfq_group_set_bpf_prog(gid, prog);
+
+        } break;
+
+        case Q_SO_GROUP_CLASS_TABLE:
+        {
+                struct pfq_so_class_table ct;
+		pfq_gid_t gid;
+		int err;
+
+                if (optlen != sizeof(ct))
+                        return -EINVAL;
+
+                if (copy_from_user(&ct, optval, optlen))
+                        return -EFAULT;
+
+		gid = (__force pfq_gid_t)ct.gid;
+
+		if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] class table: gid=%d not joined!\n", so->id, ct.gid);
+			return -EACCES;
+		}
+
+                if (ct.table < 0 || ct.table >= Q_CLASS_TABLES ||
+                    ct.class_id < Q_CLASS_TABLE_RESET || ct.class_id >= (int)Q_CLASS_MAX - 1) {
+                        printk(KERN_INFO "[PFQ|%d] class table error: invalid table=%d class=%d for gid=%d!\n",
+                               so->id, ct.table, ct.class_id, ct.gid);
+                        return -EINVAL;
+                }
+
+                err = pfq_group_set_class_table(gid, ct.table, ct.key, ct.class_id);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] class table error: gid=%d table=%d (%d)!\n",
+                               so->id, ct.gid, ct.table, err);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] class table: gid=%d table=%d key=%llu class=%d\n",
+			 so->id, ct.gid, ct.table, (unsigned long long)ct.key, ct.class_id);
+
+        } break;
+
         case Q_SO_GROUP_VLAN_FILT_TOGGLE:
         {
                 struct pfq_so_vlan_toggle vlan;
@@ -754,6 +886,13 @@ int pfq_setsockopt(struct socket *sock,
 			return -EPERM;
 		}
 
+		/* the memory of async queues is allocated when the socket is enabled */
+
+		if (bind.tid >= 0 && pfq_sock_shared_queue(so)) {
+			printk(KERN_INFO "[PFQ|%d] Tx thread: socket enabled!\n", so->id);
+			return -EPERM;
+		}
+
                 if (bind.qindex < -1) {
                         printk(KERN_INFO "[PFQ|%d] Tx thread: invalid hw queue (%d)\n", so->id, bind.qindex);
                         return -EPERM;
@@ -793,6 +932,20 @@ int pfq_setsockopt(struct socket *sock,
 		pfq_sock_tx_unbind(so);
         } break;
 
+        case Q_SO_SET_TX_ZCOPY:
+        {
+                int zcopy;
+                if (optlen != sizeof(so->tx_zcopy))
+                        return -EINVAL;
+
+                if (copy_from_user(&zcopy, optval, optlen))
+                        return -EFAULT;
+
+                so->tx_zcopy = zcopy ? 1 : 0;
+
+                pr_devel("[PFQ|%d] Tx zero-copy %s.\n", so->id, so->tx_zcopy ? "enabled" : "disabled");
+        } break;
+
         case Q_SO_TX_QUEUE_XMIT:
         {
 		int queue;
@@ -820,6 +973,14 @@ int pfq_setsockopt(struct socket *sock,
 			return 0;
 		}
 
+		if (queue > 0) { /* doorbell of an async Tx queue */
+			if (pfq_sock_tx_wakeup(so, queue) < 0) {
+				printk(KERN_INFO "[PFQ|%d] Tx queue: bad async queue %d!\n", so->id, queue);
+				return -EINVAL;
+			}
+			return 0;
+		}
+
 		printk(KERN_INFO "[PFQ|%d] Tx queue: bad queue %d!\n", so->id, queue);
 		return -EPERM;
 
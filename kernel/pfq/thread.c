@@ -33,6 +33,17 @@
 #include <linux/kthread.h>
 #include <linux/mutex.h>
 #include <linux/jiffies.h>
+#include <linux/slab.h>
+#include <linux/rcupdate.h>
+#if(LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0))
+#include <linux/sched/clock.h>
+#endif
+
+
+/* a sleeping Tx thread polls its queues at least every Q_TX_IDLE_TIMEOUT,
+ * in case a doorbell is lost */
+
+#define Q_TX_IDLE_TIMEOUT	(HZ/10)
 
 
 static DEFINE_MUTEX(pfq_thread_tx_pool_lock);
@@ -44,8 +55,7 @@ static struct pfq_thread_tx_data pfq_thread_tx_pool[Q_MAX_CPU] =
 		.id	= -1,
 		.cpu    = -1,
 		.task	= NULL,
-		.sock   = {NULL, NULL, NULL, NULL},
-		.sock_queue = {{-1}, {-1}, {-1}, {-1}}
+		.work   = NULL
 	}
 };
 
@@ -64,10 +74,79 @@ pfq_thread_ping(const char *type, struct pfq_thread_data const *data)
 
 
 
+static struct pfq_thread_tx_work *
+pfq_tx_work_alloc(size_t len, gfp_t flags)
+{
+	struct pfq_thread_tx_work *work;
+
+	work = kmalloc(sizeof(struct pfq_thread_tx_work) + len * sizeof(work->entry[0]), flags);
+	if (work)
+		work->len = len;
+	return work;
+}
+
+
+static void
+pfq_tx_work_need_wakeup(struct pfq_thread_tx_work const *work, unsigned int value)
+{
+	size_t n;
+	for(n = 0; n < work->len; n++)
+		pfq_sk_queue_need_wakeup(work->entry[n].sock, work->entry[n].queue, value);
+}
+
+
+static bool
+pfq_tx_work_pending(struct pfq_thread_tx_work const *work)
+{
+	size_t n;
+	for(n = 0; n < work->len; n++)
+	{
+		if (pfq_sk_queue_xmit_pending(work->entry[n].sock, work->entry[n].queue))
+			return true;
+	}
+	return false;
+}
+
+
+/* sleep until a producer rings the doorbell, a socket is bound or the timeout expires */
+
+static void
+pfq_tx_thread_sleep(struct pfq_thread_tx_data *data)
+{
+	struct pfq_thread_tx_work *work;
+	bool pending = false;
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	/* ask the producers for a doorbell, then check for the packets published in the meantime */
+
+	rcu_read_lock();
+	work = rcu_dereference(data->work);
+	if (work) {
+		pfq_tx_work_need_wakeup(work, 1);
+		smp_mb();
+		pending = pfq_tx_work_pending(work);
+	}
+	rcu_read_unlock();
+
+	if (!pending && !kthread_should_stop())
+		schedule_timeout(Q_TX_IDLE_TIMEOUT);
+
+	__set_current_state(TASK_RUNNING);
+
+	rcu_read_lock();
+	work = rcu_dereference(data->work);
+	if (work)
+		pfq_tx_work_need_wakeup(work, 0);
+	rcu_read_unlock();
+}
+
+
 static int
 pfq_tx_thread(void *_data)
 {
 	struct pfq_thread_tx_data *data = (struct pfq_thread_tx_data *)_data;
+	u64 idle_start = 0;
 
 #ifdef PFQ_DEBUG
         int now = 0;
@@ -85,29 +164,41 @@ pfq_tx_thread(void *_data)
         for(;;)
 	{
 		/* transmit the registered socket's queues */
+
 		bool reg = false;
-		int total_sent = 0, n;
+		int total_sent = 0;
+		size_t n;
 
-		for(n = 0; n < Q_MAX_TX_QUEUES; n++)
+		/* the read-side section covers one socket queue at a time: the work
+		 * list is looked up again for each entry, so that unbind (synchronize_rcu)
+		 * does not wait for a whole burst over all the registered queues. */
+
+		for(n = 0;; n++)
 		{
+			struct pfq_thread_tx_work *work;
 			struct pfq_sock *sock;
-			int sock_queue;
 			tx_response_t tx;
 
-			sock_queue = atomic_read(&data->sock_queue[n]);
-			smp_rmb();
-			sock = data->sock[n];
-
-			if (sock_queue != -1 && sock != NULL) {
-				reg = true;
-				tx = pfq_sk_queue_xmit(sock, sock_queue, data->cpu);
-				total_sent += tx.ok;
+			rcu_read_lock();
 
-				sparse_add(sock->stats,	  sent, tx.ok);
-				sparse_add(sock->stats,   fail, tx.fail);
-				sparse_add(global->percpu_stats,  sent, tx.ok);
-				sparse_add(global->percpu_stats,  fail, tx.fail);
+			work = rcu_dereference(data->work);
+			if (work == NULL || n >= work->len) {
+				rcu_read_unlock();
+				break;
 			}
+
+			reg = true;
+			sock = work->entry[n].sock;
+
+			tx = pfq_sk_queue_xmit(sock, work->entry[n].queue, data->cpu);
+			total_sent += tx.ok;
+
+			sparse_add(sock->stats,	  sent, tx.ok);
+			sparse_add(sock->stats,   fail, tx.fail);
+			sparse_add(global->percpu_stats,  sent, tx.ok);
+			sparse_add(global->percpu_stats,  fail, tx.fail);
+
+			rcu_read_unlock();
 		}
 
                 if (kthread_should_stop())
@@ -120,11 +211,28 @@ pfq_tx_thread(void *_data)
 		}
 #endif
 
-		if (total_sent == 0)
-			pfq_relax();
+		if (total_sent) {
+			idle_start = 0;
+			continue;
+		}
+
+		/* hybrid policy: busy-poll for tx_idle_spin usec, then sleep */
+
+		if (reg) {
+			u64 now_ns = local_clock();
 
-		if (!reg)
-			msleep(1);
+			if (idle_start == 0)
+				idle_start = now_ns;
+
+			if (global->tx_idle_spin < 0 ||
+			    now_ns - idle_start < (u64)global->tx_idle_spin * NSEC_PER_USEC) {
+				pfq_relax();
+				continue;
+			}
+		}
+
+		pfq_tx_thread_sleep(data);
+		idle_start = 0;
 	}
 
         printk(KERN_INFO "[PFQ] Tx[%d] thread stopped on cpu %d.\n", data->id, data->cpu);
@@ -137,7 +245,8 @@ int
 pfq_bind_tx_thread(int tid, struct pfq_sock *sock, int sock_queue)
 {
 	struct pfq_thread_tx_data *thread_data;
-	int n;
+	struct pfq_thread_tx_work *work, *old;
+	size_t len;
 
 	if (tid >= global->tx_cpu_nr) {
 		printk(KERN_INFO "[PFQ] Tx[%d] thread not available (%d Tx threads running)!\n", tid, global->tx_cpu_nr);
@@ -148,24 +257,32 @@ pfq_bind_tx_thread(int tid, struct pfq_sock *sock, int sock_queue)
 
 	mutex_lock(&pfq_thread_tx_pool_lock);
 
-	for(n = 0; n < Q_MAX_TX_QUEUES; n++)
-	{
-		if (atomic_read(&thread_data->sock_queue[n]) == -1)
-			break;
-	}
+	old = rcu_dereference_protected(thread_data->work, lockdep_is_held(&pfq_thread_tx_pool_lock));
+	len = old ? old->len : 0;
 
-	if (n == Q_MAX_TX_QUEUES) {
+	work = pfq_tx_work_alloc(len + 1, GFP_KERNEL);
+	if (work == NULL) {
 		mutex_unlock(&pfq_thread_tx_pool_lock);
-		printk(KERN_INFO "[PFQ] Tx[%d] thread busy (no queue available)!\n", tid);
-		return -EBUSY;
+		printk(KERN_INFO "[PFQ] Tx[%d] thread: out of memory!\n", tid);
+		return -ENOMEM;
 	}
 
-	thread_data->sock[n] = sock;
-	smp_wmb();
-	atomic_set(&thread_data->sock_queue[n], sock_queue);
+	if (old)
+		memcpy(work->entry, old->entry, len * sizeof(work->entry[0]));
+
+	work->entry[len].sock  = sock;
+	work->entry[len].queue = sock_queue;
+
+	rcu_assign_pointer(thread_data->work, work);
+
+	synchronize_rcu();
+	kfree(old);
 
         mutex_unlock(&pfq_thread_tx_pool_lock);
-        printk(KERN_INFO "[PFQ] Tx[%d] thread bound to sock_id = %d, queue = %d...\n", tid, sock->id, sock_queue);
+
+	pfq_wakeup_tx_thread(tid);
+
+        printk(KERN_INFO "[PFQ] Tx[%d] thread bound to sock_id = %d, queue = %d (%zu queues)...\n", tid, sock->id, sock_queue, len + 1);
         return 0;
 }
 
@@ -173,25 +290,42 @@ pfq_bind_tx_thread(int tid, struct pfq_sock *sock, int sock_queue)
 int
 pfq_unbind_tx_thread(struct pfq_sock *sock)
 {
-	int n, i;
+	int n;
 	mutex_lock(&pfq_thread_tx_pool_lock);
 
 	for(n = 0; n < global->tx_cpu_nr; n++)
 	{
 		struct pfq_thread_tx_data *data = &pfq_thread_tx_pool[n];
+		struct pfq_thread_tx_work *work, *old;
+		size_t i, len = 0;
+
+		old = rcu_dereference_protected(data->work, lockdep_is_held(&pfq_thread_tx_pool_lock));
+		if (old == NULL)
+			continue;
 
-		for(i = 0; i < Q_MAX_TX_QUEUES; i++)
+		for(i = 0; i < old->len; i++)
 		{
-			if (atomic_read(&data->sock_queue[i]) != -1)
-			{
-				if (data->sock[i] == sock) {
-					atomic_set(&data->sock_queue[i], -1);
-					smp_wmb();
-					msleep(Q_GRACE_PERIOD);
-					data->sock[i] = NULL;
-				}
-			}
+			if (old->entry[i].sock != sock)
+				len++;
+		}
+
+		if (len == old->len)
+			continue;
+
+		/* the socket must be removed: the allocation cannot fail */
+
+		work = pfq_tx_work_alloc(len, GFP_KERNEL | __GFP_NOFAIL);
+
+		for(i = 0, len = 0; i < old->len; i++)
+		{
+			if (old->entry[i].sock != sock)
+				work->entry[len++] = old->entry[i];
 		}
+
+		rcu_assign_pointer(data->work, work);
+
+		synchronize_rcu();
+		kfree(old);
 	}
 
         mutex_unlock(&pfq_thread_tx_pool_lock);
@@ -199,6 +333,21 @@ pfq_unbind_tx_thread(struct pfq_sock *sock)
 }
 
 
+int
+pfq_wakeup_tx_thread(int tid)
+{
+	struct task_struct *task;
+
+	if (tid < 0 || tid >= global->tx_cpu_nr)
+		return -ESRCH;
+
+	task = pfq_thread_tx_pool[tid].task;
+	if (task)
+		wake_up_process(task);
+	return 0;
+}
+
+
 int
 pfq_start_tx_threads(void)
 {
@@ -255,7 +404,6 @@ pfq_stop_tx_threads(void)
 
 			if (data->task)
 			{
-				int i;
 				pr_devel("[PFQ stopping Tx[%d] thread@%p\n", data->id, data->task);
 
 				kthread_stop(data->task);
@@ -263,11 +411,8 @@ pfq_stop_tx_threads(void)
 				data->cpu  = -1;
 				data->task = NULL;
 
-				for(i=0; i < Q_MAX_TX_QUEUES; ++i)
-				{
-					atomic_set(&data->sock_queue[i], -1);
-					data->sock[i] = NULL;
-				}
+				kfree(rcu_dereference_protected(data->work, 1));
+				RCU_INIT_POINTER(data->work, NULL);
 			}
 		}
 	}
@@ -29,6 +29,7 @@
 #include <linux/kthread.h>
 #include <linux/mutex.h>
 #include <linux/rwsem.h>
+#include <linux/rcupdate.h>
 
 
 struct pfq_sock;
@@ -39,6 +40,7 @@ extern int  pfq_start_tx_threads(void);
 extern void pfq_stop_tx_threads(void);
 extern int  pfq_bind_tx_thread(int tx_index, struct pfq_sock *sock, int sock_queue);
 extern int  pfq_unbind_tx_thread(struct pfq_sock *sock);
+extern int  pfq_wakeup_tx_thread(int tx_index);
 
 extern int pfq_check_threads_affinity(void);
 extern int pfq_check_napi_contexts(void);
@@ -51,6 +53,20 @@ struct pfq_thread_data
 };
 
 
+/* socket queues served by a Tx thread (replaced as a whole, under RCU) */
+
+struct pfq_thread_tx_work
+{
+	size_t			len;
+	struct
+	{
+		struct pfq_sock *sock;
+		int		 queue;
+
+	} entry[];
+};
+
+
 struct pfq_thread_tx_data
 {
 	int			id;
@@ -59,8 +75,7 @@ struct pfq_thread_tx_data
 
 	/* specific for Tx data */
 
-	struct pfq_sock *	sock[Q_MAX_TX_QUEUES];
-	atomic_t		sock_queue[Q_MAX_TX_QUEUES];
+	struct pfq_thread_tx_work __rcu *work;
 
 } ____pfq_cacheline_aligned;
 
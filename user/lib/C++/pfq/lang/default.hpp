@@ -222,6 +222,10 @@ namespace pfq { namespace lang {
 
         auto is_ip          = predicate ("is_ip");
 
+        //! Evaluate to \c true if the Qbuff is an IPv6 packet.
+
+        auto is_ip6         = predicate ("is_ip6");
+
         //! Evaluate to \c true if the Qbuff is an UDP packet.
 
         auto is_udp         = predicate ("is_udp");
@@ -230,7 +234,7 @@ namespace pfq { namespace lang {
 
         auto is_tcp         = predicate ("is_tcp");
 
-        //! Evaluate to \c true if the Qbuff is an ICMP packet.
+        //! Evaluate to \c true if the Qbuff is an ICMP (or ICMPv6) packet.
 
         auto is_icmp        = predicate ("is_icmp");
 
@@ -560,6 +564,18 @@ namespace pfq { namespace lang {
 
         auto steer_flow = function("steer_flow");
 
+        //! Dispatch the packet across the sockets, keeping IP fragments together.
+        /*!
+         * Like steer_flow, but the fragments of a datagram are steered on
+         * (src, dst, proto, ip_id). With a non-zero table size, a per-CPU table
+         * of that many entries remembers the flow of the first fragment, so that
+         * the trailing ones follow it to the same socket. Example:
+         *
+         * steer_frag (256)
+         */
+
+        auto steer_frag = [] (int entries) { return function("steer_frag", entries); };
+
         //! Dispatch the packet across the sockets
         /*!
          * Dispatch with a randomized algorithm that guarantees
@@ -663,6 +679,10 @@ namespace pfq { namespace lang {
 
         auto ip             = function("ip");
 
+        //! Evaluate to \c Pass Qbuff if it is an IPv6 packet, \c Drop it otherwise.
+
+        auto ip6            = function("ip6");
+
         //! Evaluate to \c Pass Qbuff if it is an UDP packet, \c Drop it otherwise.
 
         auto udp            = function("udp");
@@ -671,7 +691,7 @@ namespace pfq { namespace lang {
 
         auto tcp            = function("tcp");
 
-        //! Evaluate to \c Pass Qbuff if it is an ICMP packet, \c Drop it otherwise.
+        //! Evaluate to \c Pass Qbuff if it is an ICMP (or ICMPv6) packet, \c Drop it otherwise.
 
         auto icmp           = function("icmp");
 
@@ -736,6 +756,24 @@ namespace pfq { namespace lang {
 
         auto classify       = [] (int value) { return function("classify", value); };
 
+        //! Specify the class for the given packet, looked up by key in a class table of the group.
+        /*!
+         * The key is the value of the property, the table is updated by means of
+         * socket::set_group_class_entry. Packets whose key is not found are dropped.
+         *
+         * Example:
+         *
+         * class_table (0, ip_tos)
+         */
+
+        template <typename P>
+        auto class_table(int table, P const &prop)
+            -> decltype(function(nullptr, table, prop))
+        {
+            static_assert(is_property<P>::value, "class_table: argument 2: property expected");
+            return function("class_table", table, prop);
+        }
+
         //! Unit operation implements left- and right-identity for Action monad.
 
         auto unit           = function("unit");
@@ -859,6 +897,26 @@ namespace pfq { namespace lang {
 
         auto mark           = [] (uint32_t value) { return function("mark", value); };
 
+        //! Copy at most the given number of bytes (at least 1) of the packet to the sockets of the group.
+        /*!
+         * The socket caplen still applies. The snap is per socket: a socket that
+         * receives the packet from more groups gets the largest snap of them, and
+         * the whole packet if any of them does not snap it. Example:
+         *
+         * when (is_tcp, snap (128))
+         */
+
+        auto snap           = [] (int len) { return function("snap", len); };
+
+        //! Copy the headers up to the transport layer plus the given number of bytes of payload.
+        /*!
+         * Packets that are not IP are copied in full. Example:
+         *
+         * unless (is_udp, snap_l4 (0))
+         */
+
+        auto snap_l4        = [] (int len) { return function("snap_l4", len); };
+
         //! Set the state of the computation to the given value.
         /*
          * Example:
@@ -886,6 +944,53 @@ namespace pfq { namespace lang {
 
         auto dec            = [] (int value) { return function("dec", value); };
 
+        //! Limit the rate of packets (per second) by means of a token bucket.
+        /*!
+         * Packets exceeding the rate are dropped and counted in the given
+         * counter of the group (-1 to disable). The rate is evenly split among the
+         * cpus online when the computation is loaded; cpus brought online later
+         * get a share as well.
+         *
+         * Example:
+         *
+         * limit_pps (1000000, 0) >> steer_flow
+         */
+
+        auto limit_pps      = [] (uint64_t rate, int counter) { return function("limit_pps", rate, counter); };
+
+        //! Limit the rate of bits (per second) by means of a token bucket.
+        /*!
+         * Packets exceeding the rate are dropped and counted in the given
+         * counter of the group (-1 to disable). The rate is evenly split among the
+         * cpus online when the computation is loaded; cpus brought online later
+         * get a share as well.
+         *
+         * Example:
+         *
+         * limit_bps (1000000000, 0)
+         */
+
+        auto limit_bps      = [] (uint64_t rate, int counter) { return function("limit_bps", rate, counter); };
+
+        //! Sample one packet out of n, the others are dropped and counted in the given counter (-1 to disable).
+        /*!
+         * Example:
+         *
+         * sample (100, 1)
+         */
+
+        auto sample         = [] (int n, int counter) { return function("sample", n, counter); };
+
+        //! Sample one flow out of n (by hash), the others are dropped and counted in the given counter (-1 to disable).
+        /*!
+         * IP fragments are sampled by addresses and protocol only, and may not share
+         * the fate of the unfragmented packets of their flow. Example:
+         *
+         * sample_hash (100, 1)
+         */
+
+        auto sample_hash    = [] (int n, int counter) { return function("sample_hash", n, counter); };
+
         //! Monadic version of \c is_l3_proto predicate.
         /*!
          * Predicates are used in conditional expressions, while monadic functions
@@ -95,6 +95,17 @@ namespace pfq { namespace lang { namespace experimental {
             return function("steer_gtp_usr", ipv4_t{net}, prefix);
         };
 
+        //! Dispatch the packet across the sockets on the innermost flow.
+        /*!
+         * Tunnels (IP-in-IP, GRE, GTP-U, VXLAN and MPLS) are decapsulated
+         * and the symmetric hash is computed on the 5-tuple of the innermost
+         * IP header; non-tunneled traffic is steered by its own flow. Example:
+         *
+         * steer_inner_flow
+         */
+
+        auto steer_inner_flow = function("steer_inner_flow");
+
         //! Additional functions..
 
         auto shift = function("shift");
@@ -49,6 +49,7 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/epoll.h>
 
 #include <pfq/pfq-int.h>
 #include <pfq/pfq.h>
@@ -96,6 +97,22 @@ namespace pfq {
         static constexpr int anytag = Q_VLAN_ANYTAG;
     };
 
+    //! timestamp precision.
+    /*!
+     * Per-packet wall clock (on), wall clock shared by the capture batch (batch)
+     * raw TSC (tsc), to be converted with socket::tsc_to_nsec, or hardware
+     * timestamp (hw), when provided by the NIC (see Q_PKTHDR_HW_TSTAMP).
+     */
+
+    struct tstamp
+    {
+        static constexpr int off   = Q_TSTAMP_OFF;
+        static constexpr int on    = Q_TSTAMP_ON;
+        static constexpr int batch = Q_TSTAMP_BATCH;
+        static constexpr int tsc   = Q_TSTAMP_TSC;
+        static constexpr int hw    = Q_TSTAMP_HW;
+    };
+
     //! integer constants...
     //!
 
@@ -104,6 +121,7 @@ namespace pfq {
     static constexpr int any_group   = Q_ANY_GROUP;
     static constexpr int no_kthread  = Q_NO_KTHREAD;
     static constexpr int any_kthread = Q_ANY_KTHREAD;
+    static constexpr int rr_kthread  = Q_RR_KTHREAD;
 
     //////////////////////////////////////////////////////////////////////
 
@@ -471,6 +489,32 @@ namespace pfq {
             return as<bool>(q, pfq_is_timestamping_enabled(q));
         }
 
+        //! Specify the timestamp precision (see tstamp).
+
+        void
+        timestamping_precision(int value)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_timestamping_enable(q, value));
+        }
+
+        //! Return the timestamp precision.
+
+        int
+        timestamping_precision() const
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_is_timestamping_enabled(q));
+        }
+
+        //! Convert a TSC timestamp (tstamp::tsc) to nanoseconds since the Epoch.
+
+        uint64_t
+        tsc_to_nsec(uint64_t tsc) const
+        {
+            return pfq_tsc_to_nsec(this->data(), tsc);
+        }
+
         //! Set the weight of the socket for the steering phase.
 
         void
@@ -547,6 +591,27 @@ namespace pfq {
             return data()->rx_slot_size;
         }
 
+        //! Enable/disable the packed Rx queue (variable-length slots).
+        /*!
+         * Packed mode must be set before the socket is enabled.
+         */
+
+        void
+        rx_packed(bool value)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_rx_packed(q, value));
+        }
+
+        //! Check whether the Rx queue is packed.
+
+        bool
+        rx_packed() const
+        {
+            auto q = this->data();
+            return as<bool>(q, pfq_is_rx_packed(q));
+        }
+
         //! Specify the length of the Tx queue, in number of packets.
 
         void
@@ -564,6 +629,28 @@ namespace pfq {
            return data()->tx_slots;
         }
 
+        //! Enable/disable the zero-copy transmission from the shared queue.
+        /*!
+         * A slot of the Tx queue is reused only when the driver has completed
+         * the transmission of its packet.
+         */
+
+        void
+        tx_zcopy(bool value)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_tx_zcopy(q, value));
+        }
+
+        //! Check whether the zero-copy transmission is enabled.
+
+        bool
+        tx_zcopy() const
+        {
+            auto q = this->data();
+            return as<bool>(q, pfq_is_tx_zcopy(q));
+        }
+
 
         //! Bind the main group of the socket to the given device/queue.
         /*!
@@ -637,6 +724,10 @@ namespace pfq {
          *  The tid parameter specifies the index (id) of the transmitter
          *  thread. If 'no_kthread' specified, bind refers to synchronous
          *  transmissions.
+         *
+         *  The memory of asynchronous queues is allocated by 'enable', therefore
+         *  binding a Tx thread to an enabled socket fails: bind all the
+         *  Tx threads before enabling the socket.
          */
 
         void
@@ -818,6 +909,59 @@ namespace pfq {
             throw_if(q, pfq_group_fprog_reset(q, gid));
         }
 
+        //! Specify an eBPF program for the given group.
+        /*!
+         * The program is the file descriptor returned by bpf(BPF_PROG_LOAD),
+         * of socket filter type.
+         */
+
+        void
+        set_group_bpf_prog(int gid, int fd)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_bpf_prog(q, gid, fd));
+        }
+
+        //! Reset the eBPF program for the given group.
+
+        void
+        reset_group_bpf_prog(int gid)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_bpf_prog_reset(q, gid));
+        }
+
+        //! Map a key to a class in the given class table of the group.
+        /*!
+         * The tables are looked up by the pfq-lang function class_table,
+         * and can be updated while the computation is running.
+         */
+
+        void
+        set_group_class_entry(int gid, int table, uint64_t key, int class_id)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_class_table(q, gid, table, key, class_id));
+        }
+
+        //! Remove a key from the given class table of the group.
+
+        void
+        del_group_class_entry(int gid, int table, uint64_t key)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_class_table_del(q, gid, table, key));
+        }
+
+        //! Remove all the keys from the given class table of the group.
+
+        void
+        reset_group_class_table(int gid, int table)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_class_table_reset(q, gid, table));
+        }
+
 
         //! Wait for packets.
         /*!
@@ -830,6 +974,25 @@ namespace pfq {
             struct timespec timeout;
             struct pollfd fd = {data()->fd, POLLIN, 0 };
 
+            // busy-poll the shared queue before sleeping in the kernel
+            //
+
+            if (data_->poll_spin > 0 && data_->shm_addr)
+            {
+                auto q = static_cast<struct pfq_shared_queue *>(data_->shm_addr);
+                auto spin = (microseconds >= 0 && microseconds < data_->poll_spin) ? microseconds : data_->poll_spin;
+                auto stop = std::chrono::steady_clock::now() + std::chrono::microseconds(spin);
+
+                do {
+                    if (PFQ_SHARED_QUEUE_LEN(__atomic_load_n(&q->rx.shinfo, __ATOMIC_RELAXED)))
+                        return 0;
+                }
+                while (std::chrono::steady_clock::now() < stop);
+
+                if (microseconds >= 0)
+                    microseconds -= spin;
+            }
+
             if (microseconds >= 0) {
                 timeout.tv_sec  = microseconds / 1000000;
                 timeout.tv_nsec = (microseconds % 1000000) * 1000;
@@ -842,6 +1005,15 @@ namespace pfq {
             return 0;
         }
 
+        //! Set the busy-polling time of 'poll', in microseconds (default 0, no busy-polling).
+
+        void
+        poll_spin(long int microseconds)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_poll_spin(q, microseconds));
+        }
+
         //! Read packets in place.
         /*!
          * Wait for packets and return a 'queue' descriptor, which contains
@@ -874,22 +1046,22 @@ namespace pfq {
 
             qver = PFQ_SHARED_QUEUE_VER(data);
 
-            // at wrap-around reset Rx slots...
+            // zero-copy forward: the half given back to producers is held until its packets are transmitted
             //
 
-            if (unlikely(((qver+1) & (PFQ_SHARED_QUEUE_VER_MASK^1))== 0))
-            {
-                auto raw = static_cast<char *>(data_->rx_queue_addr) + ((qver+1) & 1) * data_->rx_queue_size;
-                auto end = raw + data_->rx_queue_size;
-                const pfq_qver_t rst = qver & 1;
-                for(; raw < end; raw += data_->rx_slot_size)
-                    reinterpret_cast<pfq_pkthdr *>(raw)->info.commit = rst;
-            }
+            if (unlikely(__atomic_load_n(&q->rx.fwd_pending[(qver+1) & 1], __ATOMIC_ACQUIRE)))
+                return net_queue();
+
+            if (data_->rx_packed)
+                return read_packed(q, qver);
 
-            // swap the net_queue...
+            auto epoch = next_epoch(q, qver);
+
+            // swap the net_queue (release semantic: producers get the epoch along with the version,
+            // acquire semantic: the epoch of the next round is not published before the swap)...
             //
 
-            data = __atomic_exchange_n(&q->rx.shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_RELAXED);
+            data = __atomic_exchange_n(&q->rx.shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_ACQ_REL);
 
             auto queue_len = std::min( static_cast<size_t>(PFQ_SHARED_QUEUE_LEN(data))
                                       , data_->rx_slots);
@@ -897,17 +1069,64 @@ namespace pfq {
             return net_queue( static_cast<char *>(data_->rx_queue_addr) + (qver & 1) * data_->rx_queue_size
                             , data_->rx_slot_size
                             , queue_len
-                            , qver);
+                            , epoch);
+        }
+
+    private:
+
+        //! Publish the commit epoch of the next half of the queue and return the current one.
+        /*!
+         * Epochs grow monotonically and skip 0, the value of slots never committed:
+         * no slot reset is required at the wrap-around of the queue version.
+         */
+
+        static uint32_t
+        next_epoch(struct pfq_shared_queue *q, unsigned long int qver)
+        {
+            uint32_t epoch = __atomic_load_n(&q->rx.epoch[qver & 1], __ATOMIC_RELAXED);
+            uint32_t next  = epoch + 1;
+
+            __atomic_store_n(&q->rx.epoch[(qver+1) & 1], likely(next) ? next : 1, __ATOMIC_RELAXED);
+            return epoch;
+        }
+
+        net_queue
+        read_packed(struct pfq_shared_queue *q, unsigned long int qver)
+        {
+            // reset the commit counters of the next half, then swap the net_queue...
+            //
+
+            auto epoch = next_epoch(q, qver);
+
+            __atomic_store_n(&q->rx.commit_len[(qver+1) & 1], 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&q->rx.commit_pkt[(qver+1) & 1], 0, __ATOMIC_RELAXED);
+
+            auto data = __atomic_exchange_n(&q->rx.shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_ACQ_REL);
+
+            // wait for the producers to complete the reserved slots...
+            //
+
+            auto units = static_cast<unsigned int>(PFQ_SHARED_QUEUE_LEN(data));
+            while (__atomic_load_n(&q->rx.commit_len[qver & 1], __ATOMIC_ACQUIRE) != units)
+                std::this_thread::yield();
+
+            return net_queue( static_cast<char *>(data_->rx_queue_addr) + (qver & 1) * data_->rx_queue_size
+                            , __atomic_load_n(&q->rx.commit_pkt[qver & 1], __ATOMIC_RELAXED)
+                            , static_cast<size_t>(units) * PFQ_SLOT_ALIGNMENT
+                            , epoch
+                            , true);
         }
 
-        //! Return the current commit version (used internally by the memory mapped queue).
+    public:
+
+        //! Return the current commit epoch (used internally by the memory mapped queue).
 
-        pfq_qver_t
+        uint32_t
         current_commit() const
         {
             auto q = static_cast<struct pfq_shared_queue *>(data_->shm_addr);
             auto data = __atomic_load_n(&q->rx.shinfo, __ATOMIC_RELAXED);
-            return static_cast<pfq_qver_t>(PFQ_SHARED_QUEUE_VER(data));
+            return __atomic_load_n(&q->rx.epoch[PFQ_SHARED_QUEUE_VER(data) & 1], __ATOMIC_RELAXED);
         }
 
         //! Receive packets in the given buffer.
@@ -929,7 +1148,9 @@ namespace pfq {
             if (buff.second < data_->rx_slots * data_->rx_slot_size)
                 throw system_error("PFQ: buffer too small");
 
-            memcpy(buff.first, this_queue.data(), this_queue.slot_size() * this_queue.size());
+            memcpy(buff.first, this_queue.data(), this_queue.size_bytes());
+            if (this_queue.packed())
+                return net_queue(buff.first, this_queue.size(), this_queue.size_bytes(), this_queue.index(), true);
             return net_queue(buff.first, this_queue.slot_size(), this_queue.size(), this_queue.index());
         }
 
@@ -953,7 +1174,7 @@ namespace pfq {
             for(; it != it_e; ++it)
             {
                 while (!it.ready())
-                    std::this_thread::yield();
+                    relax();
 
                 callback(user, &(*it), reinterpret_cast<const char *>(it.data()));
                 n++;
@@ -961,6 +1182,27 @@ namespace pfq {
             return n;
         }
 
+        //! Collect and process packets in batches.
+        /*!
+         * The callback is invoked once per span of packets ready to be read (see 'ready_spans'),
+         * with the signature: void(char *user, ready_spans::span const &).
+         * Return the number of packets processed.
+         */
+
+        template <typename Fun>
+        size_t dispatch_batch(Fun callback, long int microseconds = -1, char *user = nullptr)
+        {
+            auto many = this->read(microseconds);
+
+            size_t n = 0;
+            for(auto const &span : ready_spans(many))
+            {
+                callback(user, span);
+                n += span.size();
+            }
+            return n;
+        }
+
         //! Enable/disable vlan filtering for the given group.
 
         void vlan_filters_enable(int gid, bool toggle)
@@ -1041,6 +1283,76 @@ namespace pfq {
             return std::vector<unsigned long>(std::begin(cs.counter), std::end(cs.counter));
         }
 
+        //! Return the socket statistics from the shared memory (no syscall).
+        /*!
+         * The snapshot is refreshed by the kernel every Q_CTRL_STATS_PERIOD msec
+         * and by 'ctrl_doorbell'.
+         */
+
+        pfq_stats
+        shared_stats() const
+        {
+            pfq_stats stat;
+            auto q = this->data();
+            throw_if(q, pfq_get_shared_stats(q, &stat));
+            return stat;
+        }
+
+        //! Return the statistics of a watched group from the shared memory (no syscall).
+
+        pfq_stats
+        shared_group_stats(int gid) const
+        {
+            pfq_stats stat;
+            auto q = this->data();
+            throw_if(q, pfq_get_shared_group_stats(q, gid, &stat, nullptr));
+            return stat;
+        }
+
+        //! Return the counters of a watched group from the shared memory (no syscall).
+
+        std::vector<unsigned long>
+        shared_group_counters(int gid) const
+        {
+            pfq_counters cs;
+            auto q = this->data();
+            throw_if(q, pfq_get_shared_group_stats(q, gid, nullptr, &cs));
+            return std::vector<unsigned long>(std::begin(cs.counter), std::end(cs.counter));
+        }
+
+        //! Submit a command to the shared control ring (Q_CTRL_*).
+        /*!
+         * Commands are executed in batch by 'ctrl_doorbell', completions are
+         * retrieved by 'ctrl_complete'.
+         */
+
+        void
+        ctrl_submit(int op, int arg, uint64_t user_data = 0)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_ctrl_submit(q, op, arg, user_data));
+        }
+
+        //! Execute the commands submitted with a single syscall, return the number of commands executed.
+
+        int
+        ctrl_doorbell()
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_ctrl_doorbell(q));
+        }
+
+        //! Retrieve the completions of the control ring.
+
+        std::vector<pfq_ctrl_cqe>
+        ctrl_complete()
+        {
+            pfq_ctrl_cqe cqe[Q_CTRL_RING_LEN];
+            auto q = this->data();
+            auto n = as<int>(q, pfq_ctrl_complete(q, cqe, Q_CTRL_RING_LEN));
+            return std::vector<pfq_ctrl_cqe>(cqe, cqe + n);
+        }
+
         //! Return the memory size of the Rx queue.
 
         size_t
@@ -1059,7 +1371,9 @@ namespace pfq {
 
         //! Store the packet and transmit the packets in the queue.
         /*!
-         * The queue is flushed every sync packets.
+         * The queue is flushed every sync packets. When the queue is full it is flushed
+         * and the packet is stored again: false is returned if the slot is still in use
+         * (zero-copy transmission in progress).
          * Requires the socket is bound for transmission to a net device and queue.
          * See 'bind_tx'.
          */
@@ -1067,24 +1381,123 @@ namespace pfq {
         bool
         send(const_buffer pkt, size_t copies = 1, unsigned int sync = 1)
         {
-            retry:
             auto ret = send_raw(pkt.first, pkt.second, 0, copies, no_kthread);
             if (!ret || ++data_->tx_attempt == sync)
             {
                 data_->tx_attempt = 0;
                 this->sync_queue(0);
                 if (!ret) {
-                    goto retry;
+                    ret = send_raw(pkt.first, pkt.second, 0, copies, no_kthread);
                 }
             }
             return ret;
         }
 
+        //! Schedule the transmission of a range of packets (const_buffer).
+        /*!
+         * The packets are copied into consecutive slots of a single Tx queue and published
+         * at once ('async' as in 'send_raw'; with any_kthread the queue is selected by the flow
+         * hash of the first packet). Return the number of packets stored, less than the size
+         * of the range when the queue is full. The synchronous queue is not flushed (see 'sync_queue').
+         */
+
+        template <typename Range>
+        auto send(Range const &pkts, unsigned int copies = 1, int async = no_kthread)
+            -> decltype(static_cast<const_buffer>(*std::begin(pkts)), size_t())
+        {
+            if (unlikely(!data_->shm_addr))
+                throw system_error("PFQ: send: socket not enabled");
+
+            auto it = std::begin(pkts), it_end = std::end(pkts);
+            if (it == it_end)
+                return 0;
+
+            int tss;
+
+            auto tx = [&] {
+                if (async != no_kthread) {
+                    if (unlikely(data_->tx_num_async == 0))
+                        throw system_error("PFQ: send: socket not bound to async threads");
+                    tss = async_queue(static_cast<const_buffer>(*it).first, async);
+                    return &static_cast<struct pfq_shared_queue *>(data_->shm_addr)->tx_async[tss];
+                }
+
+                tss = -1;
+                return &static_cast<struct pfq_shared_queue *>(data_->shm_addr)->tx;
+            }();
+
+            char * base_addr = static_cast<char *>(data_->tx_queue_addr) + data_->tx_queue_size * static_cast<size_t>(1+tss);
+
+            auto offset = tx->prod.off;
+            size_t n = 0;
+
+            for(; it != it_end; ++it, ++n)
+            {
+                auto pkt = static_cast<const_buffer>(*it);
+                auto hdr = reinterpret_cast<struct pfq_pkthdr *>(base_addr + offset);
+
+                if (unlikely(__atomic_load_n(&hdr->info.commit, __ATOMIC_ACQUIRE)))
+                    break;
+
+                __builtin_prefetch(reinterpret_cast<char *>(hdr) + data_->tx_slot_size, 1);
+
+                auto caplen = std::min(pkt.second, data_->tx_slot_size - sizeof(struct pfq_pkthdr));
+
+                hdr->tstamp.tv64      = 0;
+                hdr->len              = static_cast<uint16_t>(pkt.second);
+                hdr->caplen           = static_cast<uint16_t>(caplen);
+                hdr->info.data.copies = copies;
+                hdr->info.flags       = 0;
+                hdr->info.commit      = 1;
+
+                memcpy(hdr+1, pkt.first, caplen);
+
+                offset += static_cast<ptrdiff_t>(data_->tx_slot_size);
+                if (static_cast<size_t>(offset) >= data_->tx_queue_size)
+                    offset = 0;
+            }
+
+            if (unlikely(n == 0))
+                return 0;
+
+            // publish the whole batch with a single release store
+            //
+
+            tx->prod.off = offset;
+
+            __atomic_store_n(&tx->prod.head, tx->prod.head + n, __ATOMIC_RELEASE);
+
+            if (tss >= 0)
+            {
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                if (unlikely(__atomic_load_n(&tx->cons.need_wakeup, __ATOMIC_RELAXED)))
+                    this->sync_queue(1 + tss);
+            }
+
+            return n;
+        }
+
+
+
+        //! Set the number of packets sent to an async queue before moving to the next one (rr_kthread).
+        /*!
+         * With 'rr_kthread' a single stream of packets is spread in round-robin over the
+         * async queues of the socket, e.g. bound to different hardware queues of a device,
+         * each drained by its own PFQ kernel thread.
+         */
+
+        void
+        tx_rr_batch(size_t value)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_tx_rr_batch(q, value));
+        }
 
         //! Transmit the packet asynchronously.
         /*!
          * The transmission is handled by PFQ kernel threads.
          * Requires the socket is bound for transmission to one (or multiple) PFQ kernel threads.
+         * The queue is selected by flow hash (any_kthread), in round-robin (rr_kthread) or by index.
          * See 'bind_tx'.
          */
 
@@ -1094,6 +1507,43 @@ namespace pfq {
             return send_raw(pkt.first, pkt.second, 0, copies, async);
         }
 
+        //! Forward a packet received by another socket, without copying it.
+        /*!
+         * The packet is referenced in place in the Rx queue of 'rx' (owned by the same user):
+         * reads on 'rx' return no packets until the forwarded packets are transmitted (see 'sync_queue').
+         * Packets that are not in the Rx queue of 'rx' are copied.
+         * Return false if the next Tx slot is not yet released by the kernel.
+         */
+
+        bool
+        forward(socket const &rx, pfq_pkthdr const &h, const char *buf, unsigned int copies = 1, int async = no_kthread)
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_forward(q, rx.data(), &h, buf, copies, async)) > 0;
+        }
+
+    private:
+
+        int
+        async_queue(const char *buf, int async)
+        {
+            switch(async)
+            {
+            case any_kthread:
+                return static_cast<int>(fold(symmetric_hash(buf), static_cast<uint32_t>(data_->tx_num_async)));
+            case rr_kthread:
+                if (++data_->tx_rr_count > data_->tx_rr_batch) {
+                    data_->tx_rr_count = 1;
+                    data_->tx_rr_queue++;
+                }
+                return static_cast<int>(data_->tx_rr_queue % data_->tx_num_async);
+            }
+
+            return static_cast<int>(fold(static_cast<uint32_t>(async), static_cast<uint32_t>(data_->tx_num_async)));
+        }
+
+    public:
+
         //! Schedule a packet transmission.
         /*!
          * The packet is copied into a Tx queue. If 'async' is true and 'queue' is set to any_queue, a TSS symmetric hash
@@ -1112,7 +1562,6 @@ namespace pfq {
             if (unlikely(!data_->shm_addr))
                 throw system_error("PFQ: send: socket not enabled");
 
-            ptrdiff_t *poff_addr;
             uint16_t caplen;
             int tss;
 
@@ -1120,8 +1569,7 @@ namespace pfq {
                 if (async != no_kthread) {
                     if (unlikely(data_->tx_num_async == 0))
                         throw system_error("PFQ: send: socket not bound to async threads");
-                    tss = static_cast<int>(fold(async == any_kthread ?
-                                                symmetric_hash(buf) : static_cast<uint32_t>(async), static_cast<uint32_t>(data_->tx_num_async)));
+                    tss = async_queue(buf, async);
                     return &static_cast<struct pfq_shared_queue *>(data_->shm_addr)->tx_async[tss];
                 }
 
@@ -1129,28 +1577,16 @@ namespace pfq {
                 return &static_cast<struct pfq_shared_queue *>(data_->shm_addr)->tx;
             }();
 
-            // swap the queue...
-            //
+            char * base_addr = static_cast<char *>(data_->tx_queue_addr) + data_->tx_queue_size * static_cast<size_t>(1+tss);
 
-            auto index = __atomic_load_n(&tx->cons.index, __ATOMIC_RELAXED);
-            if (index == __atomic_load_n(&tx->prod.index, __ATOMIC_RELAXED))
-            {
-                ++index;
+            auto offset = tx->prod.off;
+            auto hdr = reinterpret_cast<struct pfq_pkthdr *>(base_addr + offset);
 
-                poff_addr = (index & 1) ? &tx->prod.off1 : &tx->prod.off0;
-                __atomic_store_n(poff_addr, 0, __ATOMIC_RELEASE);
-                __atomic_store_n(&tx->prod.index, index, __ATOMIC_RELEASE);
-            }
-            else
-            {
-                poff_addr = (index & 1) ? &tx->prod.off1 : &tx->prod.off0;
-            }
-
-            char * base_addr = static_cast<char *>(data_->tx_queue_addr) + data_->tx_queue_size * static_cast<size_t>(2 * (1+tss) + (index & 1 ? 1 : 0));
-
-            // get the current offset...
+            // the slot is busy until released by the kernel (copied or, with zero-copy, completed)
             //
-            auto offset = __atomic_load_n(poff_addr, __ATOMIC_RELAXED);
+
+            if (unlikely(__atomic_load_n(&hdr->info.commit, __ATOMIC_ACQUIRE)))
+                return false;
 
             // cut the packet to xmitlen:
             //
@@ -1158,31 +1594,38 @@ namespace pfq {
             caplen = static_cast<uint16_t>(
                     std::min(len, data_->tx_slot_size - sizeof(struct pfq_pkthdr)));
 
+            hdr->tstamp.tv64      = nsec;
+            hdr->len              = static_cast<uint16_t>(len);
+            hdr->caplen           = static_cast<uint16_t>(caplen);
+            hdr->info.data.copies = copies;
+            hdr->info.flags       = 0;
+            hdr->info.commit      = 1;
 
-            // ensure there's enough space for the current packet
-            //
-            if (likely((static_cast<size_t>(offset) + data_->tx_slot_size) < data_->tx_queue_size))
-            {
-                auto hdr = (struct pfq_pkthdr *)(base_addr + offset);
+            memcpy(hdr+1, buf, caplen);
 
-                hdr->tstamp.tv64      = nsec;
-                hdr->len              = static_cast<uint16_t>(len);
-                hdr->caplen           = static_cast<uint16_t>(caplen);
-                hdr->info.data.copies = copies;
+            offset += static_cast<ptrdiff_t>(data_->tx_slot_size);
+            tx->prod.off = static_cast<size_t>(offset) < data_->tx_queue_size ? offset : 0;
+
+            __atomic_store_n(&tx->prod.head, tx->prod.head + 1, __ATOMIC_RELEASE);
 
-			    memcpy(hdr+1, buf, caplen);
+            // ring the doorbell if the Tx thread is sleeping
+            //
 
-                __atomic_store_n(poff_addr, offset + static_cast<ptrdiff_t>(data_->tx_slot_size), __ATOMIC_RELEASE);
-                return true;
+            if (tss >= 0)
+            {
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                if (unlikely(__atomic_load_n(&tx->cons.need_wakeup, __ATOMIC_RELAXED)))
+                    this->sync_queue(1 + tss);
             }
 
-            return false;
+            return true;
         }
 
         //! Transmit the packets in the queue.
         /*!
          * Transmit the packets in the queue of the socket. 'queue = 0' is the
-         * queue of the socket enabled for synchronous transmission.
+         * queue of the socket enabled for synchronous transmission; 'queue = n'
+         * wakes up the kernel thread of the n-th asynchronous queue.
          */
 
         void
@@ -1199,6 +1642,135 @@ namespace pfq {
     };
 
 
+    //! Set of sockets consumed by a single thread.
+    /*!
+     * The sockets of the set (not owned) are waited for with a single syscall
+     * (edge-triggered epoll) and read in round-robin.
+     */
+
+    class socket_set
+    {
+    public:
+
+        socket_set()
+        : epfd_(::epoll_create1(EPOLL_CLOEXEC))
+        , next_(0)
+        {
+            if (epfd_ == -1)
+                throw system_error(errno, "PFQ: set: epoll_create");
+        }
+
+        ~socket_set()
+        {
+            ::close(epfd_);
+        }
+
+        socket_set(const socket_set &) = delete;
+        socket_set& operator=(const socket_set &) = delete;
+
+        //! Add an enabled socket to the set.
+
+        void
+        add(socket &s)
+        {
+            if (std::find(sockets_.begin(), sockets_.end(), &s) != sockets_.end())
+                throw system_error("PFQ: set: socket already added");
+
+            struct epoll_event ev;
+            ev.events = EPOLLIN | EPOLLET;
+            ev.data.ptr = &s;
+
+            if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, s.fd(), &ev) == -1)
+                throw system_error(errno, "PFQ: set: epoll_ctl");
+
+            sockets_.push_back(&s);
+        }
+
+        //! Remove a socket from the set.
+
+        void
+        remove(socket &s)
+        {
+            auto it = std::find(sockets_.begin(), sockets_.end(), &s);
+            if (it == sockets_.end())
+                throw system_error("PFQ: set: socket not found");
+
+            ::epoll_ctl(epfd_, EPOLL_CTL_DEL, s.fd(), nullptr);
+
+            if (static_cast<size_t>(std::distance(sockets_.begin(), it)) < next_)
+                next_--;
+
+            sockets_.erase(it);
+        }
+
+        //! Return the number of sockets in the set.
+
+        size_t
+        size() const
+        {
+            return sockets_.size();
+        }
+
+        //! Read packets from the set.
+        /*!
+         * The queue of the first non-empty socket, starting from the one that follows
+         * the socket of the previous read, is read in place. When all the queues are empty,
+         * wait for the sockets with a single epoll_wait (timeout in microseconds).
+         * Return the socket (nullptr if no packets are available) and its queue.
+         */
+
+        std::pair<socket *, net_queue>
+        read(long int microseconds = -1)
+        {
+            if (sockets_.empty())
+                throw system_error("PFQ: set: empty set");
+
+            auto ret = read_any();
+            if (ret.first)
+                return ret;
+
+            struct epoll_event events[16];
+
+            if (::epoll_wait(epfd_, events, 16, microseconds < 0 ? -1 : static_cast<int>((microseconds + 999) / 1000)) < 0
+                    && errno != EINTR)
+                throw system_error(errno, "PFQ: set: epoll_wait");
+
+            return read_any();
+        }
+
+    private:
+
+        std::pair<socket *, net_queue>
+        read_any()
+        {
+            auto size = sockets_.size();
+
+            for(size_t i = 0; i < size; i++)
+            {
+                auto idx = (next_ + i) % size;
+                auto s = sockets_[idx];
+                auto q = static_cast<struct pfq_shared_queue const *>(s->mem_addr());
+
+                if (!q || PFQ_SHARED_QUEUE_LEN(__atomic_load_n(&q->rx.shinfo, __ATOMIC_RELAXED)) == 0)
+                    continue;
+
+                auto many = s->read(0);
+                if (many.empty())
+                    continue;
+
+                next_ = idx + 1;
+                return std::make_pair(s, many);
+            }
+
+            return std::make_pair(nullptr, net_queue());
+        }
+
+        int epfd_;
+        size_t next_;
+        std::vector<socket *> sockets_;
+    };
+
+
     template <typename CharT, typename Traits>
     typename std::basic_ostream<CharT, Traits> &
     operator<<(std::basic_ostream<CharT,Traits> &out, const pfq_stats& rhs)
@@ -42,6 +42,10 @@ namespace pfq {
         struct const_iterator;
 
         //! Forward iterator over packets.
+        /*!
+         * A slot size of 0 denotes a packed queue, where the size
+         * of each slot is computed from the caplen of the packet.
+         */
 
         struct iterator : public std::iterator<std::forward_iterator_tag, pfq_pkthdr>
         {
@@ -60,8 +64,11 @@ namespace pfq {
             iterator &
             operator++()
             {
-                hdr_ = reinterpret_cast<pfq_pkthdr *>(
-                        reinterpret_cast<char *>(hdr_) + slot_size_);
+                if (slot_size_)
+                    hdr_ = reinterpret_cast<pfq_pkthdr *>(
+                            reinterpret_cast<char *>(hdr_) + slot_size_);
+                else
+                    hdr_ = PFQ_SHARED_QUEUE_NEXT_PACKED_PKTHDR(hdr_);
                 return *this;
             }
 
@@ -131,13 +138,18 @@ namespace pfq {
             : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_)
             {}
 
+            const_iterator & operator=(const const_iterator &other) = default;
+
             ~const_iterator() = default;
 
             const_iterator &
             operator++()
             {
-                hdr_ = reinterpret_cast<pfq_pkthdr *>(
-                        reinterpret_cast<char *>(hdr_) + slot_size_);
+                if (slot_size_)
+                    hdr_ = reinterpret_cast<pfq_pkthdr *>(
+                            reinterpret_cast<char *>(hdr_) + slot_size_);
+                else
+                    hdr_ = PFQ_SHARED_QUEUE_NEXT_PACKED_PKTHDR(hdr_);
                 return *this;
             }
 
@@ -200,6 +212,7 @@ namespace pfq {
         : addr_(nullptr)
         , slot_size_(0)
         , queue_len_(0)
+        , queue_size_(0)
         , index_(0)
         {}
 
@@ -210,6 +223,18 @@ namespace pfq {
         : addr_(addr)
         , slot_size_(slot_size)
         , queue_len_(queue_len)
+        , queue_size_(queue_len * slot_size)
+        , index_(index)
+        {}
+
+        //! Constructor for packed queues (variable-length slots).
+        //
+
+        net_queue(void *addr, size_t queue_len, size_t queue_size, size_t index, bool /* packed */)
+        : addr_(addr)
+        , slot_size_(0)
+        , queue_len_(queue_len)
+        , queue_size_(queue_size)
         , index_(index)
         {}
 
@@ -246,7 +271,23 @@ namespace pfq {
             return index_;
         }
 
-        //! Return the size of the queue slot, in bytes.
+        //! Return the size of the queue, in bytes.
+
+        size_t
+        size_bytes() const
+        {
+            return queue_size_;
+        }
+
+        //! Check whether the queue is packed (variable-length slots).
+
+        bool
+        packed() const
+        {
+            return slot_size_ == 0;
+        }
+
+        //! Return the size of the queue slot, in bytes (0 for packed queues).
 
         size_t
         slot_size() const
@@ -290,7 +331,7 @@ namespace pfq {
         end()
         {
             return iterator(reinterpret_cast<pfq_pkthdr *>(
-                        static_cast<char *>(addr_) + queue_len_ * slot_size_), slot_size_, index_);
+                        static_cast<char *>(addr_) + queue_size_), slot_size_, index_);
         }
 
         //! Return a constant iterator past to the end of the queue.
@@ -299,7 +340,7 @@ namespace pfq {
         end() const
         {
             return const_iterator(reinterpret_cast<pfq_pkthdr *>(
-                        static_cast<char *>(addr_) + queue_len_ * slot_size_), slot_size_, index_);
+                        static_cast<char *>(addr_) + queue_size_), slot_size_, index_);
         }
 
         //! Return a constant iterator to the first slot of an non-empty queue.
@@ -319,23 +360,162 @@ namespace pfq {
         cend() const
         {
             return const_iterator(reinterpret_cast<pfq_pkthdr *>(
-                        static_cast<char *>(addr_) + queue_len_ * slot_size_), slot_size_, index_);
+                        static_cast<char *>(addr_) + queue_size_), slot_size_, index_);
         }
 
     private:
         void    *addr_;
         size_t  slot_size_;
         size_t  queue_len_;
+        size_t  queue_size_;
         size_t  index_;
     };
 
+    //! Pause the calling thread while spinning on a slot (cheaper than a yield).
+
+    inline void relax()
+    {
+#if defined(__i386__) || defined(__x86_64__)
+        asm volatile("rep; nop" ::: "memory");
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#else
+        asm volatile("" ::: "memory");
+#endif
+    }
+
+    //! A span of consecutive packets of a net_queue, all ready to be read.
+
+    template <typename Iter>
+    struct packet_span
+    {
+        Iter   first;
+        Iter   last;
+        size_t len;
+
+        Iter begin() const { return first; }
+        Iter end()   const { return last; }
+
+        size_t size() const { return len; }
+        bool  empty() const { return len == 0; }
+    };
+
+    //! Range adaptor over the ready prefixes of a net_queue.
+    /*!
+     * Iterating yields the longest spans of packets ready to be read: the
+     * slots ahead of the scan are prefetched and the iterator spins (without
+     * yielding the CPU) only at the tail of a span, on a slot not yet committed.
+     *
+     * for(auto span : pfq::ready_spans(queue))
+     *     for(auto &h : span) ...
+     */
+
+    class ready_spans
+    {
+    public:
+
+        static constexpr size_t prefetch_slots = 4;
+
+        using span = packet_span<net_queue::const_iterator>;
+
+        struct iterator
+        {
+            using iterator_category = std::input_iterator_tag;
+            using value_type        = span;
+            using difference_type   = std::ptrdiff_t;
+            using pointer           = span const *;
+            using reference         = span const &;
+
+            iterator(net_queue const &q, net_queue::const_iterator it)
+            : queue_(&q), cur_{it, it, 0}
+            {
+                next();
+            }
+
+            span const &
+            operator*() const
+            {
+                return cur_;
+            }
+
+            span const *
+            operator->() const
+            {
+                return &cur_;
+            }
+
+            iterator &
+            operator++()
+            {
+                cur_.first = cur_.last;
+                cur_.len = 0;
+                next();
+                return *this;
+            }
+
+            bool
+            operator==(iterator const &other) const
+            {
+                return cur_.first == other.cur_.first;
+            }
+
+            bool
+            operator!=(iterator const &other) const
+            {
+                return !(*this == other);
+            }
+
+        private:
+
+            void
+            next()
+            {
+                auto end = queue_->cend();
+                auto it = cur_.first;
+
+                if (it == end)
+                    return;
+
+                while (!it.ready())
+                    relax();
+
+                for(; it != end && it.ready(); ++it, ++cur_.len)
+                {
+                    if (queue_->slot_size())
+                    {
+                        auto ahead = reinterpret_cast<const char *>(&*it) + queue_->slot_size() * prefetch_slots;
+                        if (ahead < reinterpret_cast<const char *>(queue_->data()) + queue_->size_bytes()) {
+                            __builtin_prefetch(ahead);
+                            __builtin_prefetch(ahead + 64);
+                        }
+                    }
+                }
+
+                cur_.last = it;
+            }
+
+            net_queue const *queue_;
+            span cur_;
+        };
+
+        explicit ready_spans(net_queue const &q)
+        : queue_(q)
+        {}
+
+        iterator begin() const { return iterator(queue_, queue_.cbegin()); }
+        iterator end()   const { return iterator(queue_, queue_.cend()); }
+
+    private:
+        net_queue const &queue_;
+    };
+
     //! Return the pointer to the packet.
     /*!
      * Return the pointer to the packet, if the data is available to read;
      * return a nullptr otherwise.
      */
 
-    inline void * data_ready(pfq_pkthdr &h, uint16_t current_commit)
+    inline void * data_ready(pfq_pkthdr &h, uint32_t current_commit)
     {
         if (__atomic_load_n(&h.info.commit, __ATOMIC_ACQUIRE) != current_commit)
             return nullptr;
@@ -348,7 +528,7 @@ namespace pfq {
      * return a nullptr otherwise.
      */
 
-    inline const void * data_ready(pfq_pkthdr const &h, uint16_t current_commit)
+    inline const void * data_ready(pfq_pkthdr const &h, uint32_t current_commit)
     {
         if (__atomic_load_n(&h.info.commit, __ATOMIC_ACQUIRE) != current_commit)
             return nullptr;
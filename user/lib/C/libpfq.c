@@ -31,6 +31,7 @@
 #include <sys/ioctl.h>
 #include <sys/wait.h>
 #include <sys/mman.h>
+#include <sys/epoll.h>
 
 #include <net/if.h>
 #include <net/ethernet.h>
@@ -50,6 +51,7 @@
 #include <signal.h>
 #include <poll.h>
 #include <strings.h>
+#include <time.h>
 
 #include <linux/if_ether.h>
 #include <linux/pf_q.h>
@@ -168,6 +170,8 @@ pfq_open_group(unsigned long class_mask, int group_policy, size_t caplen, size_t
 	q->id = -1;
 	q->gid = -1;
 
+	q->tx_rr_batch = 32;
+
         memset(&q->nq, 0, sizeof(q->nq));
 
 	/* get id */
@@ -415,7 +419,7 @@ pfq_enable(pfq_t *q)
 	q->rx_queue_size = q->rx_slots * q->rx_slot_size;
 
 	q->tx_queue_addr = (char *)(q->shm_addr) + sizeof(struct pfq_shared_queue) + q->rx_queue_size * 2;
-	q->tx_queue_size = q->tx_slots * q->tx_slot_size;
+	q->tx_queue_size = q->tx_slots * q->tx_slot_size * 2;  /* ring of 2 x tx_slots slots */
 
 	return Q_OK(q);
 }
@@ -499,6 +503,37 @@ pfq_is_timestamping_enabled(pfq_t const *q)
 }
 
 
+uint64_t
+pfq_tsc_to_nsec(pfq_t const *q, uint64_t tsc)
+{
+	struct pfq_shared_queue * sq = (struct pfq_shared_queue *)q->shm_addr;
+	struct pfq_shared_tsc ref;
+	unsigned int seq;
+	int64_t delta;
+
+	if (!sq)
+		return 0;
+
+	/* the table is refreshed by the kernel: retry until a consistent copy is read */
+
+	do {
+		seq = __atomic_load_n(&sq->tsc.seq, __ATOMIC_ACQUIRE);
+		ref.cycles = sq->tsc.cycles;
+		ref.nsec   = sq->tsc.nsec;
+		ref.mult   = sq->tsc.mult;
+		ref.shift  = sq->tsc.shift;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}
+	while ((seq & 1) || seq != __atomic_load_n(&sq->tsc.seq, __ATOMIC_RELAXED));
+
+	delta = (int64_t)(tsc - ref.cycles);
+	if (delta >= 0)
+		return ref.nsec + (uint64_t)(((unsigned __int128)delta * ref.mult) >> ref.shift);
+
+	return ref.nsec - (uint64_t)(((unsigned __int128)(-delta) * ref.mult) >> ref.shift);
+}
+
+
 int
 pfq_set_weight(pfq_t *q, int value)
 {
@@ -663,6 +698,34 @@ pfq_get_rx_slot_size(pfq_t const *q)
 	return q->rx_slot_size;
 }
 
+
+int
+pfq_set_rx_packed(pfq_t *q, int value)
+{
+	int enabled = pfq_is_enabled(q);
+	if (enabled == 1) {
+		return Q_ERROR(q, "PFQ: enabled (Rx packed could not be set)");
+	}
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_RX_PACKED, &value, sizeof(value)) == -1) {
+		return Q_ERROR(q, "PFQ: set Rx packed error");
+	}
+
+	q->rx_packed = value ? 1 : 0;
+	return Q_OK(q);
+}
+
+
+int
+pfq_is_rx_packed(pfq_t const *q)
+{
+	int ret; socklen_t size = sizeof(int);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_RX_PACKED, &ret, &size) == -1) {
+	        return Q_ERROR(q, "PFQ: get Rx packed error");
+	}
+	return Q_VALUE(q, ret);
+}
+
 size_t
 pfq_get_tx_slot_size(pfq_t const *q)
 {
@@ -670,6 +733,28 @@ pfq_get_tx_slot_size(pfq_t const *q)
 }
 
 
+int
+pfq_set_tx_zcopy(pfq_t *q, int value)
+{
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_TX_ZCOPY, &value, sizeof(value)) == -1) {
+		return Q_ERROR(q, "PFQ: set Tx zero-copy error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_is_tx_zcopy(pfq_t const *q)
+{
+	int ret; socklen_t size = sizeof(int);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_TX_ZCOPY, &ret, &size) == -1) {
+	        return Q_ERROR(q, "PFQ: get Tx zero-copy error");
+	}
+	return Q_VALUE(q, ret);
+}
+
+
 int
 pfq_bind_group(pfq_t *q, int gid, const char *dev, int queue)
 {
@@ -1555,6 +1640,59 @@ pfq_group_fprog_reset(pfq_t *q, int gid)
 }
 
 
+int
+pfq_group_bpf_prog(pfq_t *q, int gid, int fd)
+{
+	struct pfq_so_bpf_prog prog = { gid, fd };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_BPF_PROG, &prog, sizeof(prog)) == -1) {
+		return Q_ERROR(q, "PFQ: set group bpf prog error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_bpf_prog_reset(pfq_t *q, int gid)
+{
+	if (pfq_group_bpf_prog(q, gid, -1) < 0)
+		return Q_ERROR(q, "PFQ: reset group bpf prog error");
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_class_table(pfq_t *q, int gid, int table, uint64_t key, int class_id)
+{
+	struct pfq_so_class_table ct = { .key = key, .gid = gid, .table = table, .class_id = class_id, .pad = 0 };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_CLASS_TABLE, &ct, sizeof(ct)) == -1) {
+		return Q_ERROR(q, "PFQ: set group class table error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_class_table_del(pfq_t *q, int gid, int table, uint64_t key)
+{
+	if (pfq_group_class_table(q, gid, table, key, Q_CLASS_TABLE_DEL) < 0)
+		return Q_ERROR(q, "PFQ: delete group class table key error");
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_class_table_reset(pfq_t *q, int gid, int table)
+{
+	if (pfq_group_class_table(q, gid, table, 0, Q_CLASS_TABLE_RESET) < 0)
+		return Q_ERROR(q, "PFQ: reset group class table error");
+	return Q_OK(q);
+}
+
+
 int
 pfq_join_group(pfq_t *q, int gid, unsigned long class_mask, int group_policy)
 {
@@ -1585,9 +1723,30 @@ pfq_leave_group(pfq_t *q, int gid)
 }
 
 
+static inline uint64_t
+pfq_monotonic_usec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+
+int
+pfq_set_poll_spin(pfq_t *q, long int microseconds)
+{
+	if (microseconds < 0)
+		return Q_ERROR(q, "PFQ: poll spin: bad value");
+
+	q->poll_spin = microseconds;
+	return Q_OK(q);
+}
+
+
 int
 pfq_poll(pfq_t *q, long int microseconds /* = -1 -> infinite */)
 {
+	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
 	struct timespec timeout;
 	struct pollfd fd = {q->fd, POLLIN, 0 };
         int ret;
@@ -1596,6 +1755,23 @@ pfq_poll(pfq_t *q, long int microseconds /* = -1 -> infinite */)
 		return Q_ERROR(q, "PFQ: socket not open");
 	}
 
+	/* busy-poll the shared queue before sleeping in the kernel */
+
+	if (q->poll_spin > 0 && qd != NULL) {
+
+		long int spin = (microseconds >= 0 && microseconds < q->poll_spin) ? microseconds : q->poll_spin;
+		uint64_t stop = pfq_monotonic_usec() + (uint64_t)spin;
+
+		do {
+			if (PFQ_SHARED_QUEUE_LEN(__atomic_load_n(&qd->rx.shinfo, __ATOMIC_RELAXED)))
+				return Q_OK(q);
+		}
+		while (pfq_monotonic_usec() < stop);
+
+		if (microseconds >= 0)
+			microseconds -= spin;
+	}
+
 	if (microseconds >= 0) {
 		timeout.tv_sec  = microseconds/1000000;
 		timeout.tv_nsec = (microseconds%1000000) * 1000;
@@ -1620,6 +1796,120 @@ pfq_get_stats(pfq_t const *q, struct pfq_stats *stats)
 }
 
 
+int
+pfq_get_shared_stats(pfq_t const *q, struct pfq_stats *stats)
+{
+	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
+	unsigned int seq;
+
+	if (unlikely(qd == NULL))
+		return Q_ERROR(q, "PFQ: shared stats: socket not enabled");
+
+	do {
+		seq = __atomic_load_n(&qd->ctrl.stats.seq, __ATOMIC_ACQUIRE);
+		*stats = qd->ctrl.stats.sock;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}
+	while ((seq & 1) || seq != __atomic_load_n(&qd->ctrl.stats.seq, __ATOMIC_RELAXED));
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_shared_group_stats(pfq_t const *q, int gid, struct pfq_stats *stats, struct pfq_counters *cs)
+{
+	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
+	unsigned int seq;
+	int n, found;
+
+	if (unlikely(qd == NULL))
+		return Q_ERROR(q, "PFQ: shared group stats: socket not enabled");
+
+	do {
+		seq = __atomic_load_n(&qd->ctrl.stats.seq, __ATOMIC_ACQUIRE);
+		found = 0;
+
+		for(n = 0; n < Q_CTRL_MAX_GROUPS; n++)
+		{
+			struct pfq_shared_group_stats const *gs = &qd->ctrl.stats.group[n];
+			if (gs->gid != gid)
+				continue;
+
+			if (stats)
+				*stats = gs->stats;
+			if (cs)
+				*cs = gs->counters;
+			found = 1;
+			break;
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}
+	while ((seq & 1) || seq != __atomic_load_n(&qd->ctrl.stats.seq, __ATOMIC_RELAXED));
+
+	if (!found)
+		return Q_ERROR(q, "PFQ: shared group stats: group not watched (see Q_CTRL_GROUP_WATCH)");
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_ctrl_submit(pfq_t *q, int op, int arg, uint64_t user_data)
+{
+	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
+	struct pfq_ctrl_sqe *sqe;
+	unsigned int head;
+
+	if (unlikely(qd == NULL))
+		return Q_ERROR(q, "PFQ: ctrl submit: socket not enabled");
+
+	head = qd->ctrl.sq.head;
+	if (head - __atomic_load_n(&qd->ctrl.sq.tail, __ATOMIC_ACQUIRE) >= Q_CTRL_RING_LEN)
+		return Q_ERROR(q, "PFQ: ctrl submit: ring full");
+
+	sqe = &qd->ctrl.sq.ring[head & (Q_CTRL_RING_LEN-1)];
+	sqe->op	       = (uint32_t)op;
+	sqe->arg       = arg;
+	sqe->user_data = user_data;
+
+	__atomic_store_n(&qd->ctrl.sq.head, head + 1, __ATOMIC_RELEASE);
+	return Q_OK(q);
+}
+
+
+int
+pfq_ctrl_doorbell(pfq_t *q)
+{
+	int ret = ioctl(q->fd, QIOCCTRL);
+	if (ret < 0)
+		return Q_ERROR(q, "PFQ: ctrl doorbell");
+	return Q_VALUE(q, ret);
+}
+
+
+int
+pfq_ctrl_complete(pfq_t *q, struct pfq_ctrl_cqe *cqe, size_t n)
+{
+	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
+	unsigned int head, tail;
+	size_t i;
+
+	if (unlikely(qd == NULL))
+		return Q_ERROR(q, "PFQ: ctrl complete: socket not enabled");
+
+	head = __atomic_load_n(&qd->ctrl.cq.head, __ATOMIC_ACQUIRE);
+	tail = qd->ctrl.cq.tail;
+
+	for(i = 0; i < n && tail != head; i++, tail++)
+		cqe[i] = qd->ctrl.cq.ring[tail & (Q_CTRL_RING_LEN-1)];
+
+	__atomic_store_n(&qd->ctrl.cq.tail, tail, __ATOMIC_RELEASE);
+	return Q_VALUE(q, (int)i);
+}
+
+
 int
 pfq_get_group_stats(pfq_t const *q, int gid, struct pfq_stats *stats)
 {
@@ -1681,11 +1971,60 @@ int pfq_vlan_reset_filter(pfq_t *q, int gid, int vid)
 }
 
 
+/* Publish the commit epoch of the next half of the Rx queue (before the swap)
+ * and return the one of the current half. Epochs grow monotonically and
+ * skip 0, the value of the slots never committed: no slot reset is required
+ * at the wrap-around of the queue version.
+ */
+
+static inline unsigned int
+pfq_next_epoch(struct pfq_shared_queue *qd, unsigned long int qver)
+{
+	unsigned int epoch = __atomic_load_n(&qd->rx.epoch[qver & 1], __ATOMIC_RELAXED);
+	unsigned int next  = epoch + 1;
+
+	__atomic_store_n(&qd->rx.epoch[(qver+1) & 1], likely(next) ? next : 1, __ATOMIC_RELAXED);
+	return epoch;
+}
+
+
+static int
+pfq_read_packed(pfq_t *q, struct pfq_shared_queue *qd, struct pfq_net_queue *nq, unsigned long int qver)
+{
+	unsigned long int data;
+	unsigned int units, epoch;
+
+	/* reset the commit counters of the next half, then swap the queue... */
+
+	epoch = pfq_next_epoch(qd, qver);
+
+	__atomic_store_n(&qd->rx.commit_len[(qver+1) & 1], 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&qd->rx.commit_pkt[(qver+1) & 1], 0, __ATOMIC_RELAXED);
+
+        data = __atomic_exchange_n(&qd->rx.shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_ACQ_REL);
+
+	/* wait for the producers to complete the reserved slots */
+
+	units = (unsigned int)PFQ_SHARED_QUEUE_LEN(data);
+	while (__atomic_load_n(&qd->rx.commit_len[qver & 1], __ATOMIC_ACQUIRE) != units)
+		pfq_relax();
+
+	nq->queue = (char *)(q->rx_queue_addr) + (qver & 1) * q->rx_queue_size;
+	nq->index = epoch;
+	nq->len   = __atomic_load_n(&qd->rx.commit_pkt[qver & 1], __ATOMIC_RELAXED);
+	nq->slot_size = 0;
+	nq->size  = (size_t)units * PFQ_SLOT_ALIGNMENT;
+
+	return Q_VALUE(q, (int)nq->len);
+}
+
+
 int
 pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
 {
 	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
 	unsigned long int data, qver;
+	unsigned int epoch;
 
         if (unlikely(qd == NULL)) {
 		return Q_ERROR(q, "PFQ: read: socket not enabled");
@@ -1700,33 +2039,38 @@ pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
 #else
 		(void)microseconds;
 		nq->len = 0;
+		nq->size = 0;
 		return Q_VALUE(q, (int)0);
 #endif
 	}
 
-        /* at wrap-around reset Rx slots... */
-
 	qver = PFQ_SHARED_QUEUE_VER(data);
 
-        if (unlikely(((qver+1) & (PFQ_SHARED_QUEUE_VER_MASK^1))== 0))
-        {
-            char * raw = (char *)(q->rx_queue_addr) + ((qver+1) & 1) * q->rx_queue_size;
-            char * end = raw + q->rx_queue_size;
-            const pfq_qver_t rst = qver & 1;
-            for(; raw < end; raw += q->rx_slot_size)
-                ((struct pfq_pkthdr *)raw)->info.commit = rst;
-        }
+	/* zero-copy forward: the half given back to producers is held until its packets are transmitted */
 
-	/* swap the queue... */
+	if (unlikely(__atomic_load_n(&qd->rx.fwd_pending[(qver+1) & 1], __ATOMIC_ACQUIRE))) {
+		nq->len = 0;
+		nq->size = 0;
+		return Q_VALUE(q, (int)0);
+	}
+
+	if (q->rx_packed)
+		return pfq_read_packed(q, qd, nq, qver);
+
+	epoch = pfq_next_epoch(qd, qver);
+
+	/* swap the queue (release semantic: producers get the epoch along with the version,
+	 * acquire semantic: the epoch of the next round is not published before the swap)... */
 
-        data = __atomic_exchange_n(&qd->rx.shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_RELAXED);
+        data = __atomic_exchange_n(&qd->rx.shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_ACQ_REL);
 
 	size_t queue_len = min(PFQ_SHARED_QUEUE_LEN(data), q->rx_slots);
 
 	nq->queue = (char *)(q->rx_queue_addr) + (qver & 1) * q->rx_queue_size;
-	nq->index = (unsigned int)qver;
+	nq->index = epoch;
 	nq->len   = queue_len;
         nq->slot_size = q->rx_slot_size;
+	nq->size  = queue_len * q->rx_slot_size;
 
 	return Q_VALUE(q, (int)queue_len);
 }
@@ -1742,7 +2086,7 @@ pfq_recv(pfq_t *q, void *buf, size_t buflen, struct pfq_net_queue *nq, long int
 	if (pfq_read(q, nq, microseconds) < 0)
 		return -1;
 
-	memcpy(buf, nq->queue, q->rx_slot_size * nq->len);
+	memcpy(buf, nq->queue, nq->size);
 	return Q_OK(q);
 }
 
@@ -1771,6 +2115,219 @@ pfq_dispatch(pfq_t *q, pfq_handler_t cb, long int microseconds, char *user)
 }
 
 
+/* slots prefetched ahead of the ready scan of pfq_dispatch_batch */
+
+#define Q_DISPATCH_PREFETCH	4
+
+
+int
+pfq_dispatch_batch(pfq_t *q, pfq_batch_handler_t cb, long int microseconds, char *user)
+{
+	pfq_iterator_t it, it_end;
+	int n = 0;
+
+	if (pfq_read(q, &q->nq, microseconds) < 0)
+		return -1;
+
+	it = pfq_net_queue_begin(&q->nq);
+	it_end = pfq_net_queue_end(&q->nq);
+
+	while (it != it_end)
+	{
+		pfq_iterator_t first = it;
+		size_t len = 0;
+
+		/* the longest prefix of ready packets, prefetching the slots ahead */
+
+		while (it != it_end && pfq_pkt_ready(&q->nq, it))
+		{
+			if (q->nq.slot_size) {
+				pfq_iterator_t ahead = it + q->nq.slot_size * Q_DISPATCH_PREFETCH;
+				if (ahead < it_end) {
+					__builtin_prefetch(ahead);
+					__builtin_prefetch(ahead + 64);
+				}
+			}
+			it = pfq_net_queue_next(&q->nq, it);
+			len++;
+		}
+
+		if (len) {
+			cb(user, &q->nq, first, it, len);
+			n += (int)len;
+			continue;
+		}
+
+		/* spin only at the tail of the batch, waiting for the producer to commit the slot */
+
+		while (!pfq_pkt_ready(&q->nq, it))
+			pfq_relax();
+	}
+
+        return Q_VALUE(q, n);
+}
+
+
+pfq_set_t *
+pfq_set_open(void)
+{
+	pfq_set_t *s = calloc(1, sizeof(pfq_set_t));
+	if (s == NULL)
+		return NULL;
+
+	s->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (s->epfd == -1) {
+		free(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+
+int
+pfq_set_close(pfq_set_t *s)
+{
+	if (s == NULL)
+		return -1;
+
+	close(s->epfd);
+	free(s->q);
+	free(s);
+	return 0;
+}
+
+
+const char *
+pfq_set_error(pfq_set_t const *s)
+{
+	return s->error;
+}
+
+
+int
+pfq_set_add(pfq_set_t *s, pfq_t *q)
+{
+	struct epoll_event ev;
+	size_t n;
+
+	for(n = 0; n < s->size; n++)
+		if (s->q[n] == q)
+			return Q_ERROR(q, "PFQ: set: socket already added");
+
+	if (s->size == s->capacity) {
+		size_t capacity = s->capacity ? s->capacity * 2 : 8;
+		pfq_t **p = realloc(s->q, capacity * sizeof(pfq_t *));
+		if (p == NULL)
+			return Q_ERROR(q, "PFQ: set: out of memory");
+		s->q = p;
+		s->capacity = capacity;
+	}
+
+	/* edge-triggered: the kernel notifies the transition of the queue from empty to non-empty */
+
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.ptr = q;
+
+	if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, q->fd, &ev) == -1)
+		return Q_ERROR(q, "PFQ: set: epoll_ctl error");
+
+	s->q[s->size++] = q;
+	return Q_OK(q);
+}
+
+
+int
+pfq_set_remove(pfq_set_t *s, pfq_t *q)
+{
+	size_t n;
+
+	for(n = 0; n < s->size; n++)
+	{
+		if (s->q[n] == q) {
+			epoll_ctl(s->epfd, EPOLL_CTL_DEL, q->fd, NULL);
+			memmove(&s->q[n], &s->q[n+1], (s->size - n - 1) * sizeof(pfq_t *));
+			s->size--;
+			if (s->next > n)
+				s->next--;
+			return Q_OK(q);
+		}
+	}
+
+	return Q_ERROR(q, "PFQ: set: socket not found");
+}
+
+
+/* read the first non-empty queue of the set, starting from the round-robin cursor */
+
+static int
+pfq_set_read_any(pfq_set_t *s, pfq_t **q, struct pfq_net_queue *nq)
+{
+	size_t i;
+
+	for(i = 0; i < s->size; i++)
+	{
+		size_t idx = (s->next + i) % s->size;
+		pfq_t *p = s->q[idx];
+		struct pfq_shared_queue *qd = (struct pfq_shared_queue *)(p->shm_addr);
+		int ret;
+
+		if (qd == NULL || PFQ_SHARED_QUEUE_LEN(__atomic_load_n(&qd->rx.shinfo, __ATOMIC_RELAXED)) == 0)
+			continue;
+
+		ret = pfq_read(p, nq, 0);
+		if (ret < 0) {
+			s->error = pfq_error(p);
+			*q = p;
+			return -1;
+		}
+
+		if (nq->len == 0)
+			continue;
+
+		s->next = idx + 1;
+		*q = p;
+		return (int)nq->len;
+	}
+
+	return 0;
+}
+
+
+int
+pfq_set_read(pfq_set_t *s, pfq_t **q, struct pfq_net_queue *nq, long int microseconds)
+{
+	struct epoll_event events[16];
+	int ret, timeout;
+
+	*q = NULL;
+	nq->len = 0;
+	nq->size = 0;
+	s->error = NULL;
+
+	if (s->size == 0) {
+		s->error = "PFQ: set: empty set";
+		return -1;
+	}
+
+	ret = pfq_set_read_any(s, q, nq);
+	if (ret != 0)
+		return ret;
+
+	/* all the queues are empty: a single syscall waits for all the sockets */
+
+	timeout = microseconds < 0 ? -1 : (int)((microseconds + 999) / 1000);
+
+	ret = epoll_wait(s->epfd, events, 16, timeout);
+	if (ret < 0 && errno != EINTR) {
+		s->error = "PFQ: set: epoll_wait error";
+		return -1;
+	}
+
+	return pfq_set_read_any(s, q, nq);
+}
+
+
 int
 pfq_bind_tx(pfq_t *q, const char *dev, int queue, int tid)
 {
@@ -1804,6 +2361,87 @@ pfq_unbind_tx(pfq_t *q)
 }
 
 
+/* select the async queue: by flow hash, in round-robin or by index */
+
+static inline int
+pfq_tx_async_queue(pfq_t *q, const void *buf, int async)
+{
+	switch(async)
+	{
+	case Q_ANY_KTHREAD:
+		return (int)pfq_fold(pfq_symmetric_hash(buf), (unsigned int)q->tx_num_async);
+	case Q_RR_KTHREAD:
+		return (int)(q->tx_rr_queue % q->tx_num_async);
+	}
+
+	return (int)pfq_fold((unsigned int)async, (unsigned int)q->tx_num_async);
+}
+
+
+/* Q_RR_KTHREAD: account the n packets published, move to the next queue once the burst is complete */
+
+static inline void
+pfq_tx_rr_advance(pfq_t *q, int async, size_t n)
+{
+	if (async == Q_RR_KTHREAD && (q->tx_rr_count += n) >= q->tx_rr_batch) {
+		q->tx_rr_count = 0;
+		q->tx_rr_queue++;
+	}
+}
+
+
+int
+pfq_set_tx_rr_batch(pfq_t *q, size_t value)
+{
+	if (value == 0)
+		return Q_ERROR(q, "PFQ: Tx round-robin batch must be greater than 0");
+
+	q->tx_rr_batch = value;
+	return Q_OK(q);
+}
+
+
+/* get the slot of a Tx queue at offset off, NULL if still busy (not yet released by the kernel) */
+
+static inline struct pfq_pkthdr *
+pfq_tx_slot(pfq_t *q, int tss, ptrdiff_t off)
+{
+	struct pfq_pkthdr *hdr = (struct pfq_pkthdr *)((char *)q->tx_queue_addr + q->tx_queue_size * (size_t)(1+tss) + off);
+
+	if (unlikely(__atomic_load_n(&hdr->info.commit, __ATOMIC_ACQUIRE)))
+		return NULL;
+
+	return hdr;
+}
+
+
+/* offset of the slot that follows the one at offset off */
+
+static inline ptrdiff_t
+pfq_tx_next_off(pfq_t *q, ptrdiff_t off)
+{
+	off += (ptrdiff_t)q->tx_slot_size;
+	return (size_t)off < q->tx_queue_size ? off : 0;
+}
+
+
+/* publish the n slots filled (a single release store), ring the doorbell if the Tx thread is sleeping */
+
+static inline void
+pfq_tx_publish(pfq_t *q, struct pfq_shared_tx_queue *tx, int tss, ptrdiff_t next_off, size_t n)
+{
+	tx->prod.off = next_off;
+
+	__atomic_store_n(&tx->prod.head, tx->prod.head + n, __ATOMIC_RELEASE);
+
+	if (tss >= 0) {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (unlikely(__atomic_load_n(&tx->cons.need_wakeup, __ATOMIC_RELAXED)))
+			pfq_sync_queue(q, 1 + tss);
+	}
+}
+
+
 int
 pfq_send_raw( pfq_t *q
 	    , const void *buf
@@ -1814,10 +2452,8 @@ pfq_send_raw( pfq_t *q
 {
         struct pfq_shared_queue *sh_queue = (struct pfq_shared_queue *)(q->shm_addr);
         struct pfq_shared_tx_queue *tx;
-        unsigned int index;
-        ptrdiff_t offset, *poff_addr;
+        struct pfq_pkthdr *hdr;
         uint16_t caplen;
-        char *base_addr;
         int tss;
 
 	if (unlikely(q->shm_addr == NULL))
@@ -1827,8 +2463,7 @@ pfq_send_raw( pfq_t *q
 		if (unlikely(q->tx_num_async == 0))
 			return Q_ERROR(q, "PFQ: send: socket not bound to async thread");
 
-		tss = (int)pfq_fold((async == Q_ANY_KTHREAD ? pfq_symmetric_hash(buf) : (unsigned int)async)
-				   ,(unsigned int)q->tx_num_async);
+		tss = pfq_tx_async_queue(q, buf, async);
 
 		tx = (struct pfq_shared_tx_queue *)&sh_queue->tx_async[tss];
 	}
@@ -1837,35 +2472,170 @@ pfq_send_raw( pfq_t *q
 		tx = (struct pfq_shared_tx_queue *)&sh_queue->tx;
 	}
 
-	index = __atomic_load_n(&tx->cons.index, __ATOMIC_RELAXED);
-	if (index == __atomic_load_n(&tx->prod.index, __ATOMIC_RELAXED)) {
-		++index;
-		poff_addr = (index & 1) ? &tx->prod.off1 : &tx->prod.off0;
-                __atomic_store_n(poff_addr, 0, __ATOMIC_RELEASE);
-                __atomic_store_n(&tx->prod.index, index, __ATOMIC_RELEASE);
+	/* the slot is busy until released by the kernel (copied or, with zero-copy, completed) */
+
+	hdr = pfq_tx_slot(q, tss, tx->prod.off);
+	if (unlikely(hdr == NULL))
+		return Q_VALUE(q, 0);
+
+	caplen = (uint16_t)min(len, q->tx_slot_size - sizeof(struct pfq_pkthdr));
+
+	hdr->tstamp.tv64       = nsec;
+	hdr->len	       = (uint16_t)len;
+	hdr->caplen	       = (uint16_t)caplen;
+	hdr->info.data.copies  = copies;
+	hdr->info.flags        = 0;
+	hdr->info.commit       = 1;
+	__builtin_memcpy(hdr+1, buf, caplen);
+
+	pfq_tx_publish(q, tx, tss, pfq_tx_next_off(q, tx->prod.off), 1);
+	pfq_tx_rr_advance(q, async, 1);
+
+	return Q_VALUE(q, (int)len);
+}
+
+
+int
+pfq_send_batch( pfq_t *q
+	      , const struct iovec *pkts
+	      , size_t n
+	      , unsigned int copies
+	      , int async)
+{
+        struct pfq_shared_queue *sh_queue = (struct pfq_shared_queue *)(q->shm_addr);
+        struct pfq_shared_tx_queue *tx;
+        struct pfq_pkthdr *hdr;
+        ptrdiff_t off;
+        size_t i;
+        int tss;
+
+	if (unlikely(q->shm_addr == NULL))
+		return Q_ERROR(q, "PFQ: send: socket not enabled");
+
+	if (unlikely(n == 0))
+		return Q_VALUE(q, 0);
+
+	/* the whole batch goes to a single queue (by the flow hash of the first packet, with Q_ANY_KTHREAD) */
+
+	if (async != Q_NO_KTHREAD) {
+		if (unlikely(q->tx_num_async == 0))
+			return Q_ERROR(q, "PFQ: send: socket not bound to async thread");
+
+		tss = pfq_tx_async_queue(q, pkts[0].iov_base, async);
+
+		tx = (struct pfq_shared_tx_queue *)&sh_queue->tx_async[tss];
 	}
 	else {
-		poff_addr = (index & 1) ? &tx->prod.off1 : &tx->prod.off0;
+		tss = -1;
+		tx = (struct pfq_shared_tx_queue *)&sh_queue->tx;
 	}
 
-	base_addr = q->tx_queue_addr + q->tx_queue_size * (size_t)(2 * (1+tss) + (index & 1 ? 1 : 0));
-        offset = __atomic_load_n(poff_addr, __ATOMIC_RELAXED);
-	caplen = (uint16_t)min(len, q->tx_slot_size - sizeof(struct pfq_pkthdr));
+	off = tx->prod.off;
 
-        /* ensure there's enough space for the current packet */
+	for(i = 0; i < n; i++)
+	{
+		size_t len = pkts[i].iov_len;
+		uint16_t caplen;
 
-	if (likely(((size_t)(offset) + q->tx_slot_size) < q->tx_queue_size)) {
-		struct pfq_pkthdr *hdr = (struct pfq_pkthdr *)(base_addr + offset);
-		hdr->tstamp.tv64       = nsec;
+		hdr = pfq_tx_slot(q, tss, off);
+		if (unlikely(hdr == NULL))
+			break;
+
+		if (i + 1 < n) {
+			__builtin_prefetch(pkts[i+1].iov_base);
+			__builtin_prefetch((char *)hdr + q->tx_slot_size, 1);
+		}
+
+		caplen = (uint16_t)min(len, q->tx_slot_size - sizeof(struct pfq_pkthdr));
+
+		hdr->tstamp.tv64       = 0;
 		hdr->len	       = (uint16_t)len;
 		hdr->caplen	       = (uint16_t)caplen;
 		hdr->info.data.copies  = copies;
-		__builtin_memcpy(hdr+1, buf, caplen);
-                __atomic_store_n(poff_addr, offset + (ptrdiff_t)q->tx_slot_size, __ATOMIC_RELEASE);
-		return Q_VALUE(q, (int)len);
+		hdr->info.flags        = 0;
+		hdr->info.commit       = 1;
+		__builtin_memcpy(hdr+1, pkts[i].iov_base, caplen);
+
+		off = pfq_tx_next_off(q, off);
 	}
 
-	return Q_VALUE(q, 0);
+	if (likely(i != 0)) {
+		pfq_tx_publish(q, tx, tss, off, i);
+		pfq_tx_rr_advance(q, async, i);
+	}
+
+	return Q_VALUE(q, (int)i);
+}
+
+
+int
+pfq_forward( pfq_t *q
+	   , pfq_t const *rx
+	   , struct pfq_pkthdr const *h
+	   , const void *data
+	   , unsigned int copies
+	   , int async)
+{
+        struct pfq_shared_queue *sh_queue = (struct pfq_shared_queue *)(q->shm_addr);
+        struct pfq_shared_queue *rx_queue = (struct pfq_shared_queue *)(rx->shm_addr);
+        struct pfq_shared_tx_queue *tx;
+        struct pfq_fwd_descr *descr;
+        struct pfq_pkthdr *hdr;
+        ptrdiff_t rx_off;
+        size_t half;
+        int tss;
+
+	if (unlikely(q->shm_addr == NULL || rx->shm_addr == NULL))
+		return Q_ERROR(q, "PFQ: forward: socket not enabled");
+
+	/* packets not in the Rx queue of the socket are copied */
+
+	rx_off = (const char *)data - (const char *)rx->rx_queue_addr;
+	if (unlikely(rx_off < 0 || (size_t)rx_off >= rx->rx_queue_size * 2))
+		return pfq_send_raw(q, data, h->caplen, 0, copies, async);
+
+	/* the packet must lie in a single half of the Rx queue */
+
+	half = (size_t)rx_off / rx->rx_queue_size;
+	if (unlikely(h->caplen == 0 || (size_t)rx_off + h->caplen > (half + 1) * rx->rx_queue_size))
+		return Q_ERROR(q, "PFQ: forward: bad packet");
+
+	if (async != Q_NO_KTHREAD) {
+		if (unlikely(q->tx_num_async == 0))
+			return Q_ERROR(q, "PFQ: forward: socket not bound to async thread");
+
+		tss = pfq_tx_async_queue(q, data, async);
+
+		tx = (struct pfq_shared_tx_queue *)&sh_queue->tx_async[tss];
+	}
+	else {
+		tss = -1;
+		tx = (struct pfq_shared_tx_queue *)&sh_queue->tx;
+	}
+
+	hdr = pfq_tx_slot(q, tss, tx->prod.off);
+	if (unlikely(hdr == NULL))
+		return Q_VALUE(q, 0);
+
+	/* the slot references the Rx slot, whose half is held until the packet is transmitted */
+
+	descr = (struct pfq_fwd_descr *)(hdr+1);
+	descr->id  = rx->id;
+	descr->off = (uint64_t)((const char *)data - (const char *)rx->shm_addr);
+
+	hdr->tstamp.tv64       = 0;
+	hdr->len	       = h->len;
+	hdr->caplen	       = h->caplen;
+	hdr->info.data.copies  = copies;
+	hdr->info.flags        = Q_PKTHDR_TX_FWD;
+	hdr->info.commit       = 1;
+
+	__atomic_fetch_add(&rx_queue->rx.fwd_pending[half], 1, __ATOMIC_RELAXED);
+
+	pfq_tx_publish(q, tx, tss, pfq_tx_next_off(q, tx->prod.off), 1);
+	pfq_tx_rr_advance(q, async, 1);
+
+	return Q_VALUE(q, (int)h->len);
 }
 
 
@@ -1876,14 +2646,15 @@ pfq_send( pfq_t *q
 	, unsigned int copies
 	, size_t sync)
 {
-	int ret;
-	retry:
-	ret = pfq_send_raw(q, ptr, len, 0, copies, Q_NO_KTHREAD);
+	int ret = pfq_send_raw(q, ptr, len, 0, copies, Q_NO_KTHREAD);
 	if (ret == 0 || ++q->tx_attempt == sync) {
 		q->tx_attempt = 0;
 		pfq_sync_queue(q, 0);
+
+		/* the queue was full: retry once, the slots may still be in use (zero-copy) */
+
 		if (ret == 0)
-			goto retry;
+			ret = pfq_send_raw(q, ptr, len, 0, copies, Q_NO_KTHREAD);
 	}
 	return ret;
 }
@@ -41,7 +41,8 @@ struct pfq_net_queue
 {
 	pfq_iterator_t queue;		/* net queue */
 	size_t         len;		/* number of packets in the queue */
-	size_t         slot_size;
+	size_t         slot_size;	/* 0 for packed queues (variable-length slots) */
+	size_t         size;		/* size of the queue, in bytes */
 	uint32_t       index;		/* current queue index */
 };
 
@@ -64,6 +65,7 @@ struct pfq_data_int
 
 	size_t rx_slots;
 	size_t rx_slot_size;
+	int    rx_packed;
 
         size_t tx_slots;
 	size_t tx_slot_size;
@@ -74,6 +76,12 @@ struct pfq_data_int
 	size_t tx_attempt;
 	size_t tx_num_async;
 
+	size_t tx_rr_queue;	/* Q_RR_KTHREAD: current async queue */
+	size_t tx_rr_count;	/* Q_RR_KTHREAD: packets sent to the current queue */
+	size_t tx_rr_batch;	/* Q_RR_KTHREAD: packets per queue */
+
+	long int poll_spin;	/* pfq_poll: busy-polling time, in microseconds */
+
 	const char * error;
 
 	int fd;
@@ -85,4 +93,21 @@ struct pfq_data_int
 	struct pfq_net_queue nq;
 };
 
+
+/*! PFQ set: sockets consumed by a single thread */
+
+typedef struct pfq_set_int pfq_set_t;
+
+struct pfq_set_int
+{
+	pfq_t **q;		/* sockets of the set */
+	size_t size;
+	size_t capacity;
+	size_t next;		/* round-robin: the next socket to read */
+
+	const char * error;
+
+	int epfd;
+};
+
 #endif /* PFQ_INT_H */
@@ -29,6 +29,7 @@
 #endif
 
 #include <stddef.h>
+#include <sys/uio.h>
 
 #include <linux/pf_q.h>
 #include <linux/if_ether.h>
@@ -55,6 +56,7 @@ pfq_net_queue_init(struct pfq_net_queue *nq)
 	nq->queue     = NULL;
 	nq->len	      = 0;
 	nq->slot_size = 0;
+	nq->size      = 0;
 	nq->index     = 0;
 }
 
@@ -73,25 +75,36 @@ static inline
 pfq_iterator_t
 pfq_net_queue_end(struct pfq_net_queue const *nq)
 {
-        return nq->queue + nq->len * nq->slot_size;
+        return nq->queue + (nq->slot_size ? nq->len * nq->slot_size : nq->size);
 }
 
 /*! Return an iterator to the next slot. */
+/*!
+ * For packed queues, the size of the slot is computed from the
+ * caplen of the packet.
+ */
 
 static inline
 pfq_iterator_t
 pfq_net_queue_next(struct pfq_net_queue const *nq, pfq_iterator_t iter)
 {
-        return iter + nq->slot_size;
+        if (nq->slot_size)
+                return iter + nq->slot_size;
+        return (pfq_iterator_t)PFQ_SHARED_QUEUE_NEXT_PACKED_PKTHDR((struct pfq_pkthdr *)iter);
 }
 
 /*! Return an iterator to the previous slot. */
+/*!
+ * Not available for packed queues (NULL is returned).
+ */
 
 static inline
 pfq_iterator_t
 pfq_net_queue_prev(struct pfq_net_queue const *nq, pfq_iterator_t iter)
 {
-        return iter - nq->slot_size;
+        if (nq->slot_size)
+                return iter - nq->slot_size;
+        return NULL;
 }
 
 /*! Given an iterator, return a pointer to the packet header. */
@@ -233,6 +246,15 @@ extern char * pfq_hugepages_mountpoint(void);
 typedef void (*pfq_handler_t)(char *user, const struct pfq_pkthdr *h, const char *data);
 
 
+/*! pfq batch handler: function prototype. */
+/*!
+ * The span [begin, end) holds len packets ready to be read, to be visited
+ * with pfq_net_queue_next.
+ */
+
+typedef void (*pfq_batch_handler_t)(char *user, struct pfq_net_queue const *nq, pfq_iterator_t begin, pfq_iterator_t end, size_t len);
+
+
 /*! Return the string error. */
 /*!
  * Return a string of the most recent error.
@@ -327,15 +349,35 @@ extern int pfq_is_enabled(pfq_t const *q);
 
 
 /*! Enable/disable timestamping for packets. */
+/*!
+ * The value specifies the timestamp precision: Q_TSTAMP_OFF, Q_TSTAMP_ON
+ * (per-packet wall clock), Q_TSTAMP_BATCH (wall clock shared by the capture
+ * batch), Q_TSTAMP_TSC (raw TSC, see pfq_tsc_to_nsec) or Q_TSTAMP_HW
+ * (hardware timestamp, when provided by the NIC; Q_PKTHDR_HW_TSTAMP is set in
+ * the packet header flags). Hardware timestamping must be enabled on the device
+ * (SIOCSHWTSTAMP). Any other non-zero value selects Q_TSTAMP_ON.
+ */
 
 extern int pfq_timestamping_enable(pfq_t *q, int value);
 
 
 /*! Check whether timestamping for packets is enabled. */
+/*!
+ * Return the current timestamp precision.
+ */
 
 extern int pfq_is_timestamping_enabled(pfq_t const *q);
 
 
+/*! Convert a TSC timestamp (Q_TSTAMP_TSC) to nanoseconds since the Epoch. */
+/*!
+ * The conversion table is exported by the kernel in the shared memory, and
+ * refreshed every Q_TSC_REFRESH_PERIOD msec; the socket must be enabled.
+ */
+
+extern uint64_t pfq_tsc_to_nsec(pfq_t const *q, uint64_t tsc);
+
+
 /*! Set the weight of the socket for the steering phase. */
 
 extern int pfq_set_weight(pfq_t *q, int value);
@@ -385,6 +427,21 @@ extern size_t pfq_get_rx_slots(pfq_t const *q);
 extern size_t pfq_get_rx_slot_size(pfq_t const *q);
 
 
+/*! Enable/disable the packed Rx queue. */
+/*!
+ * In a packed queue slots are variable-length: each slot is aligned to
+ * PFQ_SLOT_ALIGNMENT and its size is given by the caplen of the packet.
+ * Must be set before the socket is enabled.
+ */
+
+extern int pfq_set_rx_packed(pfq_t *q, int value);
+
+
+/*! Check whether the Rx queue is packed. */
+
+extern int pfq_is_rx_packed(pfq_t const *q);
+
+
 /*! Specify the length of the Tx queue, in number of packets. */
 
 extern int pfq_set_tx_slots(pfq_t *q, size_t value);
@@ -400,6 +457,21 @@ extern size_t pfq_get_tx_slots(pfq_t const *q);
 extern size_t pfq_get_tx_slots(pfq_t const *q);
 
 
+/*! Enable/disable the zero-copy transmission. */
+/*!
+ * Packets are transmitted directly from the slots of the shared queue.
+ * A slot is reused only when the driver has completed the transmission of
+ * its packet. Devices that do not support scatter-gather fall back to the copy.
+ */
+
+extern int pfq_set_tx_zcopy(pfq_t *q, int value);
+
+
+/*! Check whether the zero-copy transmission is enabled. */
+
+extern int pfq_is_tx_zcopy(pfq_t const *q);
+
+
 
 /*! Bind the main group of the socket to the given device/queue. */
 /*!
@@ -448,6 +520,10 @@ extern int pfq_egress_unbind(pfq_t *q);
  *  The tid parameter specifies the index (id) of the transmitter
  *  thread. If 'Q_NO_KTHREAD' specified, bind refers to synchronous
  *  transmissions.
+ *
+ *  The memory of asynchronous queues is allocated by 'pfq_enable', therefore
+ *  binding a Tx thread to an enabled socket fails (EPERM): bind all the
+ *  Tx threads before enabling the socket.
  */
 
 extern int pfq_bind_tx(pfq_t *q, const char *dev, int queue, int core);
@@ -520,6 +596,42 @@ extern int pfq_group_fprog(pfq_t *q, int gid, struct sock_fprog const *);
 extern int pfq_group_fprog_reset(pfq_t *q, int gid);
 
 
+/*! Specify an eBPF program for the given group. */
+/*!
+ * The program is the file descriptor returned by bpf(BPF_PROG_LOAD), of
+ * BPF_PROG_TYPE_SOCKET_FILTER type (packets are dropped when it returns 0).
+ * It is run after the BPF filter, with access to the maps of the program.
+ * The descriptor can be closed afterwards.
+ */
+
+extern int pfq_group_bpf_prog(pfq_t *q, int gid, int fd);
+
+
+/*! Reset the eBPF program for the given group. */
+
+extern int pfq_group_bpf_prog_reset(pfq_t *q, int gid);
+
+
+/*! Map a key to a class in the given class table of the group. */
+/*!
+ * The tables (Q_CLASS_TABLES per group) are looked up by the pfq-lang
+ * function class_table, which evaluates a property of the packet as key.
+ * Entries can be updated while the computation is running.
+ */
+
+extern int pfq_group_class_table(pfq_t *q, int gid, int table, uint64_t key, int class_id);
+
+
+/*! Remove a key from the given class table of the group. */
+
+extern int pfq_group_class_table_del(pfq_t *q, int gid, int table, uint64_t key);
+
+
+/*! Remove all the keys from the given class table of the group. */
+
+extern int pfq_group_class_table_reset(pfq_t *q, int gid, int table);
+
+
 /*! Enable/disable vlan filtering for the given group. */
 
 extern int pfq_vlan_filters_enable(pfq_t *q, int gid, int toggle);
@@ -546,6 +658,15 @@ extern int pfq_vlan_reset_filter(pfq_t *q, int gid, int vid);
 extern int pfq_poll(pfq_t *q, long int microseconds /* = -1 -> infinite */);
 
 
+/*! Set the busy-polling time of pfq_poll, in microseconds. */
+/*!
+ * pfq_poll spins on the shared queue up to the given time before sleeping
+ * in the kernel. Default is 0 (no busy-polling).
+ */
+
+extern int pfq_set_poll_spin(pfq_t *q, long int microseconds);
+
+
 /*! Read packets in place. */
 /*!
  * Wait for packets and return the number of packets available.
@@ -578,6 +699,59 @@ extern int pfq_recv(pfq_t *q, void *buf, size_t buflen, struct pfq_net_queue *nq
 extern int pfq_dispatch(pfq_t *q, pfq_handler_t cb, long int microseconds, char *user);
 
 
+/*! Collect and process packets in batches. */
+/*! The callback is invoked once per span of packets ready to be read,
+ *  the longest available: the function waits for the producers only at
+ *  the tail of a span. The callback must have the following signature:
+ *
+ * typedef void (*pfq_batch_handler_t)(char *user, struct pfq_net_queue const *nq, pfq_iterator_t begin, pfq_iterator_t end, size_t len);
+ */
+
+extern int pfq_dispatch_batch(pfq_t *q, pfq_batch_handler_t cb, long int microseconds, char *user);
+
+
+/*! Open a set of sockets, consumed by a single thread. */
+/*!
+ * The sockets of a set are waited for with a single syscall (epoll) and
+ * read in round-robin. Return NULL on error.
+ */
+
+extern pfq_set_t *pfq_set_open(void);
+
+
+/*! Close the set (the sockets of the set are not closed). */
+
+extern int pfq_set_close(pfq_set_t *s);
+
+
+/*! Return the string of the most recent error of the set. */
+
+extern const char *pfq_set_error(pfq_set_t const *s);
+
+
+/*! Add an enabled socket to the set. */
+
+extern int pfq_set_add(pfq_set_t *s, pfq_t *q);
+
+
+/*! Remove a socket from the set. */
+
+extern int pfq_set_remove(pfq_set_t *s, pfq_t *q);
+
+
+/*! Read packets from the set. */
+/*!
+ * The queue of the first non-empty socket, starting from the one that
+ * follows the socket of the previous read (round-robin), is read in place.
+ * When all the queues are empty, wait for the sockets with a single
+ * epoll_wait (the timeout is in microseconds, rounded up to milliseconds).
+ * Return the number of packets and the socket they belong to in q (NULL
+ * when no packets are available), -1 on error (see pfq_set_error).
+ */
+
+extern int pfq_set_read(pfq_set_t *s, pfq_t **q, struct pfq_net_queue *nq, long int microseconds);
+
+
 /*! Return the memory size of the Rx queue. */
 
 extern size_t pfq_mem_size(pfq_t const *q);
@@ -608,22 +782,115 @@ extern int pfq_get_group_stats(pfq_t const *q, int gid, struct pfq_stats *stats)
 extern int pfq_get_group_counters(pfq_t const *q, int gid, struct pfq_counters *cs);
 
 
+/*! Return the socket statistics from the shared memory (no syscall). */
+/*!
+ * The snapshot is refreshed by the kernel every Q_CTRL_STATS_PERIOD msec
+ * and by pfq_ctrl_doorbell.
+ */
+
+extern int pfq_get_shared_stats(pfq_t const *q, struct pfq_stats *stats);
+
+
+/*! Return the statistics and the counters of a group from the shared memory (no syscall). */
+/*!
+ * The group must be watched (Q_CTRL_GROUP_WATCH command). Either stats or cs can be NULL.
+ */
+
+extern int pfq_get_shared_group_stats(pfq_t const *q, int gid, struct pfq_stats *stats, struct pfq_counters *cs);
+
+
+/*! Submit a command to the shared control ring. */
+/*!
+ * Commands (Q_CTRL_TX_QUEUE_XMIT, Q_CTRL_GROUP_WATCH, Q_CTRL_GROUP_UNWATCH)
+ * are executed in batch by pfq_ctrl_doorbell; their results are retrieved
+ * with pfq_ctrl_complete, along with user_data.
+ */
+
+extern int pfq_ctrl_submit(pfq_t *q, int op, int arg, uint64_t user_data);
+
+
+/*! Execute the commands submitted with a single syscall. */
+/*!
+ * The stats snapshot is refreshed as well. Return the number of commands executed.
+ */
+
+extern int pfq_ctrl_doorbell(pfq_t *q);
+
+
+/*! Retrieve up to n completions of the control ring. */
+/*!
+ * Return the number of completions stored in cqe. Completions must be retrieved,
+ * the kernel stops executing commands when the completion ring is full.
+ */
+
+extern int pfq_ctrl_complete(pfq_t *q, struct pfq_ctrl_cqe *cqe, size_t n);
+
+
 /*! Transmit the packets in the queue. */
+/*!
+ * Queue 0 is the queue of the socket enabled for synchronous transmission;
+ * queue n wakes up the kernel thread of the n-th asynchronous queue
+ * (done by pfq_send_raw when the thread is sleeping).
+ */
 
 extern int pfq_sync_queue(pfq_t *q, int queue);
 
 
 /*! Schedule packet transmission. */
 /*!
- * The packet is copied into a Tx queue.
+ * The packet is copied into a Tx queue. The async parameter selects the queue:
+ * Q_NO_KTHREAD for the synchronous queue, Q_ANY_KTHREAD for the async queue
+ * given by the flow hash of the packet, Q_RR_KTHREAD for the async queues in
+ * round-robin (see pfq_set_tx_rr_batch), or the index of an async queue.
+ * Tx queues are rings: the function never blocks and returns 0 when the next
+ * slot is not yet released by the kernel.
  */
 
 extern int pfq_send_raw(pfq_t *q, const void *ptr, size_t len, uint64_t nsec, unsigned int copies, int async);
 
 
+/*! Schedule the transmission of a batch of packets. */
+/*!
+ * The packets are copied into consecutive slots of a single Tx queue and
+ * published at once (async as in pfq_send_raw; with Q_ANY_KTHREAD the queue is
+ * selected by the flow hash of the first packet, with Q_RR_KTHREAD the packets
+ * stored count towards the round-robin batch). Return the number of packets
+ * stored, less than n when the queue is full. The synchronous queue is not
+ * flushed (see pfq_sync_queue).
+ */
+
+extern int pfq_send_batch(pfq_t *q, const struct iovec *pkts, size_t n, unsigned int copies, int async);
+
+
+/*! Forward a packet received by another socket, without copying it. */
+/*!
+ * The packet is referenced in place in the Rx queue of the socket rx (which
+ * must belong to the same user): the half of the queue that holds it is not
+ * given back to the kernel, and pfq_read on rx returns no packets, until the
+ * forwarded packets are transmitted (see pfq_sync_queue). Packets that are not
+ * in the Rx queue of rx are copied, as with pfq_send_raw; a packet that does
+ * not lie within a single half of the queue is rejected with an error.
+ * The async parameter and the return value are those of pfq_send_raw.
+ */
+
+extern int pfq_forward(pfq_t *q, pfq_t const *rx, struct pfq_pkthdr const *h, const void *data, unsigned int copies, int async);
+
+
+/*! Set the number of packets sent to an async queue before moving to the next one. */
+/*!
+ * Used by Q_RR_KTHREAD to spread a single stream of packets over all the
+ * async queues of the socket (e.g. bound to different hardware queues of a
+ * device, each drained by its own kernel thread). Default is 32.
+ */
+
+extern int pfq_set_tx_rr_batch(pfq_t *q, size_t value);
+
+
 /*! Store the packet and transmit the packets in the queue. */
 /*!
  * The queue is flushed every sync packets (0 means immediate synchronization).
+ * When the queue is full it is flushed and the packet is stored again: 0 is
+ * returned if the slot is still in use (zero-copy transmission in progress).
  * Requires the socket is bound for transmission to a net device and queue.
  * See 'pfq_bind_tx'.
  */
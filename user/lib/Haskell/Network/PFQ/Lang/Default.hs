@@ -36,6 +36,7 @@ module Network.PFQ.Lang.Default
       -- | Collection of predicates used in conditional expressions.
 
       is_ip
+    , is_ip6
     , is_udp
     , is_tcp
     , is_icmp
@@ -128,6 +129,7 @@ module Network.PFQ.Lang.Default
 
     , Network.PFQ.Lang.Default.filter
     , ip
+    , ip6
     , udp
     , tcp
     , icmp
@@ -164,6 +166,7 @@ module Network.PFQ.Lang.Default
     , double_steer_ip
     , steer_local_ip
     , steer_flow
+    , steer_frag
     , steer_local_net
     , steer_field
     , double_steer_field
@@ -177,6 +180,7 @@ module Network.PFQ.Lang.Default
     , broadcast
     , Network.PFQ.Lang.Default.drop
     , classify
+    , class_table
     , forward
     , forwardIO
     , link
@@ -206,8 +210,14 @@ module Network.PFQ.Lang.Default
     , unit
     , inc
     , dec
+    , limit_pps
+    , limit_bps
+    , sample
+    , sample_hash
     , mark
     , put_state
+    , snap
+    , snap_l4
 
     ) where
 
@@ -311,13 +321,16 @@ p `all_bit` x = Predicate "all_bit" p x () () () () () ()
 -- | Evaluate to /True/ if the Qbuff is an IPv4 packet.
 is_ip = Predicate "is_ip" () () () () () () () ()
 
+-- | Evaluate to /True/ if the Qbuff is an IPv6 packet.
+is_ip6 = Predicate "is_ip6" () () () () () () () ()
+
 -- | Evaluate to /True/ if the Qbuff is an UDP packet.
 is_udp = Predicate "is_udp" () () () () () () () ()
 
 -- | Evaluate to /True/ if the Qbuff is a TCP packet.
 is_tcp = Predicate "is_tcp" () () () () () () () ()
 
--- | Evaluate to /True/ if the Qbuff is an ICMP packet.
+-- | Evaluate to /True/ if the Qbuff is an ICMP (or ICMPv6) packet.
 is_icmp = Predicate "is_icmp" () () () () () () () ()
 
 -- | Evaluate to /True/ if the Qbuff is an UDP or TCP packet.
@@ -540,6 +553,15 @@ steer_local_ip d = Function "steer_local_ip" d () () () () () () () :: NetFuncti
 -- > steer_flow >-> log_msg "Steering a flow"
 steer_flow = Function "steer_flow" () () () () () () () () :: NetFunction
 
+-- | Dispatch the packet across the sockets like 'steer_flow', keeping
+-- the fragments of a datagram together (hashed on src, dst, proto and ip id).
+-- A non-zero table size enables a per-CPU table that steers the trailing
+-- fragments along with the flow of the first one.
+--
+-- > steer_frag 256
+steer_frag :: Int -> NetFunction
+steer_frag n = Function "steer_frag" n () () () () () () () :: NetFunction
+
 -- | Dispatch the packet across the sockets
 -- with a randomized algorithm that guarantees
 -- RTP/RTCP flows consistency.
@@ -607,13 +629,16 @@ filter p = Function "filter" p () () () () () () ()
 -- | Evaluate to /Pass Qbuff/ if it is an IPv4 packet, /Drop/ it otherwise.
 ip = Function "ip" () () () () () () () () :: NetFunction
 
+-- | Evaluate to /Pass Qbuff/ if it is an IPv6 packet, /Drop/ it otherwise.
+ip6 = Function "ip6" () () () () () () () () :: NetFunction
+
 -- | Evaluate to /Pass Qbuff/ if it is an UDP packet, /Drop/ it otherwise.
 udp = Function "udp" () () () () () () () () :: NetFunction
 
 -- | Evaluate to /Pass Qbuff/ if it is a TCP packet, /Drop/ it otherwise.
 tcp = Function "tcp" () () () () () () () () :: NetFunction
 
--- | Evaluate to /Pass Qbuff/ if it is an ICMP packet, /Drop/ it otherwise.
+-- | Evaluate to /Pass Qbuff/ if it is an ICMP (or ICMPv6) packet, /Drop/ it otherwise.
 icmp = Function "icmp" () () () () () () () () :: NetFunction
 
 -- | Evaluate to /Pass Qbuff/ if it has a vlan tag, /Drop/ it otherwise.
@@ -718,6 +743,13 @@ drop= Function "drop" () () () () () () () () :: NetFunction
 classify :: Int -> NetFunction
 classify n = Function "classify" n () () () () () () ()
 
+-- | Specify the class for the given packet, looked up by key (the value of the property)
+-- in a class table of the group. Packets whose key is not found are dropped.
+--
+-- > class_table 0 ip_tos
+class_table :: Int -> NetProperty -> NetFunction
+class_table n p = Function "class_table" n p () () () () () ()
+
 -- | Unit operation implements left- and right-identity for Action monad.
 unit = Function "unit" () () () () () () () () :: NetFunction
 
@@ -749,6 +781,40 @@ inc n = Function "inc" n () () () () () () ()
 dec :: Int -> NetFunction
 dec n = Function "dec" n () () () () () () ()
 
+-- | Limit the rate of packets (per second) by means of a token bucket.
+-- Packets exceeding the rate are dropped and counted in the given counter of
+-- the group (-1 to disable). The rate is evenly split among the cpus online
+-- when the computation is loaded; cpus brought online later get a share as well.
+--
+-- > limit_pps 1000000 0 >-> steer_flow
+limit_pps :: Word64 -> Int -> NetFunction
+limit_pps r c = Function "limit_pps" r c () () () () () ()
+
+-- | Limit the rate of bits (per second) by means of a token bucket.
+-- Packets exceeding the rate are dropped and counted in the given counter of
+-- the group (-1 to disable). The rate is evenly split among the cpus online
+-- when the computation is loaded; cpus brought online later get a share as well.
+--
+-- > limit_bps 1000000000 0
+limit_bps :: Word64 -> Int -> NetFunction
+limit_bps r c = Function "limit_bps" r c () () () () () ()
+
+-- | Sample one packet out of n, the others are dropped and counted
+-- in the given counter of the group (-1 to disable).
+--
+-- > sample 100 1
+sample :: Int -> Int -> NetFunction
+sample n c = Function "sample" n c () () () () () ()
+
+-- | Sample one flow out of n (by hash), the others are dropped and counted
+-- in the given counter of the group (-1 to disable). IP fragments are sampled
+-- by addresses and protocol only, and may not share the fate of the
+-- unfragmented packets of their flow.
+--
+-- > sample_hash 100 1
+sample_hash :: Int -> Int -> NetFunction
+sample_hash n c = Function "sample_hash" n c () () () () () ()
+
 -- | Mark the packet with the given value.
 -- This function is unsafe in that it breaks the pure functional paradigm.
 -- Consider using `put_state` instead.
@@ -757,6 +823,22 @@ dec n = Function "dec" n () () () () () () ()
 mark :: Word32 -> NetFunction
 mark n = Function "mark" n () () () () () () ()
 
+-- | Copy at most the given number of bytes (at least 1) of the packet to the
+-- sockets of the group. The socket caplen still applies. The snap is per
+-- socket: a socket that receives the packet from more groups gets the largest
+-- snap of them, and the whole packet if any of them does not snap it.
+--
+-- > when is_tcp (snap 128)
+snap :: Int -> NetFunction
+snap n = Function "snap" n () () () () () () ()
+
+-- | Copy the headers up to the transport layer plus the given number of bytes
+-- of payload. Packets that are not IP are copied in full.
+--
+-- > unless is_udp (snap_l4 0)
+snap_l4 :: Int -> NetFunction
+snap_l4 n = Function "snap_l4" n () () () () () () ()
+
 -- | Set the state of the computation to the given value.
 --
 -- > put_state 42
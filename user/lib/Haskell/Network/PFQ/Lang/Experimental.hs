@@ -44,6 +44,7 @@ module Network.PFQ.Lang.Experimental
     , dummy_cidrs
 
     , steer_gtp_usr
+    , steer_inner_flow
     , steer_key
 
     , gtp
@@ -131,6 +132,15 @@ steer_gtp_usr :: IPv4 -> Int -> NetFunction
 steer_gtp_usr net prefix = Function "steer_gtp_usr" net prefix () () () () () () :: NetFunction
 
 
+-- | Dispatch the packet across the sockets by the flow of the innermost
+-- IP header: IP-in-IP, GRE, GTP-U, VXLAN and MPLS are decapsulated.
+--
+-- > steer_inner_flow
+
+steer_inner_flow :: NetFunction
+steer_inner_flow = Function "steer_inner_flow" () () () () () () () () :: NetFunction
+
+
 -- | Dispatch the packet to a given socket with id.
 --
 -- > ip >-> steer_key key_5tuple
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pfq/pfq.h>
+
+#define MIN(a,b) (a < b ? a : b)
+
+void dispatch(char *user __attribute__((unused)), struct pfq_net_queue const *nq, pfq_iterator_t it, pfq_iterator_t it_end, size_t len)
+{
+        printf("span: %zu packets\n", len);
+
+        for(; it != it_end; it = pfq_net_queue_next(nq, it))
+        {
+                const struct pfq_pkthdr *h = pfq_pkt_header(it);
+                const char *data = pfq_pkt_data(it);
+                int x;
+
+                for(x = 0; x < MIN(h->caplen,34); x++)
+                {
+                        printf("%2x ", (unsigned char)data[x]);
+                }
+                printf("\n");
+        }
+}
+
+int
+main(int argc, char *argv[])
+{
+        if (argc < 2) {
+                fprintf(stderr, "usage: %s dev\n", argv[0]);
+                return 0;
+        }
+
+        pfq_t *p = pfq_open(64, 4096, 64, 1024);
+        if (p == NULL) {
+                printf("error: %s\n", pfq_error(p));
+                return -1;
+        }
+
+        if (pfq_enable(p) < 0) {
+                printf("error: %s\n", pfq_error(p));
+                return -1;
+        }
+
+        if (pfq_is_enabled(p) != 1) {
+                printf("error: %s\n", pfq_error(p));
+                return -1;
+        }
+
+        int caplen = pfq_get_caplen(p);
+        if (caplen < 0) {
+		printf("error: %s\n", pfq_error(p));
+		return -1;
+        }
+
+        printf("caplen: %d\n", caplen);
+
+        int id = pfq_id(p);
+        if (id < 0) {
+		printf("error: %s\n", pfq_error(p));
+		return -1;
+        }
+
+        printf("id: %d\n", id);
+
+        if (pfq_bind(p, argv[1], Q_ANY_QUEUE) < 0) {
+		printf("error: %s\n", pfq_error(p));
+		return -1;
+        }
+
+        int n = 0;
+	printf("dispatching...\n");
+
+	for(;n < 10; n++) {
+                int many = pfq_dispatch_batch(p, dispatch, 1000000, NULL);
+                if (many < 0) {
+                        printf("error: %s\n", pfq_error(p));
+			break;
+                }
+		printf("queue length: %d\n", many);
+        }
+
+        struct pfq_stats s;
+	if(pfq_get_stats(p, &s) < 0) {
+                printf("error: %s\n", pfq_error(p));
+                return -1;
+        }
+
+        printf("stats:: recv=%lu lost=%lu drop=%lu\n", s.recv, s.lost, s.drop);
+
+	pfq_close(p);
+        return 0;
+}
+
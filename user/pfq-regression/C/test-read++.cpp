@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <cstdlib>
+#include <string>
 
 #include <pfq/pfq.hpp>
 
@@ -8,7 +9,7 @@ int
 main(int argc, char *argv[])
 {
     if (argc < 2) {
-        fprintf(stderr, "usage: %s dev\n", argv[0]);
+        fprintf(stderr, "usage: %s dev [packed]\n", argv[0]);
         return 0;
     }
 
@@ -16,6 +17,9 @@ main(int argc, char *argv[])
 
     q.bind(argv[1]);
 
+    if (argc > 2 && std::string(argv[2]) == "packed")
+        q.rx_packed(true);
+
     q.enable();
 
     q.timestamping_enable(true);
@@ -119,6 +119,27 @@ auto g = Group("PFQ")
     })
 
 
+    .Single("timestamp_precision", []
+    {
+        pfq::socket x;
+        AssertThrow(x.timestamping_precision(pfq::tstamp::batch));
+
+        x.open(pfq::group_policy::undefined, 64);
+
+        x.timestamping_precision(pfq::tstamp::batch);
+        Assert(x.timestamping_precision(), is_equal_to(Q_TSTAMP_BATCH));
+
+        x.timestamping_precision(pfq::tstamp::hw);
+        Assert(x.timestamping_precision(), is_equal_to(Q_TSTAMP_HW));
+
+        x.timestamping_precision(42);
+        Assert(x.timestamping_precision(), is_equal_to(Q_TSTAMP_ON));
+
+        x.timestamping_precision(pfq::tstamp::off);
+        Assert(x.is_timestamping_enabled(), is_equal_to(false));
+    })
+
+
     .Single("caplen", []
     {
         pfq::socket x;
@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <pfq/pfq.h>
 
 #include <pthread.h>
@@ -65,6 +66,49 @@ void test_timestamp()
 }
 
 
+void test_timestamp_precision()
+{
+	pfq_t * q = pfq_open(64, 1024, 64, 1024);
+        assert(q);
+
+	assert(pfq_timestamping_enable(q, Q_TSTAMP_BATCH) == 0);
+	assert(pfq_is_timestamping_enabled(q) == Q_TSTAMP_BATCH);
+	assert(pfq_timestamping_enable(q, Q_TSTAMP_HW) == 0);
+	assert(pfq_is_timestamping_enabled(q) == Q_TSTAMP_HW);
+
+	/* legacy: any other non-zero value enables the default precision */
+
+	assert(pfq_timestamping_enable(q, 42) == 0);
+	assert(pfq_is_timestamping_enabled(q) == Q_TSTAMP_ON);
+	assert(pfq_timestamping_enable(q, -1) == 0);
+	assert(pfq_is_timestamping_enabled(q) == Q_TSTAMP_ON);
+
+	/* TSC: not supported on every architecture */
+
+	assert(pfq_enable(q) == 0);
+	if (pfq_timestamping_enable(q, Q_TSTAMP_TSC) == 0) {
+		assert(pfq_is_timestamping_enabled(q) == Q_TSTAMP_TSC);
+#if defined(__x86_64__) || defined(__i386__)
+		{
+			struct timespec now;
+			uint64_t nsec = pfq_tsc_to_nsec(q, __builtin_ia32_rdtsc());
+			int64_t diff;
+			clock_gettime(CLOCK_REALTIME, &now);
+			diff = (int64_t)((uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec - nsec);
+			assert(diff > -1000000000LL && diff < 1000000000LL);
+		}
+#endif
+	}
+	else
+		assert(pfq_is_timestamping_enabled(q) == Q_TSTAMP_ON);
+
+	assert(pfq_timestamping_enable(q, Q_TSTAMP_OFF) == 0);
+	assert(pfq_is_timestamping_enabled(q) == 0);
+
+	pfq_close(q);
+}
+
+
 void test_caplen()
 {
 	pfq_t * q = pfq_open(64, 1024, 64, 1024);
@@ -581,6 +625,8 @@ void test_tx_thread()
         assert(pfq_bind_tx(q, "lo", Q_ANY_QUEUE, 0) == 0);
         assert(pfq_enable(q) == 0);
 
+        assert(pfq_bind_tx(q, "lo", Q_ANY_QUEUE, 0) == -1);
+
         pfq_close(q);
 }
 
@@ -628,6 +674,7 @@ main(int argc __attribute__((unused)), char *argv[]__attribute__((unused)))
 	TEST(test_is_enabled);
 	TEST(test_ifindex);
 	TEST(test_timestamp);
+	TEST(test_timestamp_precision);
 	TEST(test_caplen);
 	TEST(test_xmitlen);
 	TEST(test_rx_slots);
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pfq/pfq.h>
+
+#define MAX_SOCKETS 16
+
+int
+main(int argc, char *argv[])
+{
+        pfq_t *q[MAX_SOCKETS];
+        int n, nsock = 0;
+
+        if (argc < 2) {
+                fprintf(stderr, "usage: %s dev [dev...]\n", argv[0]);
+                return 0;
+        }
+
+        pfq_set_t *s = pfq_set_open();
+        if (s == NULL) {
+                printf("error: pfq_set_open\n");
+                return -1;
+        }
+
+        for(n = 1; n < argc && nsock < MAX_SOCKETS; n++)
+        {
+                pfq_t *p = pfq_open(64, 4096, 64, 1024);
+                if (p == NULL) {
+                        printf("error: %s\n", pfq_error(p));
+                        return -1;
+                }
+
+                if (pfq_enable(p) < 0) {
+                        printf("error: %s\n", pfq_error(p));
+                        return -1;
+                }
+
+                if (pfq_bind(p, argv[n], Q_ANY_QUEUE) < 0) {
+                        printf("error: %s\n", pfq_error(p));
+                        return -1;
+                }
+
+                if (pfq_set_add(s, p) < 0) {
+                        printf("error: %s\n", pfq_error(p));
+                        return -1;
+                }
+
+                printf("reading from %s (socket %d)...\n", argv[n], pfq_id(p));
+                q[nsock++] = p;
+        }
+
+        for(n = 0; n < 100; n++)
+        {
+                struct pfq_net_queue nq;
+                pfq_t *p;
+
+                int many = pfq_set_read(s, &p, &nq, 1000000);
+                if (many < 0) {
+                        printf("error: %s\n", pfq_set_error(s));
+                        break;
+                }
+
+                if (p == NULL) {
+                        printf("timeout\n");
+                        continue;
+                }
+
+                printf("socket %d: queue length: %zd\n", pfq_id(p), nq.len);
+        }
+
+        pfq_set_close(s);
+
+        for(n = 0; n < nsock; n++)
+                pfq_close(q[n]);
+
+        return 0;
+}
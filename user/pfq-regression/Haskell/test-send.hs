@@ -77,8 +77,8 @@ sender xs = do
     fp <- Q.open 64 1024 64 1024
 
     Q.withPfq fp  $ \q -> do
-            Q.enable q
             Q.bindTx q dev queue kthread
+            Q.enable q
 
             if kthread /= -1
             then do
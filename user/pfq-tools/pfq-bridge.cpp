@@ -113,7 +113,11 @@ void make_user_bridge(int gid, Bridge const &b)
                     auto h = *pkt;
                     const unsigned char *buff = static_cast<unsigned char *>(pkt.data());
 
-                    out.send(pfq::const_buffer(reinterpret_cast<const char *>(buff), h.len), b.queue);
+                    // zero-copy: the packet is transmitted from the Rx queue of 'in'
+                    //
+
+                    while (!out.forward(in, h, reinterpret_cast<const char *>(buff)))
+                        out.sync_queue(0);
                 }
 
                 out.sync_queue(0);
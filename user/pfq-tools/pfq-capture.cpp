@@ -66,6 +66,7 @@ namespace opt
     bool promisc   = true;
     bool dump      = false;
     bool verbose   = false;
+    bool hw_tstamp = false;
 
     std::string dumpfile;
 
@@ -103,7 +104,7 @@ namespace thread
 {
     namespace pcap_emu
     {
-        uint32_t constexpr magic_number = 0xA1B2C3D4;
+        uint32_t constexpr magic_number = 0xA1B23C4D; // nanosecond resolution
         int constexpr zone_gmt = 0;
 
         struct file_header
@@ -120,7 +121,7 @@ namespace thread
         struct pkthdr
         {
             uint32_t sec;
-            uint32_t usec;
+            uint32_t nsec;
             uint32_t caplen;
             uint32_t len;
         };
@@ -193,7 +194,7 @@ namespace thread
 
             if (!m_filename.empty() || opt::dump)
             {
-                m_pfq.timestamping_enable(true);
+                m_pfq.timestamping_precision(opt::hw_tstamp ? tstamp::hw : tstamp::on);
             }
 
             if (!m_filename.empty())
@@ -224,7 +225,7 @@ namespace thread
                         const unsigned char *buff = static_cast<unsigned char *>(it.data());
 
                         if (m_file)
-                            pcap_write_(buff, h.len, h.caplen, h.tstamp.tv.sec, h.tstamp.tv.nsec/1000);
+                            pcap_write_(buff, h.len, h.caplen, h.tstamp.tv.sec, h.tstamp.tv.nsec);
 
                         if (opt::dump) {
                             printf("%d:%d [%d] (%d/%d)",
@@ -348,12 +349,12 @@ namespace thread
             m_file = nullptr;
         }
 
-        void pcap_write_(const unsigned char *ptr, size_t len, size_t caplen, uint32_t sec, uint32_t usec)
+        void pcap_write_(const unsigned char *ptr, size_t len, size_t caplen, uint32_t sec, uint32_t nsec)
         {
             pcap_emu::pkthdr header;
 
             header.sec = sec;
-            header.usec = usec;
+            header.nsec = nsec;
             header.caplen = (uint32_t)caplen;
             header.len = (uint32_t)len;
 
@@ -393,6 +394,7 @@ void usage(std::string name)
         " -s --slot INT                 Set slots\n"
         "    --seconds INT              Terminate after INT seconds\n"
         "    --no-promisc               Disable promiscuous mode (enabled by default)\n"
+        "    --hw-tstamp                Use hardware timestamps, if provided by the NIC\n"
         " -f --function FUNCTION\n"
         " -t --thread BINDING\n\n"
         "      " + more::netdev_format + "\n"
@@ -514,6 +516,12 @@ try
             continue;
         }
 
+        if ( any_strcmp(argv[i], "--hw-tstamp") )
+        {
+            opt::hw_tstamp = true;
+            continue;
+        }
+
         if (any_strcmp(argv[i], "-h", "-?", "--help"))
             usage(argv[0]);
 
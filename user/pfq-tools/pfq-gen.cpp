@@ -127,6 +127,7 @@ namespace opt
     bool   rand_flow   = false;
     bool   interactive = false;
     bool   checksum    = false;
+    bool   zcopy       = false;
 
     double rate = 0;
 
@@ -271,6 +272,11 @@ namespace thread
 
             m_async = kthread != std::vector<int>{-1};
 
+            // without randomization all packets belong to the same flow: spread them in round-robin
+            //
+
+            m_spread = (opt::rand_src_ip || opt::rand_dst_ip) ? pfq::any_kthread : pfq::rr_kthread;
+
             auto q = pfq::socket(param::list, param::tx_slots{opt::slots});
 
             std::cout << "thread     : " << id << " -> "  << show(m_bind) << " kthread { ";
@@ -300,6 +306,9 @@ namespace thread
 
         void operator()()
         {
+            if (opt::zcopy)
+                m_pfq.tx_zcopy(true);
+
             m_pfq.enable();
 
             if (!m_packet)
@@ -313,7 +322,10 @@ namespace thread
 #endif
             }
             else if (opt::preload > 1) {
-                pool_generator();
+                if (opt::rate == 0.0 && !opt::interactive)
+                    pool_generator_bulk();
+                else
+                    pool_generator();
             }
             else generator();
 
@@ -366,7 +378,7 @@ namespace thread
 
                 if (m_async)
                 {
-                    if (!m_pfq.send_async(pfq::const_buffer(reinterpret_cast<const char *>(m_packet.get()), len), opt::copies))
+                    if (!m_pfq.send_async(pfq::const_buffer(reinterpret_cast<const char *>(m_packet.get()), len), opt::copies, m_spread))
                     {
                         m_fail->fetch_add(1, std::memory_order_relaxed);
                         continue;
@@ -438,7 +450,7 @@ namespace thread
 
                 if (m_async)
                 {
-                    if (!m_pfq.send_async(pfq::const_buffer(reinterpret_cast<const char *>(m_packet.get() + idx * opt::len), len), opt::copies))
+                    if (!m_pfq.send_async(pfq::const_buffer(reinterpret_cast<const char *>(m_packet.get() + idx * opt::len), len), opt::copies, m_spread))
                     {
                         m_fail->fetch_add(1, std::memory_order_relaxed);
                         continue;
@@ -467,6 +479,48 @@ namespace thread
         }
 
 
+        void pool_generator_bulk()
+        {
+            std::cout << "generator  : " << opt::preload << " preloaded packets (bulk)..." << std::endl;
+
+            auto len = opt::len;
+
+            const size_t bulk_size = 32;
+
+            std::vector<pfq::const_buffer> batch;
+            batch.reserve(bulk_size);
+
+            size_t idx = 0;
+
+            for(size_t n = 0; n < opt::npackets;)
+            {
+                batch.clear();
+
+                for(size_t i = 0; i < std::min(bulk_size, opt::npackets - n); i++)
+                    batch.emplace_back(reinterpret_cast<const char *>(m_packet.get() + ((idx + i) & (opt::preload-1)) * opt::len), len);
+
+                auto sent = m_pfq.send(batch, opt::copies, m_async ? m_spread : pfq::no_kthread);
+
+                if (!m_async)
+                    m_pfq.sync_queue(0);
+
+                if (sent < batch.size())
+                    m_fail->fetch_add(1, std::memory_order_relaxed);
+
+                idx += sent;
+                n   += sent;
+
+                m_sent->fetch_add(sent, std::memory_order_relaxed);
+                m_band->fetch_add(len * sent, std::memory_order_relaxed);
+                m_gros->fetch_add((len+24) * sent, std::memory_order_relaxed);
+
+                if (opt::stop.load(std::memory_order_relaxed))
+                    break;
+            }
+
+        }
+
+
 #ifdef HAVE_PCAP_H
         void pcap_replay()
         {
@@ -604,6 +658,7 @@ namespace thread
         std::unique_ptr<char[]> m_packet;
 
         bool m_async;
+        int  m_spread;
     };
 
 }
@@ -655,6 +710,7 @@ void usage(std::string name)
         " -k --kthread IDX,IDX...       Async with kernel threads\n"
         " -s --queue-slots INT          Set Tx queue length\n"
         " -S --queue-sync INT           Set queue sync value, used to Tx sync\n"
+        " -Z --zero-copy                Transmit from the Tx queue without copying packets\n"
         " -t --thread BINDING\n\n"
         "      " + more::netdev_format + "\n" + "      " + more::thread_binding_format
     );
@@ -968,6 +1024,12 @@ try
             continue;
         }
 
+        if ( any_strcmp(argv[i], "-Z", "--zero-copy") )
+        {
+            opt::zcopy = true;
+            continue;
+        }
+
         if ( any_strcmp(argv[i], "--src-mac") )
         {
             if (++i == argc)
@@ -1115,6 +1177,7 @@ try
         std::cout << "seconds    : " << opt::seconds << std::endl;
 
     std::cout << "copies     : "  << opt::copies << std::endl;
+    std::cout << "zero-copy  : "  << std::boolalpha << opt::zcopy << std::endl;
 
     if (opt::rate != 0.0)
         std::cout << "rate       : "  << opt::rate << " Mpps" << std::endl;
@@ -1125,7 +1188,7 @@ try
         !opt::rand_dst_ip &&
         mq)
     {
-        std::cout << vt100::BOLD << "*** Multiple queue detected! Consider to randomize IP addresses with -R option! ***" << vt100::RESET << std::endl;
+        std::cout << vt100::BOLD << "*** Multiple queue detected! Packets are spread in round-robin (randomize IP addresses with -R for per-flow spreading) ***" << vt100::RESET << std::endl;
     }
 
     //